@@ -34,7 +34,7 @@ extern char *calloc();
 
 #define  TRUE  1
 #define  FALSE 0
-#define  MAX_STRING 1024
+#define  MAX_STRING MAX_CLI_LINE
 
 typedef char String[MAX_STRING];
 
@@ -67,6 +67,10 @@ warranty of merchantability or fitness for a particular purpose.
 #define  END_SET    else return (0);    \
                   return (1);
 
+/* longest line of commands, and so the longest parameter */
+
+#define  MAX_CLI_LINE  1024
+
 /* external declarations */
 
 int file_is_open();
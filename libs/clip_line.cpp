@@ -26,11 +26,11 @@ warranty of merchantability or fitness for a particular purpose.
 #include <stdio.h>
 #include <math.h>
 
-/* the clipping window */
-static float xmin = 0.0;
-static float xmax = 1.0;
-static float ymin = 0.0;
-static float ymax = 1.0;
+/* the clipping window, which each thread sets for itself */
+static thread_local float xmin = 0.0;
+static thread_local float xmax = 1.0;
+static thread_local float ymin = 0.0;
+static thread_local float ymax = 1.0;
 
 
 /******************************************************************************
@@ -401,6 +401,47 @@ void FloatImage::update_row(Window2d *win, int row)
 }
 
 
+/******************************************************************************
+Update a rectangle of an image.  Must have called "FloatImage::draw()" first
+because of the max and min values.
+
+Entry:
+  win   - window to display in
+  x0,y0 - lower corner of rectangle (inclusive)
+  x1,y1 - upper corner of rectangle (exclusive)
+******************************************************************************/
+
+void FloatImage::draw_region(Window2d *win, int x0, int y0, int x1, int y1)
+{
+  int i, j;
+  int win_width, win_height;
+  int dup;
+
+  win->getsize(&win_width, &win_height);
+
+  dup = (int) (win_width / xsize);
+
+  int width = (x1 - x0) * dup;
+  int height = (y1 - y0) * dup;
+
+  unsigned char *image_data;
+  image_data = new unsigned char[width * height];
+
+  for (j = 0; j < height; j++)
+    for (i = 0; i < width; i++) {
+      float t = (pixel(x0 + i / dup, y0 + j / dup) - saved_min) /
+                (saved_max - saved_min);
+      if (t < 0) t = 0;
+      if (t > 1) t = 1;
+      image_data[i + j * width] = (int) (255.0 * t);
+    }
+
+  win->draw_offset_image(width, height, image_data,
+                         x0 * dup, (ysize - y1) * dup);
+  delete[] image_data;
+}
+
+
 /******************************************************************************
 Display an image containing floats in a window.
 
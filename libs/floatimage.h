@@ -95,6 +95,8 @@ public:
 
     void update_row(Window2d *, int);
 
+    void draw_region(Window2d *, int, int, int, int);
+
     void draw_clamped(Window2d *, float, float);
 
     int read_pgm(char *);
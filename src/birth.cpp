@@ -0,0 +1,298 @@
+/*
+
+Queue of the emptiest places in a low-pass image.
+
+Births used to be tried by walking the cells of the image in a
+pseudo-random order, making a trial streamline wherever a cell was below
+the birth threshold.  Here the pixels are instead kept in a heap ordered
+by how far each falls short of the target gray value, so the emptiest
+parts of the image are tried first and the search stops as soon as no
+pixel is sparse enough.  The image marks the tiles that each added or
+removed streamline touches, so only the pixels of those tiles have to be
+put back in order before the next look.
+
+---------------------------------------------------------------------
+
+Copyright (c) 1996 The University of North Carolina.  All rights reserved.
+
+Permission to use, copy, modify and distribute this software and its
+documentation for any purpose is hereby granted without fee, provided
+that the above copyright notice and this permission notice appear in
+all copies of this software and that you do not sell the software.
+
+The software is provided "as is" and without warranty of any kind,
+express, implied or otherwise, including without limitation, any
+warranty of merchantability or fitness for a particular purpose.
+
+*/
+
+
+#include <stdlib.h>
+#include "birth.h"
+
+
+/******************************************************************************
+Create a queue of the pixels of a low-pass image.
+
+Entry:
+  lowpass - image whose pixels to queue
+******************************************************************************/
+
+BirthQueue::BirthQueue(Lowpass *lowpass)
+{
+  low = lowpass;
+  xsize = low->xsize;
+  ysize = low->ysize;
+  tiles_x = (xsize + LOWPASS_TILE - 1) / LOWPASS_TILE;
+
+  int count = xsize * ysize;
+  heap = new int[count];
+  place = new int[count];
+  deficit = new float[count];
+  tiles = new int[low->num_tiles()];
+  tile_used = new char[low->num_tiles()];
+  aside = new int[count];
+
+  for (int t = 0; t < low->num_tiles(); t++)
+    tile_used[t] = 0;
+
+  /* put every pixel in the heap */
+
+  FloatImage *image = low->get_image_ptr();
+  float target = low->get_target();
+
+  for (int j = 0; j < ysize; j++)
+    for (int i = 0; i < xsize; i++) {
+      int p = j * xsize + i;
+      deficit[p] = target - image->pixel(i, j);
+      heap[p] = p;
+      place[p] = p;
+    }
+
+  num = count;
+  for (int n = num / 2 - 1; n >= 0; n--)
+    move_down(n);
+
+  seen = low->get_stamp();
+}
+
+
+/******************************************************************************
+Free up the queue.
+******************************************************************************/
+
+BirthQueue::~BirthQueue()
+{
+  delete[] heap;
+  delete[] place;
+  delete[] deficit;
+  delete[] tiles;
+  delete[] tile_used;
+  delete[] aside;
+}
+
+
+/******************************************************************************
+Move an entry of the heap towards the top until it is in order.
+
+Entry:
+  n - position of the entry in the heap
+******************************************************************************/
+
+void BirthQueue::move_up(int n)
+{
+  int p = heap[n];
+
+  while (n > 0) {
+    int parent = (n - 1) / 2;
+    if (deficit[heap[parent]] >= deficit[p])
+      break;
+    heap[n] = heap[parent];
+    place[heap[n]] = n;
+    n = parent;
+  }
+
+  heap[n] = p;
+  place[p] = n;
+}
+
+
+/******************************************************************************
+Move an entry of the heap towards the bottom until it is in order.
+
+Entry:
+  n - position of the entry in the heap
+******************************************************************************/
+
+void BirthQueue::move_down(int n)
+{
+  int p = heap[n];
+
+  while (1) {
+    int child = 2 * n + 1;
+    if (child >= num)
+      break;
+    if (child + 1 < num && deficit[heap[child + 1]] > deficit[heap[child]])
+      child++;
+    if (deficit[p] >= deficit[heap[child]])
+      break;
+    heap[n] = heap[child];
+    place[heap[n]] = n;
+    n = child;
+  }
+
+  heap[n] = p;
+  place[p] = n;
+}
+
+
+/******************************************************************************
+Add a pixel to the heap.
+
+Entry:
+  p - index of the pixel
+******************************************************************************/
+
+void BirthQueue::insert(int p)
+{
+  heap[num] = p;
+  place[p] = num;
+  num++;
+  move_up(num - 1);
+}
+
+
+/******************************************************************************
+Take a pixel out of the heap.
+
+Entry:
+  p - index of the pixel
+******************************************************************************/
+
+void BirthQueue::remove(int p)
+{
+  int n = place[p];
+  place[p] = -1;
+  num--;
+
+  if (n == num)
+    return;
+
+  /* fill the hole with the last entry and put that in order */
+
+  int last = heap[num];
+  heap[n] = last;
+  place[last] = n;
+  move_up(n);
+  move_down(place[last]);
+}
+
+
+/******************************************************************************
+Bring the queue up to date with the image, looking again at the pixels of
+the tiles that have changed since the last time.  Pixels that were taken
+from the queue are put back if their tile has changed.
+******************************************************************************/
+
+void BirthQueue::update()
+{
+  FloatImage *image = low->get_image_ptr();
+  float target = low->get_target();
+
+  int count = low->changed_tiles(seen, tiles);
+  seen = low->get_stamp();
+
+  for (int k = 0; k < count; k++) {
+
+    int x0, y0, x1, y1;
+    low->tile_bounds(tiles[k], x0, y0, x1, y1);
+
+    for (int j = y0; j < y1; j++)
+      for (int i = x0; i < x1; i++) {
+        int p = j * xsize + i;
+        float old = deficit[p];
+        deficit[p] = target - image->pixel(i, j);
+        if (place[p] < 0)
+          insert(p);
+        else if (deficit[p] > old)
+          move_up(place[p]);
+        else
+          move_down(place[p]);
+      }
+  }
+}
+
+
+/******************************************************************************
+Take the emptiest pixel from the queue, if it is below a threshold.
+
+Entry:
+  thresh - value that a pixel must be below
+
+Exit:
+  i,j     - the pixel
+  returns 1 if a pixel was found, 0 if none is below the threshold
+******************************************************************************/
+
+int BirthQueue::next(float thresh, int &i, int &j)
+{
+  return (next_batch(thresh, 1, &i, &j));
+}
+
+
+/******************************************************************************
+Take a number of the emptiest pixels from the queue, emptiest first, that
+are below a threshold.  At most one pixel is taken from each tile, so that
+the births tried together are spread over the sparse parts of the image
+rather than all crowded into the emptiest one.
+
+Entry:
+  thresh - value that a pixel must be below
+  max    - most pixels to take
+
+Exit:
+  is,js   - the pixels
+  returns how many were taken
+******************************************************************************/
+
+int BirthQueue::next_batch(float thresh, int max, int *is, int *js)
+{
+  update();
+
+  float least = low->get_target() - thresh;
+  int count = 0;
+  int skipped = 0;
+
+  while (count < max && num > 0 && deficit[heap[0]] > least) {
+
+    int p = heap[0];
+    int i = p % xsize;
+    int j = p / xsize;
+    int t = (j / LOWPASS_TILE) * tiles_x + i / LOWPASS_TILE;
+
+    /* a pixel from a tile already picked from is set aside */
+
+    remove(p);
+
+    if (tile_used[t]) {
+      aside[skipped++] = p;
+      continue;
+    }
+
+    tile_used[t] = 1;
+    tiles[count] = t;
+    is[count] = i;
+    js[count] = j;
+    count++;
+  }
+
+  /* put back the pixels that were set aside, and clear the tiles */
+
+  for (int k = 0; k < skipped; k++)
+    insert(aside[k]);
+
+  for (int k = 0; k < count; k++)
+    tile_used[tiles[k]] = 0;
+
+  return (count);
+}
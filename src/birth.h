@@ -0,0 +1,62 @@
+//
+//  Queue of the places in a low-pass image that are emptiest, for choosing
+//  where to birth new streamlines
+//
+
+/*
+Copyright (c) 1996 The University of North Carolina.  All rights reserved.
+
+Permission to use, copy, modify and distribute this software and its
+documentation for any purpose is hereby granted without fee, provided
+that the above copyright notice and this permission notice appear in
+all copies of this software and that you do not sell the software.
+
+The software is provided "as is" and without warranty of any kind,
+express, implied or otherwise, including without limitation, any
+warranty of merchantability or fitness for a particular purpose.
+*/
+
+
+#ifndef _BIRTH_QUEUE_
+#define _BIRTH_QUEUE_
+
+#include "lowpass.h"
+
+
+/* The pixels of a low-pass image are kept in a heap ordered by how far */
+/* each falls short of the target value.  A pixel that is taken from the */
+/* queue stays out of it until a streamline changes the tile it is in, */
+/* so a place where a birth was turned down isn't tried again until */
+/* something near it is different. */
+
+class BirthQueue
+{
+    Lowpass *low;          /* image whose pixels are queued */
+    int xsize, ysize;
+    int tiles_x;           /* number of tiles across the image */
+    int *heap;             /* pixels, the one furthest below target first */
+    int *place;            /* where each pixel is in the heap, or -1 */
+    float *deficit;        /* target minus each pixel's value */
+    int num;               /* number of pixels in the heap */
+    unsigned int seen;     /* image's stamp when the queue was last updated */
+    int *tiles;            /* scratch list of changed tiles */
+    char *tile_used;       /* tiles already picked from in a batch */
+    int *aside;            /* pixels set aside while picking a batch */
+
+    void move_up(int);
+    void move_down(int);
+    void insert(int);
+    void remove(int);
+public:
+    BirthQueue(Lowpass *);
+
+    ~BirthQueue();
+
+    void update();
+
+    int next(float, int &, int &);
+
+    int next_batch(float, int, int *, int *);
+};
+
+#endif /* _BIRTH_QUEUE_ */
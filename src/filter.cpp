@@ -0,0 +1,464 @@
+/*
+
+The radially symmetric filter used to make low-pass images of streamlines.
+
+The filter is the cubic f(t) = (2t - 3) t^2 + 1 for t <= 1, and zero beyond.
+A line segment's contribution to a pixel is the integral of the filter along
+the segment, which is found from the "summed" filter F(r,h): the integral
+of f along a line at distance r from the filter's center, from the closest
+point on the line out to distance h along it.  There are three ways of
+finding F:
+
+  FILTER_TABLE     the original 30 by 30 table, interpolated bilinearly
+  FILTER_HIRES     a 257 by 257 table that the compiler builds, using
+                   Simpson's rule on each interval
+  FILTER_ANALYTIC  the integral itself, in closed form
+
+With s^2 = r^2 + h^2, the integral is
+
+  F(r,h) = h - 3 r^2 h - h^3
+           + h (2 h^2 + 5 r^2) s / 4 + 3 r^4 asinh(h / r) / 4
+
+for h out to the edge of the filter, sqrt(1 - r^2), and constant beyond.
+
+All three are immutable once made (the original table is made the first
+time it is asked for, which C++ makes safe from several threads at once),
+so low-pass images can be evaluated in parallel.  Only the choice of which
+one to use is global.
+
+---------------------------------------------------------------------
+
+Copyright (c) 1996 The University of North Carolina.  All rights reserved.
+
+Permission to use, copy, modify and distribute this software and its
+documentation for any purpose is hereby granted without fee, provided
+that the above copyright notice and this permission notice appear in
+all copies of this software and that you do not sell the software.
+
+The software is provided "as is" and without warranty of any kind,
+express, implied or otherwise, including without limitation, any
+warranty of merchantability or fitness for a particular purpose.
+
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "filter.h"
+#include "footprint.h"
+
+static int filter_type = FILTER_TABLE;
+
+
+/******************************************************************************
+The original table, made the same way it always was: a running sum of
+samples of the filter along each line.
+******************************************************************************/
+
+class CoarseTable
+{
+public:
+    float sum[FILTER_TABLE_SAMPLES][FILTER_TABLE_SAMPLES];
+
+    CoarseTable()
+    {
+      const int samples = FILTER_TABLE_SAMPLES;
+      float delta = 1.0 / (samples - 1);
+
+      for (int i = 0; i < samples; i++) {
+        float r = i * delta;
+        float s = 0;
+        for (int j = 0; j < samples; j++) {
+          float h = j * delta;
+          float t = sqrt(r * r + h * h);
+          float f = (2 * t - 3) * t * t + 1;
+          if (t > 1)
+            f = 0;
+          sum[i][j] = s;
+          s += f * delta;
+        }
+      }
+    }
+};
+
+static const float *coarse_table()
+{
+  static const CoarseTable table;
+  return (&table.sum[0][0]);
+}
+
+
+/******************************************************************************
+The finer table, built at compile time.
+******************************************************************************/
+
+struct HiresTable
+{
+    float sum[FILTER_HIRES_SAMPLES][FILTER_HIRES_SAMPLES];
+};
+
+/* square root by Newton's method, starting above the root */
+
+static constexpr double const_sqrt(double x)
+{
+  if (x <= 0)
+    return (0.0);
+
+  double g = 0.5 * (1 + x);
+
+  for (int k = 0; k < 64; k++) {
+    double next = 0.5 * (g + x / g);
+    if (next >= g)
+      break;
+    g = next;
+  }
+
+  return (g);
+}
+
+/* the filter at distance sqrt(r2) from its center */
+
+static constexpr double const_filter(double r2)
+{
+  if (r2 >= 1)
+    return (0.0);
+
+  double t = const_sqrt(r2);
+  return ((2 * t - 3) * r2 + 1);
+}
+
+static constexpr HiresTable make_hires_table()
+{
+  HiresTable table {};
+  const int samples = FILTER_HIRES_SAMPLES;
+  const double delta = 1.0 / (samples - 1);
+
+  for (int i = 0; i < samples; i++) {
+    double r2 = (i * delta) * (i * delta);
+    double s = 0;
+    double f0 = const_filter(r2);
+    table.sum[i][0] = 0;
+    for (int j = 1; j < samples; j++) {
+      double hm = (j - 0.5) * delta;
+      double h1 = j * delta;
+      double fm = const_filter(r2 + hm * hm);
+      double f1 = const_filter(r2 + h1 * h1);
+      s += delta * (f0 + 4 * fm + f1) / 6;
+      table.sum[i][j] = (float) s;
+      f0 = f1;
+    }
+  }
+
+  return (table);
+}
+
+static constexpr HiresTable hires_table = make_hires_table();
+
+
+/******************************************************************************
+Select the way the summed filter is found.  This should be done before
+any low-pass images are made.
+
+Entry:
+  type - FILTER_TABLE, FILTER_HIRES or FILTER_ANALYTIC
+
+Exit:
+  returns 1 if the type is known, 0 if not (and nothing was changed)
+******************************************************************************/
+
+int set_filter_type(int type)
+{
+  if (type < FILTER_TABLE || type > FILTER_ANALYTIC)
+    return (0);
+
+  filter_type = type;
+  return (1);
+}
+
+
+/******************************************************************************
+Return the way the summed filter is found.
+******************************************************************************/
+
+int get_filter_type()
+{
+  return (filter_type);
+}
+
+
+/******************************************************************************
+Return the name of a way of finding the summed filter.
+******************************************************************************/
+
+const char *filter_type_name(int type)
+{
+  switch (type) {
+    case FILTER_TABLE:
+      return ("table");
+    case FILTER_HIRES:
+      return ("hires");
+    case FILTER_ANALYTIC:
+      return ("analytic");
+    default:
+      return ("unknown");
+  }
+}
+
+
+/******************************************************************************
+Return the table for a way of finding the summed filter.
+
+Entry:
+  type - FILTER_TABLE, FILTER_HIRES or FILTER_ANALYTIC
+
+Exit:
+  samples - size of the table
+  returns the table, samples by samples, or NULL if the type uses no table
+******************************************************************************/
+
+const float *filter_table(int type, int &samples)
+{
+  switch (type) {
+    case FILTER_TABLE:
+      samples = FILTER_TABLE_SAMPLES;
+      return (coarse_table());
+    case FILTER_HIRES:
+      samples = FILTER_HIRES_SAMPLES;
+      return (&hires_table.sum[0][0]);
+    default:
+      samples = 0;
+      return (NULL);
+  }
+}
+
+
+/******************************************************************************
+Find the integral of the filter along a line.
+
+Entry:
+  r - distance of the line from the center of the filter
+  h - how far along the line to integrate, from its closest point
+
+Exit:
+  returns the integral
+******************************************************************************/
+
+double analytic_filter_sum(double r, double h)
+{
+  r = fabs(r);
+  h = fabs(h);
+
+  if (r >= 1)
+    return (0.0);
+
+  /* the filter is zero outside the unit circle */
+
+  double hmax = sqrt(1 - r * r);
+  if (h > hmax)
+    h = hmax;
+
+  double r2 = r * r;
+  double h2 = h * h;
+  double s = sqrt(r2 + h2);
+
+  double sum = h - 3 * r2 * h - h2 * h + 0.25 * h * (2 * h2 + 5 * r2) * s;
+
+  if (r > 0)
+    sum += 0.75 * r2 * r2 * asinh(h / r);
+
+  return (sum);
+}
+
+
+/******************************************************************************
+Return the value along a summed line of the filter, found in the selected
+way.
+
+Entry:
+  x,y - point along line
+
+Exit:
+  returns summed value
+******************************************************************************/
+
+float radial_filter_value(float x, float y)
+{
+  int samples;
+  const float *table = filter_table(filter_type, samples);
+
+  if (table == NULL)
+    return ((float) analytic_filter_sum(x, y));
+
+  x = fabs(x);
+  y = fabs(y);
+
+  int i = (int) floor((samples - 1) * x);
+  int j = (int) floor((samples - 1) * y);
+
+  if (i >= samples - 1)
+    i = samples - 2;
+
+  if (j >= samples - 1)
+    j = samples - 2;
+
+  float tx = (samples - 1) * x - i;
+  float ty = (samples - 1) * y - j;
+
+  const float *t = &table[i * samples + j];
+  float s00 = t[0];
+  float s01 = t[1];
+  float s10 = t[samples];
+  float s11 = t[samples + 1];
+
+  float s0 = s00 + ty * (s01 - s00);
+  float s1 = s10 + ty * (s11 - s10);
+  float s = s0 + tx * (s1 - s0);
+
+  return (s);
+}
+
+
+/******************************************************************************
+Find the exact contribution of a line segment to a row of pixels, in double
+precision.  This follows filter_row_scalar(), and is what the benchmark
+compares against.
+******************************************************************************/
+
+static void reference_row(
+        double rad,
+        int i0,
+        int i1,
+        int j,
+        double x0,
+        double y0,
+        double x1,
+        double y1,
+        double *out
+)
+{
+  double len = sqrt((x1 - x0) * (x1 - x0) + (y1 - y0) * (y1 - y0));
+  double a = (y0 - y1) / len;
+  double b = (x1 - x0) / len;
+
+  for (int i = i0; i <= i1; i++) {
+
+    double rx0 = (a * (x0 - i) + b * (y0 - j)) / rad;
+    double ry0 = (-b * (x0 - i) + a * (y0 - j)) / rad;
+    double ry1 = (-b * (x1 - i) + a * (y1 - j)) / rad;
+
+    double v0 = analytic_filter_sum(rx0, ry0);
+    double v1 = analytic_filter_sum(rx0, ry1);
+
+    if (ry0 * ry1 > 0)
+      *out++ = fabs(v0 - v1);
+    else
+      *out++ = v0 + v1;
+  }
+}
+
+
+/******************************************************************************
+Compare the ways of finding the summed filter, for speed and for accuracy,
+by filtering random line segments of the lengths a streamline is made of.
+
+Entry:
+  num - number of segments to filter with each method
+******************************************************************************/
+
+void filter_benchmark(int num)
+{
+  const int width = 64;
+  const float radius = 2.5;
+  unsigned short seed[3] = {1, 2, 3};
+
+  float *rad = new float[width];
+  for (int i = 0; i < width; i++)
+    rad[i] = radius;
+
+  float *segs = new float[num * 4];
+  for (int n = 0; n < num; n++) {
+    float x = 8 + (width - 16) * erand48(seed);
+    float y = 8 + (width - 16) * erand48(seed);
+    float len = 0.25 + 1.75 * erand48(seed);
+    float theta = 2 * M_PI * erand48(seed);
+    segs[4 * n] = x;
+    segs[4 * n + 1] = y;
+    segs[4 * n + 2] = x + len * cos(theta);
+    segs[4 * n + 3] = y + len * sin(theta);
+  }
+
+  float *row = new float[width];
+  double *exact = new double[width];
+
+  int save_type = filter_type;
+
+  for (int type = FILTER_TABLE; type <= FILTER_ANALYTIC; type++) {
+
+    filter_type = type;
+
+    long pixels = 0;
+    double max_err = 0;
+    double sum_err2 = 0;
+
+    /* time the filtering by itself */
+
+    clock_t start = clock();
+
+    for (int n = 0; n < num; n++) {
+      float x0 = segs[4 * n], y0 = segs[4 * n + 1];
+      float x1 = segs[4 * n + 2], y1 = segs[4 * n + 3];
+      float len = sqrt((x1 - x0) * (x1 - x0) + (y1 - y0) * (y1 - y0));
+      float a = (y0 - y1) / len;
+      float b = (x1 - x0) / len;
+      int i0 = (int) floor(fmin(x0, x1) - radius);
+      int i1 = (int) ceil(fmax(x0, x1) + radius);
+      int j0 = (int) floor(fmin(y0, y1) - radius);
+      int j1 = (int) ceil(fmax(y0, y1) + radius);
+      for (int j = j0; j <= j1; j++) {
+        filter_row(rad, i0, i1, j, x0, y0, x1, y1, a, b, row);
+        pixels += i1 - i0 + 1;
+      }
+    }
+
+    double secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    /* then compare with the exact values */
+
+    for (int n = 0; n < num; n++) {
+      float x0 = segs[4 * n], y0 = segs[4 * n + 1];
+      float x1 = segs[4 * n + 2], y1 = segs[4 * n + 3];
+      float len = sqrt((x1 - x0) * (x1 - x0) + (y1 - y0) * (y1 - y0));
+      float a = (y0 - y1) / len;
+      float b = (x1 - x0) / len;
+      int i0 = (int) floor(fmin(x0, x1) - radius);
+      int i1 = (int) ceil(fmax(x0, x1) + radius);
+      int j0 = (int) floor(fmin(y0, y1) - radius);
+      int j1 = (int) ceil(fmax(y0, y1) + radius);
+      for (int j = j0; j <= j1; j++) {
+        filter_row(rad, i0, i1, j, x0, y0, x1, y1, a, b, row);
+        reference_row(radius, i0, i1, j, x0, y0, x1, y1, exact);
+        for (int i = 0; i <= i1 - i0; i++) {
+          double err = fabs(row[i] - exact[i]);
+          if (err > max_err)
+            max_err = err;
+          sum_err2 += err * err;
+        }
+      }
+    }
+
+    printf("%-8s  %6.1f Mpixels/sec   max error %.2e   rms error %.2e\n",
+           filter_type_name(type),
+           secs > 0 ? pixels / secs * 1e-6 : 0.0,
+           max_err, sqrt(sum_err2 / pixels));
+  }
+
+  filter_type = save_type;
+
+  delete[] rad;
+  delete[] segs;
+  delete[] row;
+  delete[] exact;
+}
+
@@ -0,0 +1,43 @@
+//
+//  The radially symmetric filter used to make low-pass images of
+//  streamlines, integrated along a line
+//
+
+/*
+Copyright (c) 1996 The University of North Carolina.  All rights reserved.
+
+Permission to use, copy, modify and distribute this software and its
+documentation for any purpose is hereby granted without fee, provided
+that the above copyright notice and this permission notice appear in
+all copies of this software and that you do not sell the software.
+
+The software is provided "as is" and without warranty of any kind,
+express, implied or otherwise, including without limitation, any
+warranty of merchantability or fitness for a particular purpose.
+*/
+
+
+#ifndef _FILTER_
+#define _FILTER_
+
+/* ways of finding the summed filter */
+#define FILTER_TABLE     1   /* the original coarse table */
+#define FILTER_HIRES     2   /* a finer table, built by the compiler */
+#define FILTER_ANALYTIC  3   /* the exact integral */
+
+#define FILTER_TABLE_SAMPLES  30
+#define FILTER_HIRES_SAMPLES  257
+
+int set_filter_type(int);
+int get_filter_type();
+const char *filter_type_name(int);
+
+const float *filter_table(int, int &);
+
+double analytic_filter_sum(double, double);
+float radial_filter_value(float, float);
+
+void filter_benchmark(int);
+
+#endif /* _FILTER_ */
+
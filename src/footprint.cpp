@@ -0,0 +1,747 @@
+/*
+
+Filter a line segment over a row of pixels of a low-pass image.
+
+The scalar version performs exactly the same floating-point operations as
+Lowpass::better_filter_segment, one pixel at a time.  The SSE2 and AVX2
+versions do the same operations four or eight pixels at a time, so all
+three give identical results.  The fastest one the processor supports is
+chosen the first time a row is filtered.  When the filter is integrated
+exactly instead of being looked up in a table (see filter.cpp), there is
+only a scalar version.
+
+---------------------------------------------------------------------
+
+Copyright (c) 1996 The University of North Carolina.  All rights reserved.
+
+Permission to use, copy, modify and distribute this software and its
+documentation for any purpose is hereby granted without fee, provided
+that the above copyright notice and this permission notice appear in
+all copies of this software and that you do not sell the software.
+
+The software is provided "as is" and without warranty of any kind,
+express, implied or otherwise, including without limitation, any
+warranty of merchantability or fitness for a particular purpose.
+
+*/
+
+
+#include <math.h>
+#include "footprint.h"
+#include "filter.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FOOTPRINT_X86
+#include <immintrin.h>
+#endif
+
+static int kernel = 0;    /* kernel asked for, or zero for the best one */
+
+
+/******************************************************************************
+Look up a value in a summed radial filter table.  This is the same as
+radial_filter_value() in filter.cpp, but with the table passed in.
+
+Entry:
+  table   - summed filter table, samples by samples
+  samples - size of table
+  x,y     - point along line
+
+Exit:
+  returns summed value
+******************************************************************************/
+
+static inline float table_value(
+        const float *table,
+        int samples,
+        float x,
+        float y
+)
+{
+  x = fabs(x);
+  y = fabs(y);
+
+  int i = (int) floor((samples - 1) * x);
+  int j = (int) floor((samples - 1) * y);
+
+  if (i >= samples - 1)
+    i = samples - 2;
+
+  if (j >= samples - 1)
+    j = samples - 2;
+
+  float tx = (samples - 1) * x - i;
+  float ty = (samples - 1) * y - j;
+
+  const float *t = &table[i * samples + j];
+  float s00 = t[0];
+  float s01 = t[1];
+  float s10 = t[samples];
+  float s11 = t[samples + 1];
+
+  float s0 = s00 + ty * (s01 - s00);
+  float s1 = s10 + ty * (s11 - s10);
+  float s = s0 + tx * (s1 - s0);
+
+  return (s);
+}
+
+
+/******************************************************************************
+Filter a line segment over a row of pixels, one pixel at a time.
+
+Entry:
+  table   - summed filter table, samples by samples
+  samples - size of table
+  rad     - filter radius for each pixel of the row
+  i0,i1   - first and last pixel in the row
+  j       - which row
+  x0,y0   - one segment endpoint
+  x1,y1   - other endpoint
+  a,b     - equation of line through endpoints
+
+Exit:
+  out - contribution to pixels i0 through i1
+******************************************************************************/
+
+void filter_row_scalar(
+        const float *table,
+        int samples,
+        const float *rad,
+        int i0,
+        int i1,
+        int j,
+        float x0,
+        float y0,
+        float x1,
+        float y1,
+        float a,
+        float b,
+        float *out
+)
+{
+  for (int i = i0; i <= i1; i++) {
+
+    /* translate line into coordinates so that pixel is at (0,0) */
+
+    float xx0 = x0 - i;
+    float yy0 = y0 - j;
+    float xx1 = x1 - i;
+    float yy1 = y1 - j;
+
+    /* rotate line so that it points vertically */
+
+    float rx0 = a * xx0 + b * yy0;
+    float ry0 = -b * xx0 + a * yy0;
+    float rx1 = a * xx1 + b * yy1;
+    float ry1 = -b * xx1 + a * yy1;
+
+    /* maybe flip the line across the y-axis */
+
+    if (rx0 < 0) {
+      rx0 *= -1.0;
+      rx1 *= -1.0;
+    }
+
+    /* scale segment by the radius of the filter */
+
+    float recip = 1.0 / rad[i];
+    rx0 *= recip;
+    ry0 *= recip;
+    rx1 *= recip;
+    ry1 *= recip;
+
+    /* clip to maximum radius */
+
+    if (rx0 > 1.0) {
+      *out++ = 0.0;
+      continue;
+    }
+
+    if (ry0 < -1.0) ry0 = -1.0;
+    if (ry0 > 1.0) ry0 = 1.0;
+    if (ry1 < -1.0) ry1 = -1.0;
+    if (ry1 > 1.0) ry1 = 1.0;
+
+    /* determine filter contribution */
+
+    float v0 = table_value(table, samples, rx0, ry0);
+    float v1 = table_value(table, samples, rx1, ry1);
+
+    if (ry0 * ry1 > 0)    /* same side of x-axis */
+      *out++ = fabs(v0 - v1);
+    else                  /* opposite sides of x-axis */
+      *out++ = v0 + v1;
+  }
+}
+
+
+/******************************************************************************
+Filter a line segment over a row of pixels, one pixel at a time, using the
+exact integral of the filter instead of a table.  Arguments are the same as
+for filter_row_scalar(), less the table.
+******************************************************************************/
+
+void filter_row_analytic(
+        const float *rad,
+        int i0,
+        int i1,
+        int j,
+        float x0,
+        float y0,
+        float x1,
+        float y1,
+        float a,
+        float b,
+        float *out
+)
+{
+  for (int i = i0; i <= i1; i++) {
+
+    /* translate, rotate and scale the line just as filter_row_scalar() */
+
+    float xx0 = x0 - i;
+    float yy0 = y0 - j;
+    float xx1 = x1 - i;
+    float yy1 = y1 - j;
+
+    float rx0 = a * xx0 + b * yy0;
+    float ry0 = -b * xx0 + a * yy0;
+    float ry1 = -b * xx1 + a * yy1;
+
+    float recip = 1.0 / rad[i];
+    rx0 = fabs(rx0) * recip;
+    ry0 *= recip;
+    ry1 *= recip;
+
+    if (rx0 > 1.0) {
+      *out++ = 0.0;
+      continue;
+    }
+
+    /* the integral is clipped to the filter's edge by itself */
+
+    double v0 = analytic_filter_sum(rx0, ry0);
+    double v1 = analytic_filter_sum(rx0, ry1);
+
+    if (ry0 * ry1 > 0)    /* same side of x-axis */
+      *out++ = (float) fabs(v0 - v1);
+    else                  /* opposite sides of x-axis */
+      *out++ = (float) (v0 + v1);
+  }
+}
+
+
+#ifdef FOOTPRINT_X86
+
+/******************************************************************************
+Four table lookups at once, for the SSE2 kernel.
+******************************************************************************/
+
+__attribute__((target("sse2")))
+static inline __m128 table_value_sse2(
+        const float *table,
+        int samples,
+        __m128 x,
+        __m128 y
+)
+{
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  const __m128 scale = _mm_set1_ps((float) (samples - 1));
+  const __m128 last = _mm_set1_ps((float) (samples - 2));
+
+  x = _mm_andnot_ps(sign, x);
+  y = _mm_andnot_ps(sign, y);
+
+  /* values are non-negative, so truncation is the same as floor(); */
+  /* clamping before the conversion also keeps masked-off lanes in the table */
+
+  __m128 px = _mm_mul_ps(scale, x);
+  __m128 py = _mm_mul_ps(scale, y);
+  __m128i i = _mm_cvttps_epi32(_mm_min_ps(px, last));
+  __m128i j = _mm_cvttps_epi32(_mm_min_ps(py, last));
+
+  __m128 tx = _mm_sub_ps(px, _mm_cvtepi32_ps(i));
+  __m128 ty = _mm_sub_ps(py, _mm_cvtepi32_ps(j));
+
+  int ii[4], jj[4];
+  _mm_storeu_si128((__m128i *) ii, i);
+  _mm_storeu_si128((__m128i *) jj, j);
+
+  const float *t0 = &table[ii[0] * samples + jj[0]];
+  const float *t1 = &table[ii[1] * samples + jj[1]];
+  const float *t2 = &table[ii[2] * samples + jj[2]];
+  const float *t3 = &table[ii[3] * samples + jj[3]];
+
+  __m128 s00 = _mm_setr_ps(t0[0], t1[0], t2[0], t3[0]);
+  __m128 s01 = _mm_setr_ps(t0[1], t1[1], t2[1], t3[1]);
+  __m128 s10 = _mm_setr_ps(t0[samples], t1[samples], t2[samples], t3[samples]);
+  __m128 s11 = _mm_setr_ps(t0[samples + 1], t1[samples + 1],
+                           t2[samples + 1], t3[samples + 1]);
+
+  __m128 s0 = _mm_add_ps(s00, _mm_mul_ps(ty, _mm_sub_ps(s01, s00)));
+  __m128 s1 = _mm_add_ps(s10, _mm_mul_ps(ty, _mm_sub_ps(s11, s10)));
+  return (_mm_add_ps(s0, _mm_mul_ps(tx, _mm_sub_ps(s1, s0))));
+}
+
+
+/******************************************************************************
+Filter a line segment over a row of pixels, four pixels at a time.
+Arguments are the same as for filter_row_scalar().
+******************************************************************************/
+
+__attribute__((target("sse2")))
+static void filter_row_sse2(
+        const float *table,
+        int samples,
+        const float *rad,
+        int i0,
+        int i1,
+        int j,
+        float x0,
+        float y0,
+        float x1,
+        float y1,
+        float a,
+        float b,
+        float *out
+)
+{
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 minus_one = _mm_set1_ps(-1.0f);
+  const __m128 va = _mm_set1_ps(a);
+  const __m128 vb = _mm_set1_ps(b);
+  const __m128 vnb = _mm_set1_ps(-b);
+  const __m128 vx0 = _mm_set1_ps(x0);
+  const __m128 vx1 = _mm_set1_ps(x1);
+  const __m128 yy0 = _mm_set1_ps(y0 - j);
+  const __m128 yy1 = _mm_set1_ps(y1 - j);
+
+  int i = i0;
+
+  for (; i + 3 <= i1; i += 4) {
+
+    __m128 fi = _mm_cvtepi32_ps(_mm_setr_epi32(i, i + 1, i + 2, i + 3));
+    __m128 xx0 = _mm_sub_ps(vx0, fi);
+    __m128 xx1 = _mm_sub_ps(vx1, fi);
+
+    __m128 rx0 = _mm_add_ps(_mm_mul_ps(va, xx0), _mm_mul_ps(vb, yy0));
+    __m128 ry0 = _mm_add_ps(_mm_mul_ps(vnb, xx0), _mm_mul_ps(va, yy0));
+    __m128 rx1 = _mm_add_ps(_mm_mul_ps(va, xx1), _mm_mul_ps(vb, yy1));
+    __m128 ry1 = _mm_add_ps(_mm_mul_ps(vnb, xx1), _mm_mul_ps(va, yy1));
+
+    __m128 flip = _mm_and_ps(_mm_cmplt_ps(rx0, zero), sign);
+    rx0 = _mm_xor_ps(rx0, flip);
+    rx1 = _mm_xor_ps(rx1, flip);
+
+    __m128 recip = _mm_div_ps(one, _mm_loadu_ps(rad + i));
+    rx0 = _mm_mul_ps(rx0, recip);
+    ry0 = _mm_mul_ps(ry0, recip);
+    rx1 = _mm_mul_ps(rx1, recip);
+    ry1 = _mm_mul_ps(ry1, recip);
+
+    __m128 outside = _mm_cmpgt_ps(rx0, one);
+
+    ry0 = _mm_min_ps(_mm_max_ps(ry0, minus_one), one);
+    ry1 = _mm_min_ps(_mm_max_ps(ry1, minus_one), one);
+
+    __m128 v0 = table_value_sse2(table, samples, rx0, ry0);
+    __m128 v1 = table_value_sse2(table, samples, rx1, ry1);
+
+    __m128 same = _mm_cmpgt_ps(_mm_mul_ps(ry0, ry1), zero);
+    __m128 diff = _mm_andnot_ps(sign, _mm_sub_ps(v0, v1));
+    __m128 sum = _mm_add_ps(v0, v1);
+    __m128 value = _mm_or_ps(_mm_and_ps(same, diff), _mm_andnot_ps(same, sum));
+
+    _mm_storeu_ps(out + (i - i0), _mm_andnot_ps(outside, value));
+  }
+
+  if (i <= i1)
+    filter_row_scalar(table, samples, rad, i, i1, j, x0, y0, x1, y1, a, b,
+                      out + (i - i0));
+}
+
+
+/******************************************************************************
+Eight table lookups at once, for the AVX2 kernel.
+******************************************************************************/
+
+__attribute__((target("avx2")))
+static inline __m256 table_value_avx2(
+        const float *table,
+        int samples,
+        __m256 x,
+        __m256 y
+)
+{
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  const __m256 scale = _mm256_set1_ps((float) (samples - 1));
+  const __m256 last = _mm256_set1_ps((float) (samples - 2));
+
+  x = _mm256_andnot_ps(sign, x);
+  y = _mm256_andnot_ps(sign, y);
+
+  __m256 px = _mm256_mul_ps(scale, x);
+  __m256 py = _mm256_mul_ps(scale, y);
+  __m256i i = _mm256_cvttps_epi32(_mm256_min_ps(px, last));
+  __m256i j = _mm256_cvttps_epi32(_mm256_min_ps(py, last));
+
+  __m256 tx = _mm256_sub_ps(px, _mm256_cvtepi32_ps(i));
+  __m256 ty = _mm256_sub_ps(py, _mm256_cvtepi32_ps(j));
+
+  __m256i index = _mm256_add_epi32(
+          _mm256_mullo_epi32(i, _mm256_set1_epi32(samples)), j);
+  __m256i index1 = _mm256_add_epi32(index, _mm256_set1_epi32(samples));
+
+  __m256 s00 = _mm256_i32gather_ps(table, index, 4);
+  __m256 s01 = _mm256_i32gather_ps(table + 1, index, 4);
+  __m256 s10 = _mm256_i32gather_ps(table, index1, 4);
+  __m256 s11 = _mm256_i32gather_ps(table + 1, index1, 4);
+
+  __m256 s0 = _mm256_add_ps(s00, _mm256_mul_ps(ty, _mm256_sub_ps(s01, s00)));
+  __m256 s1 = _mm256_add_ps(s10, _mm256_mul_ps(ty, _mm256_sub_ps(s11, s10)));
+  return (_mm256_add_ps(s0, _mm256_mul_ps(tx, _mm256_sub_ps(s1, s0))));
+}
+
+
+/******************************************************************************
+Filter a line segment over a row of pixels, eight pixels at a time.
+Arguments are the same as for filter_row_scalar().
+******************************************************************************/
+
+__attribute__((target("avx2")))
+static void filter_row_avx2(
+        const float *table,
+        int samples,
+        const float *rad,
+        int i0,
+        int i1,
+        int j,
+        float x0,
+        float y0,
+        float x1,
+        float y1,
+        float a,
+        float b,
+        float *out
+)
+{
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 minus_one = _mm256_set1_ps(-1.0f);
+  const __m256 va = _mm256_set1_ps(a);
+  const __m256 vb = _mm256_set1_ps(b);
+  const __m256 vnb = _mm256_set1_ps(-b);
+  const __m256 vx0 = _mm256_set1_ps(x0);
+  const __m256 vx1 = _mm256_set1_ps(x1);
+  const __m256 yy0 = _mm256_set1_ps(y0 - j);
+  const __m256 yy1 = _mm256_set1_ps(y1 - j);
+  const __m256i steps = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+  int i = i0;
+
+  for (; i + 7 <= i1; i += 8) {
+
+    __m256 fi = _mm256_cvtepi32_ps(
+            _mm256_add_epi32(_mm256_set1_epi32(i), steps));
+    __m256 xx0 = _mm256_sub_ps(vx0, fi);
+    __m256 xx1 = _mm256_sub_ps(vx1, fi);
+
+    __m256 rx0 = _mm256_add_ps(_mm256_mul_ps(va, xx0), _mm256_mul_ps(vb, yy0));
+    __m256 ry0 = _mm256_add_ps(_mm256_mul_ps(vnb, xx0), _mm256_mul_ps(va, yy0));
+    __m256 rx1 = _mm256_add_ps(_mm256_mul_ps(va, xx1), _mm256_mul_ps(vb, yy1));
+    __m256 ry1 = _mm256_add_ps(_mm256_mul_ps(vnb, xx1), _mm256_mul_ps(va, yy1));
+
+    __m256 flip = _mm256_and_ps(_mm256_cmp_ps(rx0, zero, _CMP_LT_OQ), sign);
+    rx0 = _mm256_xor_ps(rx0, flip);
+    rx1 = _mm256_xor_ps(rx1, flip);
+
+    __m256 recip = _mm256_div_ps(one, _mm256_loadu_ps(rad + i));
+    rx0 = _mm256_mul_ps(rx0, recip);
+    ry0 = _mm256_mul_ps(ry0, recip);
+    rx1 = _mm256_mul_ps(rx1, recip);
+    ry1 = _mm256_mul_ps(ry1, recip);
+
+    __m256 outside = _mm256_cmp_ps(rx0, one, _CMP_GT_OQ);
+
+    ry0 = _mm256_min_ps(_mm256_max_ps(ry0, minus_one), one);
+    ry1 = _mm256_min_ps(_mm256_max_ps(ry1, minus_one), one);
+
+    __m256 v0 = table_value_avx2(table, samples, rx0, ry0);
+    __m256 v1 = table_value_avx2(table, samples, rx1, ry1);
+
+    __m256 same = _mm256_cmp_ps(_mm256_mul_ps(ry0, ry1), zero, _CMP_GT_OQ);
+    __m256 diff = _mm256_andnot_ps(sign, _mm256_sub_ps(v0, v1));
+    __m256 sum = _mm256_add_ps(v0, v1);
+    __m256 value = _mm256_blendv_ps(sum, diff, same);
+
+    _mm256_storeu_ps(out + (i - i0), _mm256_andnot_ps(outside, value));
+  }
+
+  if (i <= i1)
+    filter_row_sse2(table, samples, rad, i, i1, j, x0, y0, x1, y1, a, b,
+                    out + (i - i0));
+}
+
+#endif /* FOOTPRINT_X86 */
+
+
+/******************************************************************************
+Is a given kernel supported by this processor?
+******************************************************************************/
+
+static int kernel_supported(int which)
+{
+  switch (which) {
+    case FOOTPRINT_SCALAR:
+      return (1);
+#ifdef FOOTPRINT_X86
+    case FOOTPRINT_SSE2:
+      return (__builtin_cpu_supports("sse2"));
+    case FOOTPRINT_AVX2:
+      return (__builtin_cpu_supports("avx2"));
+#endif
+    default:
+      return (0);
+  }
+}
+
+
+/******************************************************************************
+Return the fastest kernel supported by this processor.
+******************************************************************************/
+
+static int best_kernel()
+{
+  static const int best = kernel_supported(FOOTPRINT_AVX2) ? FOOTPRINT_AVX2 :
+                          kernel_supported(FOOTPRINT_SSE2) ? FOOTPRINT_SSE2 :
+                          FOOTPRINT_SCALAR;
+  return (best);
+}
+
+
+/******************************************************************************
+Select which kernel to use for filtering rows.
+
+Entry:
+  which - FOOTPRINT_SCALAR, FOOTPRINT_SSE2, FOOTPRINT_AVX2, or zero for the
+          fastest one available
+
+Exit:
+  returns 1 if the kernel is supported, 0 if not (and nothing was changed)
+******************************************************************************/
+
+int set_footprint_kernel(int which)
+{
+  if (which != 0 && !kernel_supported(which))
+    return (0);
+
+  kernel = which;
+  return (1);
+}
+
+
+/******************************************************************************
+Return which kernel is being used for filtering rows.
+******************************************************************************/
+
+int get_footprint_kernel()
+{
+  return (kernel ? kernel : best_kernel());
+}
+
+
+/******************************************************************************
+Return the name of the kernel being used for filtering rows.
+******************************************************************************/
+
+const char *footprint_kernel_name()
+{
+  switch (get_footprint_kernel()) {
+    case FOOTPRINT_SSE2:
+      return ("sse2");
+    case FOOTPRINT_AVX2:
+      return ("avx2");
+    default:
+      return ("scalar");
+  }
+}
+
+
+/******************************************************************************
+Filter a line segment over a row of pixels, using the selected filter and
+kernel.  Arguments are the same as for filter_row_scalar(), less the table.
+******************************************************************************/
+
+void filter_row(
+        const float *rad,
+        int i0,
+        int i1,
+        int j,
+        float x0,
+        float y0,
+        float x1,
+        float y1,
+        float a,
+        float b,
+        float *out
+)
+{
+  int samples;
+  const float *table = filter_table(get_filter_type(), samples);
+
+  if (table == NULL) {
+    filter_row_analytic(rad, i0, i1, j, x0, y0, x1, y1, a, b, out);
+    return;
+  }
+
+  switch (get_footprint_kernel()) {
+#ifdef FOOTPRINT_X86
+    case FOOTPRINT_AVX2:
+      filter_row_avx2(table, samples, rad, i0, i1, j, x0, y0, x1, y1, a, b, out);
+      break;
+    case FOOTPRINT_SSE2:
+      filter_row_sse2(table, samples, rad, i0, i1, j, x0, y0, x1, y1, a, b, out);
+      break;
+#endif
+    default:
+      filter_row_scalar(table, samples, rad, i0, i1, j, x0, y0, x1, y1, a, b,
+                        out);
+      break;
+  }
+}
+
+
+/******************************************************************************
+Add a pixel's contribution to a footprint.
+
+Entry:
+  i,j   - pixel coordinate
+  value - contribution of the segment to the pixel
+******************************************************************************/
+
+void Footprint::add_pixel(int i, int j, float value)
+{
+  if (num_pixels >= max_pixels) {
+    max_pixels = (max_pixels == 0) ? 16 : max_pixels * 2;
+    PixelValue *temp = new PixelValue[max_pixels];
+    for (int k = 0; k < num_pixels; k++)
+      temp[k] = pixels[k];
+    delete[] pixels;
+    pixels = temp;
+  }
+
+  pixels[num_pixels].i = i;
+  pixels[num_pixels].j = j;
+  pixels[num_pixels].value = value;
+  num_pixels++;
+}
+
+
+/******************************************************************************
+Create a cache of segment footprints.
+
+Entry:
+  num - number of entries, rounded up to a power of two
+******************************************************************************/
+
+FootprintCache::FootprintCache(int num)
+{
+  size = 1;
+  while (size < num)
+    size *= 2;
+
+  entries = new Footprint[size];
+  filter = get_filter_type();
+  hits = misses = 0;
+}
+
+
+/******************************************************************************
+Delete a cache of segment footprints.
+******************************************************************************/
+
+FootprintCache::~FootprintCache()
+{
+  delete[] entries;
+}
+
+
+/******************************************************************************
+Forget all cached footprints, e.g. when the filter radius changes.
+******************************************************************************/
+
+void FootprintCache::clear()
+{
+  for (int i = 0; i < size; i++)
+    entries[i].valid = 0;
+}
+
+
+/******************************************************************************
+Find the cache entry for a line segment.  Segments whose endpoints and
+radius agree to within 1/FOOTPRINT_QUANTUM of a pixel share an entry.
+
+Entry:
+  x0,y0 - one segment endpoint, in pixels
+  x1,y1 - other endpoint
+  rad   - filter radius, in pixels
+
+Exit:
+  found - whether the entry already holds this segment's footprint
+  returns the entry; if found is 0, the caller must fill it in
+******************************************************************************/
+
+Footprint *FootprintCache::lookup(
+        float x0,
+        float y0,
+        float x1,
+        float y1,
+        float rad,
+        int &found
+)
+{
+  int key[5];
+
+  key[0] = (int) floor(x0 * FOOTPRINT_QUANTUM + 0.5);
+  key[1] = (int) floor(y0 * FOOTPRINT_QUANTUM + 0.5);
+  key[2] = (int) floor(x1 * FOOTPRINT_QUANTUM + 0.5);
+  key[3] = (int) floor(y1 * FOOTPRINT_QUANTUM + 0.5);
+  key[4] = (int) floor(rad * FOOTPRINT_QUANTUM + 0.5);
+
+  unsigned int hash = 0;
+  for (int k = 0; k < 5; k++)
+    hash = (hash ^ (unsigned int) key[k]) * 16777619u;
+  hash ^= hash >> 15;
+
+  /* footprints made with another filter are no use */
+
+  if (filter != get_filter_type()) {
+    clear();
+    filter = get_filter_type();
+  }
+
+  Footprint *fp = &entries[hash & (size - 1)];
+
+  if (fp->valid && fp->key[0] == key[0] && fp->key[1] == key[1] &&
+      fp->key[2] == key[2] && fp->key[3] == key[3] && fp->key[4] == key[4]) {
+    hits++;
+    found = 1;
+    return (fp);
+  }
+
+  /* replace whatever was here before */
+
+  misses++;
+  found = 0;
+
+  for (int k = 0; k < 5; k++)
+    fp->key[k] = key[k];
+  fp->valid = 1;
+  fp->num_pixels = 0;
+
+  return (fp);
+}
@@ -0,0 +1,101 @@
+//
+//  Filter a line segment over a row of pixels of a low-pass image, using
+//  a summed radial filter table or its exact integral.  Vectorized versions
+//  of the table lookups are chosen at run time.
+//
+
+/*
+Copyright (c) 1996 The University of North Carolina.  All rights reserved.
+
+Permission to use, copy, modify and distribute this software and its
+documentation for any purpose is hereby granted without fee, provided
+that the above copyright notice and this permission notice appear in
+all copies of this software and that you do not sell the software.
+
+The software is provided "as is" and without warranty of any kind,
+express, implied or otherwise, including without limitation, any
+warranty of merchantability or fitness for a particular purpose.
+*/
+
+
+#ifndef _FOOTPRINT_
+#define _FOOTPRINT_
+
+#include "streamline.h"
+
+/* kernels for filtering a row of pixels */
+
+#define FOOTPRINT_SCALAR  1
+#define FOOTPRINT_SSE2    2
+#define FOOTPRINT_AVX2    3
+
+void filter_row(const float *rad, int i0, int i1, int j,
+                float x0, float y0, float x1, float y1,
+                float a, float b, float *out);
+
+void filter_row_scalar(const float *table, int samples, const float *rad,
+                       int i0, int i1, int j, float x0, float y0,
+                       float x1, float y1, float a, float b, float *out);
+
+void filter_row_analytic(const float *rad, int i0, int i1, int j,
+                         float x0, float y0, float x1, float y1,
+                         float a, float b, float *out);
+
+int set_footprint_kernel(int);
+
+int get_footprint_kernel();
+
+const char *footprint_kernel_name();
+
+
+/* the pixels that one line segment contributes to */
+
+class Footprint
+{
+public:
+    int key[5];           /* quantized x0, y0, x1, y1 and radius */
+    int valid;            /* is this a computed footprint? */
+    int num_pixels;       /* number of pixels touched by the segment */
+    int max_pixels;       /* memory allocated to pixels */
+    PixelValue *pixels;   /* contributions, not yet scaled by intensity */
+
+    Footprint()
+    {
+      valid = 0;
+      num_pixels = 0;
+      max_pixels = 0;
+      pixels = NULL;
+    }
+
+    ~Footprint()
+    {
+      delete[] pixels;
+    }
+
+    void add_pixel(int i, int j, float value);
+};
+
+
+/* a direct-mapped cache of segment footprints */
+
+#define FOOTPRINT_QUANTUM  1024   /* key positions are in 1/1024 pixels */
+
+class FootprintCache
+{
+    Footprint *entries;   /* the cached footprints */
+    int size;             /* number of entries, a power of two */
+    int filter;           /* filter type the footprints were made with */
+public:
+    int hits, misses;     /* statistics */
+
+    FootprintCache(int);
+
+    ~FootprintCache();
+
+    Footprint *lookup(float, float, float, float, float, int &);
+
+    void clear();
+};
+
+#endif /* _FOOTPRINT_ */
+
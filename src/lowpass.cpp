@@ -32,15 +32,55 @@ warranty of merchantability or fitness for a particular purpose.
 #include "stplace.h"
 #include "lowpass.h"
 #include "visparams.h"
+#include "footprint.h"
+#include "filter.h"
 
 #define Min(a, b) ((a) > (b) ? (b) : (a))
 #define Max(a, b) ((a) > (b) ? (a) : (b))
 #define Square(a) ((a)*(a))
 
 
-const int samples = 30;
-float filter_sum[samples][samples];
-int filter_made = 0;
+static int cache_footprints = 1;
+
+
+/******************************************************************************
+Turn the cache of segment footprints on or off.
+******************************************************************************/
+
+void set_footprint_cache(int flag)
+{
+  cache_footprints = flag;
+}
+
+
+/******************************************************************************
+Create scratch space for finding streamline values in a lowpass image.
+
+Entry:
+  x,y - size of the image
+******************************************************************************/
+
+LowpassWork::LowpassWork(int x, int y)
+{
+  pixel_slot = new int[x * y];
+  for (int i = 0; i < x * y; i++)
+    pixel_slot[i] = -1;
+
+  row_values = new float[x];
+  cache = new FootprintCache(FOOTPRINT_CACHE_SIZE);
+}
+
+
+/******************************************************************************
+Delete scratch space.
+******************************************************************************/
+
+LowpassWork::~LowpassWork()
+{
+  delete[] pixel_slot;
+  delete[] row_values;
+  delete cache;
+}
 
 
 /******************************************************************************
@@ -54,7 +94,25 @@ Lowpass::Lowpass(int x, int y, float rad, float targ)
   image = new FloatImage(x, y);
   image->setimage(0.0);
   target = targ;
-  sum = xsize * ysize * target * target;
+  sum = (double) xsize * ysize * target * target;
+  stride = 1;
+
+  num_works = 1;
+  works = new LowpassWork *[1];
+  works[0] = new LowpassWork(x, y);
+
+  /* every tile starts out changed, and with no energy computed */
+  tiles_x = (x + LOWPASS_TILE - 1) / LOWPASS_TILE;
+  tiles_y = (y + LOWPASS_TILE - 1) / LOWPASS_TILE;
+  stamp = 1;
+  tile_stamp = new unsigned int[tiles_x * tiles_y];
+  energy_stamp = new unsigned int[tiles_x * tiles_y];
+  tile_energy = new double[tiles_x * tiles_y];
+  for (int i = 0; i < tiles_x * tiles_y; i++) {
+    tile_stamp[i] = stamp;
+    energy_stamp[i] = 0;
+    tile_energy[i] = 0;
+  }
 
   rad_image = new FloatImage(x, y);
   for (int i = 0; i < x; i++)
@@ -103,88 +161,10 @@ void compute_line(
 }
 
 
-/******************************************************************************
-Create the radially-symmetric filter for quick table lookup.
-******************************************************************************/
-
-void create_radial_filter()
-{
-  int i, j;
-
-  float delta = 1.0 / (samples - 1);
-
-  for (i = 0; i < samples; i++)
-    for (j = 0; j < samples; j++)
-      filter_sum[i][j] = 0;
-
-  for (i = 0; i < samples; i++) {
-    float r = i * delta;
-    float sum = 0;
-    for (j = 0; j < samples; j++) {
-      float h = j * delta;
-      float t = sqrt(r * r + h * h);
-      float f = (2 * t - 3) * t * t + 1;
-      if (t > 1)
-        f = 0;
-      filter_sum[i][j] = sum;
-      sum += f * delta;
-      /*
-      printf ("%.3f ", filter_sum[i][j]);
-      */
-    }
-    /*
-    printf ("\n");
-    */
-  }
-
-  filter_made = 1;
-}
-
-
-/******************************************************************************
-Return the value along a summed line of the filter.
-
-Entry:
-  x,y - point along line
-
-Exit:
-  returns summed value
-******************************************************************************/
-
-float radial_value(float x, float y)
-{
-  x = fabs(x);
-  y = fabs(y);
-
-  int i = (int) floor((samples - 1) * x);
-  int j = (int) floor((samples - 1) * y);
-
-  if (i == samples - 1)
-    i = samples - 2;
-
-  if (j == samples - 1)
-    j = samples - 2;
-
-  float tx = (samples - 1) * x - i;
-  float ty = (samples - 1) * y - j;
-
-  float s00 = filter_sum[i][j];
-  float s01 = filter_sum[i][j + 1];
-  float s10 = filter_sum[i + 1][j];
-  float s11 = filter_sum[i + 1][j + 1];
-
-  float s0 = s00 + ty * (s01 - s00);
-  float s1 = s10 + ty * (s11 - s10);
-  float s = s0 + tx * (s1 - s0);
-
-  return (s);
-}
-
-
 /******************************************************************************
 Find the contribution of a line segment to a single pixel in a low-pass
 filtered version of an image.  This version uses a rotationally symmetric
-filter from a pre-built table.
+filter, found in whichever way has been selected.
 
 Entry:
   i,j   - pixel coordinate
@@ -269,55 +249,46 @@ float Lowpass::better_filter_segment(
   /* determine filter contribution */
 
   if (y0 * y1 > 0) {  /* same side of x-axis */
-    float diff = radial_value(x0, y0) - radial_value(x1, y1);
+    float diff = radial_filter_value(x0, y0) - radial_filter_value(x1, y1);
     return (fabs(diff));
   } else {              /* opposite sides of x-axis */
-    float sum = radial_value(x0, y0) + radial_value(x1, y1);
+    float sum = radial_filter_value(x0, y0) + radial_filter_value(x1, y1);
     return (sum);
   }
 }
 
 
 /******************************************************************************
-What is the new quality measure of a low-pass image, given a new
-streamline?
+Find the contributions that a streamline would make to the pixels of the
+low-pass image.  Contributions from different segments that fall on the same
+pixel are merged, so each pixel appears at most once in the streamline's list.
+The image itself is only read, so several threads may do this at once if
+each has its own scratch space.
 
 Entry:
-  st - new streamline
-
-Exit:
-  returns quality measure
+  st   - streamline whose pixel contributions we want
+  work - scratch space to use
 ******************************************************************************/
 
-float Lowpass::new_quality(Streamline *st)
+void Lowpass::compute_values(Streamline *st, LowpassWork *work)
 {
-  float a, b, c;
-
-  if (!filter_made) {
-    create_radial_filter();
-    /*
-    for (int k = 0; k <= 300; k++) {
-      float tt = k / 300.0;
-      printf ("t radial_value: %f %f\n", tt, radial_value (1.0, tt));
-    }
-    */
-  }
-
   /* clear out the list of value contributions to the pixels */
   st->clear_values();
 
   /* examine each line segment in a streamline to find their contribution */
-  /* to a low-pass filtered version of the image */
+  /* to a low-pass filtered version of the image; a coarse image may use */
+  /* segments that span several samples */
 
-  for (int n = 0; n < st->samples - 1; n++) {
+  for (int n = 0; n < st->samples - 1; n += stride) {
 
     /* find coordinates of line segment ends */
 
+    int m = Min (n + stride, st->samples - 1);
     float x0 = st->xs(n);
     float y0 = st->ys(n);
-    float x1 = st->xs(n + 1);
-    float y1 = st->ys(n + 1);
-    float taper_scale = 0.5 * (st->pts[n].intensity + st->pts[n + 1].intensity);
+    float x1 = st->xs(m);
+    float y1 = st->ys(m);
+    float taper_scale = 0.5 * (st->ipts[n] + st->ipts[m]);
 
     float rad = rad_image->get_value((x0 + x1) * 0.5, (y0 + y1) * 0.5);
 
@@ -326,70 +297,270 @@ float Lowpass::new_quality(Streamline *st)
     x1 = x1 * xsize - 0.5;
     y1 = y1 * ysize / image->getaspect() - 0.5;
 
-    /* find which pixels the segment can affect */
+    /* find (or re-use) the pixels that the segment affects */
 
-    int i0 = (int) Min (floor(x0 - rad), floor(x1 - rad));
-    int i1 = (int) Max (ceil(x0 + rad), ceil(x1 + rad));
-    int j0 = (int) Min (floor(y0 - rad), floor(y1 - rad));
-    int j1 = (int) Max (ceil(y0 + rad), ceil(y1 + rad));
+    Footprint *fp = segment_footprint(x0, y0, x1, y1, rad, work);
 
-    /* clamp these values to the image size */
-    i0 = Max (i0, 0);
-    j0 = Max (j0, 0);
-    i1 = Min (i1, xsize - 1);
-    j1 = Min (j1, ysize - 1);
+    for (int k = 0; k < fp->num_pixels; k++) {
+      PixelValue *pv = &fp->pixels[k];
+      float value = pv->value * taper_scale;
+      if (value > 0) {
+        int *slot = &work->pixel_slot[pv->i + pv->j * xsize];
+        if (*slot < 0) {
+          *slot = st->num_values;
+          st->add_value(pv->i, pv->j, value);
+        } else
+          st->values[*slot].value += value;
+      }
+    }
+  }
 
-#if 0
-    printf ("x0 y0 x1 y1: %f %f %f %f\n", x0, y0, x1, y1);
-    printf ("i0 j0 i1 j1: %d %d %d %d\n", i0, j0, i1, j1);
-    printf ("\n");
-#endif
+  /* reset the pixel slots for the next streamline */
 
-    /* compute equation for line through the segment */
+  for (int n = 0; n < st->num_values; n++)
+    work->pixel_slot[st->values[n].i + st->values[n].j * xsize] = -1;
+}
 
-    compute_line(x0, y0, x1, y1, a, b, c);
 
-    /* loop over the possibly affected pixels */
+/******************************************************************************
+Find the pixels that a line segment contributes to.  Footprints are kept in
+a cache so that segments that didn't move between one version of a
+streamline and the next don't have to be filtered again.
 
-    for (int i = i0; i <= i1; i++) {
-      for (int j = j0; j <= j1; j++) {
-        float value = better_filter_segment(i, j, x0, y0, x1, y1, a, b, c);
-        value *= taper_scale;
-#if 0
-        printf ("i j value: %d %d %f\n", i, j, value);
-#endif
-        if (value > 0)
-          st->add_value(i, j, value);
-      }
-    }
+Entry:
+  x0,y0 - one segment endpoint, in pixels
+  x1,y1 - other endpoint
+  rad   - filter radius at the segment's center
+  work  - scratch space, whose cache is used
+
+Exit:
+  returns the segment's footprint, which is valid until the next call
+******************************************************************************/
+
+Footprint *Lowpass::segment_footprint(
+        float x0,
+        float y0,
+        float x1,
+        float y1,
+        float rad,
+        LowpassWork *work
+)
+{
+  Footprint *fp;
+  float *row_values = work->row_values;
+
+  if (cache_footprints) {
+    int found;
+    fp = work->cache->lookup(x0, y0, x1, y1, rad, found);
+    if (found)
+      return (fp);
+  } else {
+    fp = &work->scratch;
+    fp->num_pixels = 0;
   }
 
-  /* compute what the average pixel value would be if we added the streamline */
+  /* find which pixels the segment can affect */
 
-  float new_sum = sum;
+  int i0 = (int) Min (floor(x0 - rad), floor(x1 - rad));
+  int i1 = (int) Max (ceil(x0 + rad), ceil(x1 + rad));
+  int j0 = (int) Min (floor(y0 - rad), floor(y1 - rad));
+  int j1 = (int) Max (ceil(y0 + rad), ceil(y1 + rad));
 
-  for (int n = 0; n < st->num_values; n++) {
-    int i, j;
-    float value;
-    st->get_value(n, i, j, value);
-    new_sum -= Square (target - image->pixel(i, j));
-    image->pixel(i, j) += value;
-    new_sum += Square (target - image->pixel(i, j));
+  /* clamp these values to the image size */
+  i0 = Max (i0, 0);
+  j0 = Max (j0, 0);
+  i1 = Min (i1, xsize - 1);
+  j1 = Min (j1, ysize - 1);
+
+  /* compute equation for line through the segment */
+
+  float a, b, c;
+  compute_line(x0, y0, x1, y1, a, b, c);
+
+  /* loop over the possibly affected pixels, a row at a time */
+
+  for (int j = j0; j <= j1; j++) {
+    filter_row(&rad_image->pixel(0, j),
+               i0, i1, j, x0, y0, x1, y1, a, b, row_values);
+    for (int i = i0; i <= i1; i++)
+      if (row_values[i - i0] > 0)
+        fp->add_pixel(i, j, row_values[i - i0]);
   }
 
-  /* take out what we added in */
+  return (fp);
+}
+
+
+/******************************************************************************
+Find how much the quality measure would change if a streamline's pixel
+contributions were added to the image.  The image itself is only read,
+never modified.
+
+Entry:
+  st - streamline whose values have been found by compute_values()
+
+Exit:
+  returns change in quality measure
+******************************************************************************/
+
+double Lowpass::delta_quality(Streamline *st)
+{
+  double delta = 0;
+
+  /* (target - p - v)^2 - (target - p)^2 = v * (v - 2 * (target - p)) */
+
   for (int n = 0; n < st->num_values; n++) {
-    int i, j;
-    float value;
-    st->get_value(n, i, j, value);
-    image->pixel(i, j) -= value;
+    PixelValue *pv = &st->values[n];
+    float diff = target - image->pixel(pv->i, pv->j);
+    delta += pv->value * (pv->value - 2 * diff);
   }
 
-#if 0
-  printf ("sum new_sum: %f %f\n", sum, new_sum);
-#endif
+  return (delta);
+}
+
+
+/******************************************************************************
+Find how much the quality measure would change if one list of pixel values
+were taken out of the image and another put in, as when a streamline is
+replaced by a moved version of itself.  The image is only read.
+
+Entry:
+  old_values - values to be removed
+  num_old    - number of them
+  new_values - values to be added
+  num_new    - number of them
+  work       - scratch space to use
+
+Exit:
+  returns change in quality measure
+******************************************************************************/
+
+double Lowpass::swap_delta(
+        PixelValue *old_values,
+        int num_old,
+        PixelValue *new_values,
+        int num_new,
+        LowpassWork *work
+)
+{
+  Footprint &merged = work->merged;
+  int *pixel_slot = work->pixel_slot;
+
+  /* merge the two lists so that each pixel's net change is known */
+
+  merged.num_pixels = 0;
+
+  for (int n = 0; n < num_old + num_new; n++) {
+    PixelValue *pv = (n < num_old) ? &old_values[n] : &new_values[n - num_old];
+    float value = (n < num_old) ? -pv->value : pv->value;
+    int *slot = &pixel_slot[pv->i + pv->j * xsize];
+    if (*slot < 0) {
+      *slot = merged.num_pixels;
+      merged.add_pixel(pv->i, pv->j, value);
+    } else
+      merged.pixels[*slot].value += value;
+  }
+
+  /* (target - p - v)^2 - (target - p)^2 = v * (v - 2 * (target - p)) */
+
+  double delta = 0;
+
+  for (int n = 0; n < merged.num_pixels; n++) {
+    PixelValue *pv = &merged.pixels[n];
+    float diff = target - image->pixel(pv->i, pv->j);
+    delta += pv->value * (pv->value - 2 * diff);
+    pixel_slot[pv->i + pv->j * xsize] = -1;
+  }
+
+  return (delta);
+}
 
-  return (new_sum);
+
+/******************************************************************************
+Find how much the quality measure would change if a streamline were replaced
+by another, or taken out altogether.  The image is only read.
+
+Entry:
+  old_st - streamline to be removed
+  new_st - streamline to put in its place, or NULL for none
+  work   - scratch space to use
+
+Exit:
+  returns change in quality measure
+******************************************************************************/
+
+double Lowpass::swap_delta(
+        Streamline *old_st,
+        Streamline *new_st,
+        LowpassWork *work
+)
+{
+  if (new_st == NULL)
+    return (swap_delta(old_st->values, old_st->num_values, NULL, 0, work));
+  else
+    return (swap_delta(old_st->values, old_st->num_values,
+                       new_st->values, new_st->num_values, work));
+}
+
+
+/******************************************************************************
+Make sure there is scratch space for a number of threads to find streamline
+values at the same time.
+
+Entry:
+  num - number of threads, the main one included
+******************************************************************************/
+
+void Lowpass::make_works(int num)
+{
+  if (num <= num_works)
+    return;
+
+  LowpassWork **temp = new LowpassWork *[num];
+  for (int i = 0; i < num; i++)
+    temp[i] = (i < num_works) ? works[i] : new LowpassWork(xsize, ysize);
+
+  delete[] works;
+  works = temp;
+  num_works = num;
+}
+
+
+/******************************************************************************
+Change the target gray-scale value of the image.
+
+Entry:
+  targ - new target value
+******************************************************************************/
+
+void Lowpass::set_target(float targ)
+{
+  target = targ;
+
+  /* every tile's part of the quality measure has to be found again */
+
+  for (int t = 0; t < tiles_x * tiles_y; t++)
+    energy_stamp[t] = 0;
+
+  sum = tiled_quality();
+}
+
+
+/******************************************************************************
+What is the new quality measure of a low-pass image, given a new
+streamline?
+
+Entry:
+  st - new streamline
+
+Exit:
+  returns quality measure
+******************************************************************************/
+
+double Lowpass::new_quality(Streamline *st)
+{
+  compute_values(st);
+  return (sum + delta_quality(st));
 }
 
 
@@ -410,10 +581,6 @@ void Lowpass::filter_segment(
         float scale
 )
 {
-  /* create the radial filter if it hasn't already been made */
-  if (!filter_made)
-    create_radial_filter();
-
   /* get the filter radius at the segment's center */
   float rad = rad_image->get_value((x0 + x1) * 0.5, (y0 + y1) * 0.5);
 
@@ -443,32 +610,65 @@ void Lowpass::filter_segment(
   /* loop over the possibly affected pixels, adding the segment's */
   /* contribution to the image */
 
-  for (int i = i0; i <= i1; i++)
-    for (int j = j0; j <= j1; j++) {
-      float value = better_filter_segment(i, j, x0, y0, x1, y1, a, b, c);
-      image->pixel(i, j) += value * scale;
-    }
+  float *row_values = works[0]->row_values;
+
+  for (int j = j0; j <= j1; j++) {
+    filter_row(&rad_image->pixel(0, j),
+               i0, i1, j, x0, y0, x1, y1, a, b, row_values);
+    for (int i = i0; i <= i1; i++)
+      image->pixel(i, j) += row_values[i - i0] * scale;
+  }
+
+  /* mark the tiles that were touched */
+
+  stamp++;
+  for (int tj = j0 / LOWPASS_TILE; tj <= j1 / LOWPASS_TILE; tj++)
+    for (int ti = i0 / LOWPASS_TILE; ti <= i1 / LOWPASS_TILE; ti++)
+      tile_stamp[tj * tiles_x + ti] = stamp;
 }
 
 
 /******************************************************************************
-Add a streamline to an image.
+Add or subtract a list of pixel values to the image, and mark the tiles that
+they touch as changed.
+
+Entry:
+  values - pixel values, such as a streamline's from compute_values()
+  num    - number of values
+  sign   - 1 to add the values, -1 to subtract them
 ******************************************************************************/
 
-void Lowpass::add_line(Streamline *st)
+void Lowpass::change_pixels(PixelValue *values, int num, float sign)
 {
-  int i, j;
-  float value;
+  double delta = 0;
 
-  /* add these values to the image */
+  stamp++;
 
-  for (int n = 0; n < st->num_values; n++) {
-    st->get_value(n, i, j, value);
-    sum -= Square (target - image->pixel(i, j));
-    image->pixel(i, j) += value;
-    sum += Square (target - image->pixel(i, j));
+  /* sum the change in quality separately, so that small changes */
+  /* aren't lost against a large sum */
+
+  for (int n = 0; n < num; n++) {
+    int i = values[n].i;
+    int j = values[n].j;
+    double diff = target - image->pixel(i, j);
+    image->pixel(i, j) += sign * values[n].value;
+    double new_diff = target - image->pixel(i, j);
+    delta += new_diff * new_diff - diff * diff;
+    tile_stamp[(j / LOWPASS_TILE) * tiles_x + i / LOWPASS_TILE] = stamp;
   }
 
+  sum += delta;
+}
+
+
+/******************************************************************************
+Add a streamline to an image.
+******************************************************************************/
+
+void Lowpass::add_line(Streamline *st)
+{
+  change_pixels(st->values, st->num_values, 1.0);
+
   /* add new streamline to bundle */
   bundle->add_line(st);
 }
@@ -480,17 +680,7 @@ Remove a streamline from an image.
 
 void Lowpass::delete_line(Streamline *st)
 {
-  int i, j;
-  float value;
-
-  /* subtract these values from the image */
-
-  for (int n = 0; n < st->num_values; n++) {
-    st->get_value(n, i, j, value);
-    sum -= Square (target - image->pixel(i, j));
-    image->pixel(i, j) -= value;
-    sum += Square (target - image->pixel(i, j));
-  }
+  change_pixels(st->values, st->num_values, -1.0);
 
   /* remove streamline from bundle */
   bundle->delete_line(st);
@@ -512,10 +702,10 @@ void Lowpass::draw_lines(Window2d *win)
 Calculate the image quality from scratch.
 ******************************************************************************/
 
-float Lowpass::recalculate_quality()
+double Lowpass::recalculate_quality()
 {
   int i, j;
-  float tsum = 0;
+  double tsum = 0;
 
   /* re-create image */
 
@@ -533,15 +723,147 @@ float Lowpass::recalculate_quality()
   /* calculate sum */
 
   for (i = 0; i < xsize; i++)
-    for (j = 0; j < ysize; j++)
-      tsum += Square (target - image->pixel(i, j));
+    for (j = 0; j < ysize; j++) {
+      double diff = target - image->pixel(i, j);
+      tsum += diff * diff;
+    }
 
   sum = tsum;
 
+  /* every pixel may have changed */
+  stamp++;
+  for (i = 0; i < tiles_x * tiles_y; i++)
+    tile_stamp[i] = stamp;
+
+  return (tsum);
+}
+
+
+/******************************************************************************
+Make a list of the tiles of the image that have changed.
+
+Entry:
+  since - value of get_stamp() when the caller last looked at the image
+
+Exit:
+  list - indices of the changed tiles (must hold num_tiles() entries)
+  returns number of changed tiles
+******************************************************************************/
+
+int Lowpass::changed_tiles(unsigned int since, int *list)
+{
+  int count = 0;
+
+  for (int t = 0; t < tiles_x * tiles_y; t++)
+    if (tile_stamp[t] > since)
+      list[count++] = t;
+
+  return (count);
+}
+
+
+/******************************************************************************
+Find the pixels covered by a tile.
+
+Entry:
+  tile - index of tile
+
+Exit:
+  x0,y0 - lower corner of tile (inclusive)
+  x1,y1 - upper corner of tile (exclusive)
+******************************************************************************/
+
+void Lowpass::tile_bounds(int tile, int &x0, int &y0, int &x1, int &y1)
+{
+  x0 = (tile % tiles_x) * LOWPASS_TILE;
+  y0 = (tile / tiles_x) * LOWPASS_TILE;
+
+  x1 = x0 + LOWPASS_TILE;
+  if (x1 > xsize)
+    x1 = xsize;
+
+  y1 = y0 + LOWPASS_TILE;
+  if (y1 > ysize)
+    y1 = ysize;
+}
+
+
+/******************************************************************************
+Return the sum of squared deviations from the target within one tile.  The
+sum is only recomputed if the tile has changed since it was last asked for.
+
+Entry:
+  tile - index of tile
+
+Exit:
+  returns the tile's part of the quality measure
+******************************************************************************/
+
+double Lowpass::tile_quality(int tile)
+{
+  if (energy_stamp[tile] >= tile_stamp[tile])
+    return (tile_energy[tile]);
+
+  int x0, y0, x1, y1;
+  tile_bounds(tile, x0, y0, x1, y1);
+
+  double tsum = 0;
+  for (int j = y0; j < y1; j++)
+    for (int i = x0; i < x1; i++) {
+      double diff = target - image->pixel(i, j);
+      tsum += diff * diff;
+    }
+
+  tile_energy[tile] = tsum;
+  energy_stamp[tile] = stamp;
+
   return (tsum);
 }
 
 
+/******************************************************************************
+Sum the quality measure over the whole image, re-scanning only the tiles
+that have changed since the last call.  Unlike recalculate_quality(), this
+uses the pixel values as they stand and leaves the running sum alone.
+
+Exit:
+  returns quality measure
+******************************************************************************/
+
+double Lowpass::tiled_quality()
+{
+  double tsum = 0;
+
+  for (int t = 0; t < tiles_x * tiles_y; t++)
+    tsum += tile_quality(t);
+
+  return (tsum);
+}
+
+
+/******************************************************************************
+Re-draw the parts of the image that have changed.  The image must have been
+drawn with draw() first, which sets the range of gray values.
+
+Entry:
+  win   - window to draw into
+  since - value of get_stamp() when the image was last drawn
+******************************************************************************/
+
+void Lowpass::draw_changes(Window2d *win, unsigned int since)
+{
+  int x0, y0, x1, y1;
+
+  for (int t = 0; t < tiles_x * tiles_y; t++)
+    if (tile_stamp[t] > since) {
+      tile_bounds(t, x0, y0, x1, y1);
+      image->draw_region(win, x0, y0, x1, y1);
+    }
+
+  win->flush();
+}
+
+
 /******************************************************************************
 Is a particular pixel below the threshold at which we want a birth?
 
@@ -559,6 +881,22 @@ int Lowpass::birth_test(float x, float y, float birth_thresh)
 }
 
 
+/******************************************************************************
+Clear the image to black.  The streamlines of the bundle are left alone.
+******************************************************************************/
+
+void Lowpass::clear()
+{
+  image->setimage(0.0);
+
+  stamp++;
+  for (int t = 0; t < tiles_x * tiles_y; t++)
+    tile_stamp[t] = stamp;
+
+  sum = tiled_quality();
+}
+
+
 /******************************************************************************
 Delete all streamlines of this lowpass image.
 ******************************************************************************/
@@ -582,6 +920,9 @@ Entry:
 
 void Lowpass::set_radius(float r1, float r2)
 {
+  for (int i = 0; i < num_works; i++)
+    works[i]->cache->clear();
+
   for (int i = 0; i < xsize; i++) {
     float t = i / (float) (xsize - 1);
     float r = r1 + t * (r2 - r1);
@@ -631,8 +972,8 @@ float Lowpass::random_samples_quality(
 
   int inside_points = 0;
   for (i = 0; i < st->samples; i++) {
-    x = st->pts[i].x;
-    y = st->pts[i].y;
+    x = st->xpts[i];
+    y = st->ypts[i];
     if (x > xmin && x < xmax && y > ymin && y < ymax) {
       inside_points = 1;
       break;
@@ -665,9 +1006,8 @@ float Lowpass::random_samples_quality(
         rad = 2 * radius;
       }
 
-      SamplePoint *sample = &st->pts[index];
-      x = sample->x + rad * (2 * drand48() - 1);
-      y = sample->y + rad * (2 * drand48() - 1);
+      x = st->xpts[index] + rad * (2 * drand48() - 1);
+      y = st->ypts[index] + rad * (2 * drand48() - 1);
 
     } while (x < xmin || x > xmax || y < ymin || y > ymax);
 
@@ -695,11 +1035,9 @@ float Lowpass::random_samples_quality(
 
     /* pick a random sample near the streamline in the lowpass image */
 
-    SamplePoint *sample = &st->pts[index];
-
     do {
-      x = sample->x + 2 * radius * (2 * drand48() - 1);
-      y = sample->y + 2 * radius * (2 * drand48() - 1);
+      x = st->xpts[index] + 2 * radius * (2 * drand48() - 1);
+      y = st->ypts[index] + 2 * radius * (2 * drand48() - 1);
     } while (x < 0 || x > 1 || y < 0 || y > image->getaspect());
 
     /* debug drawing of samples */
@@ -761,8 +1099,8 @@ float Lowpass::shorten_quality(
   /* measure the quality as we move into the body of the streamline */
   /* from the tail endpoint */
 
-  x = st->pts[0].x;
-  y = st->pts[0].y;
+  x = st->xpts[0];
+  y = st->ypts[0];
   rad = radius * rad_image->get_value(x, y) / xsize;
   delta = dist * rad / nsamples;
 
@@ -791,8 +1129,8 @@ float Lowpass::shorten_quality(
 
   /* now measure from the head */
 
-  x = st->pts[st->samples - 1].x;
-  y = st->pts[st->samples - 1].y;
+  x = st->xpts[st->samples - 1];
+  y = st->ypts[st->samples - 1];
   rad = radius * rad_image->get_value(x, y) / xsize;
   delta = dist * rad / nsamples;
 
@@ -885,8 +1223,8 @@ float Lowpass::lengthen_quality(
 
   /* measure the quality as we move away from the streamline's tail */
 
-  x = st->pts[0].x;
-  y = st->pts[0].y;
+  x = st->xpts[0];
+  y = st->ypts[0];
   rad = radius * rad_image->get_value(x, y) / xsize;
   delta = dist * rad / nsamples;
 
@@ -915,8 +1253,8 @@ float Lowpass::lengthen_quality(
 
   /* now measure from the head */
 
-  x = st->pts[st->samples - 1].x;
-  y = st->pts[st->samples - 1].y;
+  x = st->xpts[st->samples - 1];
+  y = st->ypts[st->samples - 1];
   rad = radius * rad_image->get_value(x, y) / xsize;
   delta = dist * rad / nsamples;
 
@@ -1011,10 +1349,8 @@ float Lowpass::main_body_quality(
   for (i = 0; i < nsamples; i++) {
 
     int index = (int) (st->samples * drand48());
-    SamplePoint *sample = &st->pts[index];
-
-    x = sample->x;
-    y = sample->y;
+    x = st->xpts[index];
+    y = st->ypts[index];
 
     /* don't measure near the borders */
     if (x < xmin || x > xmax || y < ymin || y > ymax)
@@ -20,17 +20,52 @@ warranty of merchantability or fitness for a particular purpose.
 #include <math.h>
 #include "../libs/floatimage.h"
 #include "streamline.h"
+#include "footprint.h"
 
 #ifndef _LOWPASS_CLASS_
 #define _LOWPASS_CLASS_
 
+#define FOOTPRINT_CACHE_SIZE 16384   /* segments whose footprints are kept */
+
+#define LOWPASS_TILE 8   /* width and height of a tile of the image */
+
+/* scratch space for finding a streamline's pixel values; each thread */
+/* that evaluates streamlines at the same time needs its own */
+
+class LowpassWork
+{
+public:
+    int *pixel_slot;       /* where each pixel is in a streamline's values */
+    float *row_values;     /* one row of a segment's filtered values */
+    FootprintCache *cache; /* footprints of recently seen segments */
+    Footprint scratch;     /* footprint when the cache is turned off */
+    Footprint merged;      /* combined pixel changes of a swap */
+
+    LowpassWork(int, int);
+
+    ~LowpassWork();
+};
+
+
 class Lowpass
 {
     FloatImage *image;     /* low-pass version of image */
     float target;          /* target gray-scale pixel value */
-    float sum;             /* current sum of all pixel values */
+    double sum;            /* current sum of squared deviations from target */
     float dev;             /* deviation from target */
     FloatImage *rad_image; /* spatially varying radius */
+    LowpassWork **works;   /* scratch space, the main thread's first */
+    int num_works;
+    int stride;            /* samples spanned by each filtered segment */
+
+    int tiles_x, tiles_y;  /* number of tiles across and down the image */
+    unsigned int stamp;    /* count of changes made to the image */
+    unsigned int *tile_stamp;   /* when each tile was last changed */
+    unsigned int *energy_stamp; /* when each tile's energy was last found */
+    double *tile_energy;   /* sum of squared deviations within each tile */
+
+    Footprint *segment_footprint(float, float, float, float, float,
+                                 LowpassWork *);
 public:
     Bundle *bundle;      /* bundle of streamlines in the image */
     int xsize, ysize;
@@ -42,12 +77,82 @@ public:
       delete image;
       delete rad_image;
       delete bundle;
+      for (int i = 0; i < num_works; i++)
+        delete works[i];
+      delete[] works;
+      delete[] tile_stamp;
+      delete[] energy_stamp;
+      delete[] tile_energy;
     }
 
-    float current_quality()
+    double current_quality()
     { return (sum); }
 
-    float new_quality(Streamline *st);
+    float get_target()
+    { return (target); }
+
+    double new_quality(Streamline *st);
+
+    void compute_values(Streamline *st)
+    { compute_values(st, works[0]); }
+
+    void compute_values(Streamline *, LowpassWork *);
+
+    double delta_quality(Streamline *st);
+
+    double swap_delta(PixelValue *old_values, int num_old,
+                      PixelValue *new_values, int num_new)
+    { return (swap_delta(old_values, num_old, new_values, num_new, works[0])); }
+
+    double swap_delta(PixelValue *, int, PixelValue *, int, LowpassWork *);
+
+    double swap_delta(Streamline *old_st, Streamline *new_st)
+    { return (swap_delta(old_st, new_st, works[0])); }
+
+    double swap_delta(Streamline *, Streamline *, LowpassWork *);
+
+    void make_works(int);
+
+    LowpassWork *get_work(int n)
+    { return (works[n]); }
+
+    void change_pixels(PixelValue *, int, float);
+
+    void set_target(float);
+
+    void set_stride(int n)
+    { stride = n; }
+
+    void get_cache_stats(int &hits, int &misses)
+    {
+      hits = misses = 0;
+      for (int i = 0; i < num_works; i++) {
+        hits += works[i]->cache->hits;
+        misses += works[i]->cache->misses;
+      }
+    }
+
+    /* tracking which parts of the image have changed; a caller keeps */
+    /* the value of get_stamp() from its last look at the image */
+
+    unsigned int get_stamp()
+    { return (stamp); }
+
+    int num_tiles()
+    { return (tiles_x * tiles_y); }
+
+    int tile_changed(int tile, unsigned int since)
+    { return (tile_stamp[tile] > since); }
+
+    int changed_tiles(unsigned int, int *);
+
+    void tile_bounds(int, int &, int &, int &, int &);
+
+    double tile_quality(int);
+
+    double tiled_quality();
+
+    void draw_changes(Window2d *, unsigned int);
 
     float get_radius(float x, float y)
     {
@@ -63,7 +168,9 @@ public:
 
     void delete_streamlines();
 
-    float recalculate_quality();
+    void clear();
+
+    double recalculate_quality();
 
     void draw(Window2d *win)
     { image->draw(win); }
@@ -100,5 +207,7 @@ public:
     friend class Streamline;
 };
 
+void set_footprint_cache(int);
+
 #endif /* _LOWPASS_CLASS_ */
 
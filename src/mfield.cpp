@@ -27,6 +27,7 @@ warranty of merchantability or fitness for a particular purpose.
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
+#include "vecfile.h"
 
 #define CIRCLE     1
 #define SADDLE     2
@@ -79,8 +80,8 @@ int main(int argc, char *argv[])
   float *VectorField;
   register float x, y;
   register int i, j;
-  int fd, cc;
-  char str[80];
+  int encoding = VEC_F32;
+  int tile = 0;
   char *s;
   int which = CIRCLE;
   float angle;
@@ -111,6 +112,18 @@ int main(int argc, char *argv[])
         case 'l':
           lic_style = 1;
           break;
+        case 'e':
+          encoding = vec_encoding(*++argv);
+          if (encoding < 0) {
+            fprintf(stderr, "%s: unknown encoding '%s'\n", myname, *argv);
+            exit(-1);
+          }
+          argc -= 1;
+          break;
+        case 't':
+          tile = atoi(*++argv);
+          argc -= 1;
+          break;
         case 'n':
           noise_cycles = atof(*++argv);
           which = NOISE;
@@ -231,30 +244,8 @@ int main(int argc, char *argv[])
     }
   }
 
-  fd = open(file, O_CREAT | O_TRUNC | O_WRONLY, 0666);
-  if (fd < 0) {
-    fprintf(stderr, "%s: unable to open %s: %s\n", myname, file,
-            strerror(errno));
-    exit(-1);
-  }
-
-  sprintf(str, "VF\n%d %d %d\n%d\n", xsize, ysize, zsize, Rank);
-  cc = write(fd, str, strlen(str));
-  if (cc == -1) {
-    fprintf(stderr, "Can't write to file.\n");
+  if (!write_vec_file(file, xsize, ysize, VectorField, encoding, tile))
     exit(-1);
-  }
-
-  cc = write(fd, VectorField, 2 * sizeof(float) * xsize * ysize);
-
-  if (cc != 2 * sizeof(float) * xsize * ysize) {
-    fprintf(stderr, "%s: write returned short: %s\n", myname,
-            strerror(errno));
-    close(fd);
-    exit(-1);
-  }
-
-  close(fd);
   return 0;
 }
 
@@ -272,6 +263,8 @@ void usage()
   fprintf(stderr, "         [-n noise_cycles]\n");
   fprintf(stderr, "         [-c circulation]\n");
   fprintf(stderr, "         [-l] (LIC file)\n");
+  fprintf(stderr, "         [-e encoding] (f32, f16 or f8)\n");
+  fprintf(stderr, "         [-t tile_size] (tiled file)\n");
   fprintf(stderr, "         [-m xmin xmax ymin ymax]\n");
   fprintf(stderr, "\n");
   fprintf(stderr, "field_type:\n");
@@ -29,6 +29,7 @@ warranty of merchantability or fitness for a particular purpose.
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
+#include "vecfile.h"
 
 void usage();
 
@@ -64,8 +65,8 @@ int main(int argc, char *argv[])
   register int i, j;
   char *file;
   float *VectorField;
-  int fd, cc;
-  char str[80];
+  int encoding = VEC_F32;
+  int tile = 0;
   char *s;
   int lic_style = 0;    /* write out LIC file type? */
   float fx, fy;
@@ -85,6 +86,18 @@ int main(int argc, char *argv[])
         case 'l':
           lic_style = 1;
           break;
+        case 'e':
+          encoding = vec_encoding(*++argv);
+          if (encoding < 0) {
+            fprintf(stderr, "%s: unknown encoding '%s'\n", myname, *argv);
+            exit(-1);
+          }
+          argc -= 1;
+          break;
+        case 't':
+          tile = atoi(*++argv);
+          argc -= 1;
+          break;
         case 'n':
           normalize = 1 - normalize;
           break;
@@ -192,30 +205,8 @@ int main(int argc, char *argv[])
     }
   }
 
-  fd = open(file, O_CREAT | O_TRUNC | O_WRONLY, 0666);
-  if (fd < 0) {
-    fprintf(stderr, "%s: unable to open %s: %s\n", myname, file,
-            strerror(errno));
-    exit(-1);
-  }
-
-  sprintf(str, "VF\n%d %d %d\n%d\n", xsize, ysize, zsize, Rank);
-  cc = write(fd, str, strlen(str));
-  if (cc == -1) {
-    fprintf(stderr, "Can't write to file.\n");
+  if (!write_vec_file(file, xsize, ysize, VectorField, encoding, tile))
     exit(-1);
-  }
-
-  cc = write(fd, VectorField, 2 * sizeof(float) * xsize * ysize);
-
-  if (cc != 2 * sizeof(float) * xsize * ysize) {
-    fprintf(stderr, "%s: write returned short: %s\n", myname,
-            strerror(errno));
-    close(fd);
-    exit(-1);
-  }
-
-  close(fd);
 }
 
 
@@ -228,5 +219,7 @@ void usage()
   fprintf(stderr, "%s: { options } output_file\n", myname);
   fprintf(stderr, "        -s xsize ysize (default 20 by 20)\n");
   fprintf(stderr, "        -k smoothing_steps (default 40)\n");
+  fprintf(stderr, "        -e encoding (f32, f16 or f8; default f32)\n");
+  fprintf(stderr, "        -t tile_size (write in tiles; default not)\n");
 }
 
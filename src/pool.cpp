@@ -0,0 +1,234 @@
+/*
+
+Recycling pool for the buffers of short-lived streamlines.
+
+Every proposed move in improve_lines() creates a streamline, finds its
+pixel contributions and then throws one of the old or new streamlines away.
+Rather than going to the heap each time, the streamline object, its sample
+points and its pixel values are taken from free lists of blocks whose sizes
+are powers of two.  A discarded streamline puts its blocks back on the free
+lists, and the next proposal picks them up again, so once the lists have
+filled up the optimizer runs without touching the heap.
+
+The free lists belong to the thread that frees a block, so no locking is
+needed.  Blocks made by one thread and freed by another would pile up on
+the second thread's lists, so a block freed onto a list that is already
+long is given back to the system instead.  A thread's lists are emptied
+when the thread exits.
+
+The global operator new is replaced here by one that counts calls, and
+the pool counts the blocks it has to take from the heap, so that the number
+of heap allocations the whole program makes per iteration can be reported.
+
+---------------------------------------------------------------------
+
+Copyright (c) 1996 The University of North Carolina.  All rights reserved.
+
+Permission to use, copy, modify and distribute this software and its
+documentation for any purpose is hereby granted without fee, provided
+that the above copyright notice and this permission notice appear in
+all copies of this software and that you do not sell the software.
+
+The software is provided "as is" and without warranty of any kind,
+express, implied or otherwise, including without limitation, any
+warranty of merchantability or fitness for a particular purpose.
+
+*/
+
+
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+#include "pool.h"
+
+/* a thread's free lists, one for each block size, and their lengths */
+
+class FreeLists
+{
+public:
+    void *list[POOL_CLASSES];
+    int count[POOL_CLASSES];
+
+    FreeLists()
+    {
+      for (int n = 0; n < POOL_CLASSES; n++) {
+        list[n] = NULL;
+        count[n] = 0;
+      }
+    }
+
+    /* give the blocks back when the thread exits; the lists are left */
+    /* looking full, so any block freed after this goes straight back too */
+
+    ~FreeLists()
+    {
+      for (int n = 0; n < POOL_CLASSES; n++) {
+        while (list[n]) {
+          void *next = *(void **) list[n];
+          free(list[n]);
+          list[n] = next;
+        }
+        count[n] = POOL_MAX_FREE;
+      }
+    }
+};
+
+static thread_local FreeLists free_lists;
+
+/* number of times memory was taken from the heap */
+static std::atomic<long> heap_allocations(0);
+
+
+/******************************************************************************
+Find the size class of a block.
+
+Entry:
+  bytes - size of block wanted
+
+Exit:
+  returns index of the smallest class that holds the block
+******************************************************************************/
+
+static int size_class(size_t bytes)
+{
+  int n = 0;
+  size_t size = POOL_MIN_BYTES;
+
+  while (size < bytes) {
+    size *= 2;
+    n++;
+  }
+
+  return (n);
+}
+
+
+/******************************************************************************
+Get a block from the pool.
+
+Entry:
+  bytes - size of block wanted
+
+Exit:
+  bytes - actual size of the block, which may be larger
+  returns pointer to the block
+******************************************************************************/
+
+void *pool_alloc(size_t &bytes)
+{
+  int n = size_class(bytes);
+  bytes = (size_t) POOL_MIN_BYTES << n;
+
+  FreeLists &lists = free_lists;
+  void *ptr = lists.list[n];
+
+  if (ptr) {
+    lists.list[n] = *(void **) ptr;
+    lists.count[n]--;
+    return (ptr);
+  }
+
+  heap_allocations++;
+  ptr = malloc(bytes);
+  if (ptr == NULL)
+    throw std::bad_alloc();
+
+  return (ptr);
+}
+
+
+/******************************************************************************
+Give a block back to the pool.
+
+Entry:
+  ptr   - block from pool_alloc()
+  bytes - size of block as returned by pool_alloc()
+******************************************************************************/
+
+void pool_free(void *ptr, size_t bytes)
+{
+  int n = size_class(bytes);
+  FreeLists &lists = free_lists;
+
+  if (lists.count[n] >= POOL_MAX_FREE) {
+    free(ptr);
+    return;
+  }
+
+  *(void **) ptr = lists.list[n];
+  lists.list[n] = ptr;
+  lists.count[n]++;
+}
+
+
+/******************************************************************************
+Return the number of heap allocations made so far, both by the pool and
+by operator new.
+******************************************************************************/
+
+long get_heap_allocations()
+{
+  return (heap_allocations);
+}
+
+
+/******************************************************************************
+Replacements for the global operator new and delete that count allocations.
+******************************************************************************/
+
+void *operator new(size_t bytes)
+{
+  heap_allocations++;
+
+  void *ptr = malloc(bytes ? bytes : 1);
+  if (ptr == NULL)
+    throw std::bad_alloc();
+
+  return (ptr);
+}
+
+void *operator new[](size_t bytes)
+{
+  return (operator new(bytes));
+}
+
+void *operator new(size_t bytes, const std::nothrow_t &) noexcept
+{
+  heap_allocations++;
+  return (malloc(bytes ? bytes : 1));
+}
+
+void *operator new[](size_t bytes, const std::nothrow_t &) noexcept
+{
+  return (operator new(bytes, std::nothrow));
+}
+
+void operator delete(void *ptr) noexcept
+{
+  free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+  free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+  free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+  free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+  free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+  free(ptr);
+}
@@ -0,0 +1,55 @@
+//
+//  Recycling pool for the buffers of short-lived streamlines, and a count
+//  of the heap allocations made by the program
+//
+
+/*
+Copyright (c) 1996 The University of North Carolina.  All rights reserved.
+
+Permission to use, copy, modify and distribute this software and its
+documentation for any purpose is hereby granted without fee, provided
+that the above copyright notice and this permission notice appear in
+all copies of this software and that you do not sell the software.
+
+The software is provided "as is" and without warranty of any kind,
+express, implied or otherwise, including without limitation, any
+warranty of merchantability or fitness for a particular purpose.
+*/
+
+
+#ifndef _POOL_
+#define _POOL_
+
+#include <stddef.h>
+
+#define POOL_MIN_BYTES  16   /* smallest block handed out by the pool */
+#define POOL_CLASSES    40   /* block sizes are POOL_MIN_BYTES * 2^n */
+#define POOL_MAX_FREE  512   /* longest free list for each block size */
+
+void *pool_alloc(size_t &bytes);
+
+void pool_free(void *ptr, size_t bytes);
+
+long get_heap_allocations();
+
+
+/* typed versions, for arrays of plain records */
+
+template <class T>
+T *pool_array(int &count)
+{
+  size_t bytes = count * sizeof(T);
+  T *ptr = (T *) pool_alloc(bytes);
+  count = (int) (bytes / sizeof(T));
+  return (ptr);
+}
+
+template <class T>
+void pool_release(T *ptr, int count)
+{
+  if (ptr)
+    pool_free(ptr, count * sizeof(T));
+}
+
+#endif /* _POOL_ */
+
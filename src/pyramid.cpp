@@ -0,0 +1,437 @@
+/*
+
+A pyramid of low-pass images for cascaded optimization.
+
+When streamlines are placed by a cascade of optimizations, each one at half
+the separation of the one before, the low-pass image of each stage has about
+twice the resolution of the one before it.  Rather than throwing away the
+image of a finished stage, the pyramid keeps it, and keeps it up to date as
+streamlines are added and removed during the later stages.  Every streamline
+that the pyramid knows about has a slot, and each level remembers the
+streamline's contributions to its image in that slot.
+
+The finest level of the pyramid is one step coarser than the image being
+optimized.  The filter radius is the same number of pixels at every level,
+so a streamline is filtered there using segments that span twice as many
+samples, and it costs about half as much to rasterize it.  A level keeps
+this stride for as long as it lasts, so that all of the contributions kept
+in it are found the same way.  The image of a finished stage was drawn with
+the shorter segments of that stage, so it is cleared and drawn again with
+the longer ones when it is put onto the pyramid.  A proposed move
+can be tried out there first, and moves that make the coarse image worse
+need never be tried at full resolution.  How much worse a move may make it
+is measured against the energy of the old streamline's own footprint, which
+makes the test independent of the target gray value and of the image size.
+
+Streamlines at a finer separation are packed twice as densely, so the
+target gray value of a level grows by a factor of two for each step it is
+coarser than the image being optimized.
+
+Images of stages that haven't been reached yet are not kept, because
+updating them for every accepted move would cost far more than building
+each one once, when its stage begins.  Each stage's own image is twice as
+fine as any level of the pyramid, so its streamlines are still drawn into
+it from scratch.
+
+---------------------------------------------------------------------
+
+Copyright (c) 1996 The University of North Carolina.  All rights reserved.
+
+Permission to use, copy, modify and distribute this software and its
+documentation for any purpose is hereby granted without fee, provided
+that the above copyright notice and this permission notice appear in
+all copies of this software and that you do not sell the software.
+
+The software is provided "as is" and without warranty of any kind,
+express, implied or otherwise, including without limitation, any
+warranty of merchantability or fitness for a particular purpose.
+
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "pyramid.h"
+#include "pool.h"
+
+
+/******************************************************************************
+Create an empty pyramid.
+******************************************************************************/
+
+LowpassPyramid::LowpassPyramid()
+{
+  num_levels = 0;
+  max_slots = 500;
+  num_slots = 0;
+  free_slots = new int[max_slots];
+  num_free = 0;
+  scratch = NULL;
+  scratch_num = 0;
+  scratch_max = 0;
+  rejects = 0;
+  passes = 0;
+}
+
+
+/******************************************************************************
+Delete a pyramid and all of its images.
+******************************************************************************/
+
+LowpassPyramid::~LowpassPyramid()
+{
+  for (int l = 0; l < num_levels; l++) {
+    PyramidLevel *level = &levels[l];
+    for (int s = 0; s < num_slots; s++)
+      pool_release(level->values[s], level->max_values[s]);
+    delete[] level->values;
+    delete[] level->num_values;
+    delete[] level->max_values;
+    delete level->image;
+  }
+
+  delete[] free_slots;
+  pool_release(scratch, scratch_max);
+}
+
+
+/******************************************************************************
+Put a new, finest level onto the pyramid, with empty slots.
+
+Entry:
+  low - low-pass image for the level, which the pyramid now owns
+******************************************************************************/
+
+void LowpassPyramid::init_level(Lowpass *low)
+{
+  if (num_levels >= PYRAMID_MAX_LEVELS) {
+    fprintf(stderr, "lowpass pyramid has too many levels\n");
+    exit(-1);
+  }
+
+  PyramidLevel *level = &levels[num_levels];
+
+  level->image = low;
+  level->values = new PixelValue *[max_slots];
+  level->num_values = new int[max_slots];
+  level->max_values = new int[max_slots];
+
+  for (int s = 0; s < max_slots; s++) {
+    level->values[s] = NULL;
+    level->num_values[s] = 0;
+    level->max_values[s] = 0;
+  }
+
+  num_levels++;
+}
+
+
+/******************************************************************************
+Find an unused slot for a streamline.
+
+Exit:
+  returns the slot
+******************************************************************************/
+
+int LowpassPyramid::new_slot()
+{
+  if (num_free > 0)
+    return (free_slots[--num_free]);
+
+  /* make sure every level has room for another slot */
+
+  if (num_slots >= max_slots) {
+
+    int new_max = max_slots * 2;
+
+    for (int l = 0; l < num_levels; l++) {
+      PyramidLevel *level = &levels[l];
+      PixelValue **values = new PixelValue *[new_max];
+      int *num_values = new int[new_max];
+      int *max_values = new int[new_max];
+      for (int s = 0; s < new_max; s++) {
+        values[s] = (s < max_slots) ? level->values[s] : NULL;
+        num_values[s] = (s < max_slots) ? level->num_values[s] : 0;
+        max_values[s] = (s < max_slots) ? level->max_values[s] : 0;
+      }
+      delete[] level->values;
+      delete[] level->num_values;
+      delete[] level->max_values;
+      level->values = values;
+      level->num_values = num_values;
+      level->max_values = max_values;
+    }
+
+    int *temp = new int[new_max];
+    for (int s = 0; s < num_free; s++)
+      temp[s] = free_slots[s];
+    delete[] free_slots;
+    free_slots = temp;
+
+    max_slots = new_max;
+  }
+
+  return (num_slots++);
+}
+
+
+/******************************************************************************
+Find the contributions a streamline makes to the image of one level.  The
+streamline's own list of values (for the image being optimized) is left
+as it was.
+
+Entry:
+  l      - level
+  st     - streamline
+  values - memory to put the contributions in (may be NULL)
+  max    - size of that memory
+
+Exit:
+  values - the contributions, possibly in new memory
+  num    - how many there are
+  max    - new size of the memory
+******************************************************************************/
+
+void LowpassPyramid::level_values(
+        int l,
+        Streamline *st,
+        PixelValue *&values,
+        int &num,
+        int &max
+)
+{
+  PixelValue *save_values = st->values;
+  int save_num = st->num_values;
+  int save_max = st->max_values;
+
+  if (values == NULL) {
+    max = 16;
+    values = pool_array<PixelValue>(max);
+  }
+
+  st->values = values;
+  st->max_values = max;
+  levels[l].image->compute_values(st);
+  values = st->values;
+  num = st->num_values;
+  max = st->max_values;
+
+  st->values = save_values;
+  st->num_values = save_num;
+  st->max_values = save_max;
+}
+
+
+/******************************************************************************
+Put a new, finest level onto the pyramid, and draw the streamlines of a
+bundle into it.  This is how the first level of a pyramid is made.
+
+Entry:
+  low    - low-pass image for the level, which the pyramid now owns
+  bundle - streamlines that are to be in the image
+******************************************************************************/
+
+void LowpassPyramid::add_level(Lowpass *low, Bundle *bundle)
+{
+  init_level(low);
+  low->set_stride(PYRAMID_STRIDE);
+
+  int l = num_levels - 1;
+  PyramidLevel *level = &levels[l];
+
+  for (int i = 0; i < bundle->num_lines; i++) {
+    Streamline *st = bundle->get_line(i);
+
+    /* streamlines new to the pyramid go into every level */
+    if (st->pyramid_slot < 0) {
+      num_levels--;
+      add_line(st);
+      num_levels++;
+    }
+
+    int s = st->pyramid_slot;
+    level_values(l, st, level->values[s], level->num_values[s],
+                 level->max_values[s]);
+    low->change_pixels(level->values[s], level->num_values[s], 1.0);
+  }
+}
+
+
+/******************************************************************************
+Put the low-pass image of a finished stage onto the pyramid as its new
+finest level.  The streamlines are drawn into it again with the longer
+segments of a pyramid level.
+
+Entry:
+  low    - low-pass image, which the pyramid now owns
+  bundle - copies of the streamlines in low->bundle, in the same order,
+           that take their place in the next stage
+******************************************************************************/
+
+void LowpassPyramid::push_level(Lowpass *low, Bundle *bundle)
+{
+  /* make sure that every streamline has a slot in the coarser levels */
+
+  for (int i = 0; i < low->bundle->num_lines; i++) {
+    Streamline *st = low->bundle->get_line(i);
+    if (st->pyramid_slot < 0)
+      add_line(st);
+  }
+
+  init_level(low);
+
+  int l = num_levels - 1;
+  PyramidLevel *level = &levels[l];
+
+  low->set_stride(PYRAMID_STRIDE);
+  low->clear();
+
+  /* find each streamline's contributions, and pass its slot on to */
+  /* the copy that replaces it */
+
+  for (int i = 0; i < low->bundle->num_lines; i++) {
+
+    Streamline *st = low->bundle->get_line(i);
+    int s = st->pyramid_slot;
+
+    level_values(l, st, level->values[s], level->num_values[s],
+                 level->max_values[s]);
+    low->change_pixels(level->values[s], level->num_values[s], 1.0);
+
+    bundle->get_line(i)->pyramid_slot = s;
+  }
+
+  /* the old streamlines have been replaced by their copies */
+
+  low->delete_streamlines();
+  delete low->bundle;
+  low->bundle = new Bundle();
+}
+
+
+/******************************************************************************
+Set the target gray value of each level.
+
+Entry:
+  targ - target value of the image being optimized
+******************************************************************************/
+
+void LowpassPyramid::set_target(float targ)
+{
+  float t = targ;
+
+  for (int l = num_levels - 1; l >= 0; l--) {
+    t *= 2;
+    levels[l].image->set_target(t);
+  }
+}
+
+
+/******************************************************************************
+Add a streamline to every level.
+
+Entry:
+  st - streamline to add
+******************************************************************************/
+
+void LowpassPyramid::add_line(Streamline *st)
+{
+  if (num_levels == 0)
+    return;
+
+  int s = new_slot();
+  st->pyramid_slot = s;
+
+  for (int l = 0; l < num_levels; l++) {
+    PyramidLevel *level = &levels[l];
+    level_values(l, st, level->values[s], level->num_values[s],
+                 level->max_values[s]);
+    level->image->change_pixels(level->values[s], level->num_values[s], 1.0);
+  }
+}
+
+
+/******************************************************************************
+Remove a streamline from every level.
+
+Entry:
+  st - streamline to remove
+******************************************************************************/
+
+void LowpassPyramid::delete_line(Streamline *st)
+{
+  int s = st->pyramid_slot;
+
+  if (s < 0)
+    return;
+
+  for (int l = 0; l < num_levels; l++) {
+    PyramidLevel *level = &levels[l];
+    level->image->change_pixels(level->values[s], level->num_values[s], -1.0);
+    level->num_values[s] = 0;
+  }
+
+  free_slots[num_free++] = s;
+  st->pyramid_slot = -1;
+}
+
+
+/******************************************************************************
+Find how the finest level of the pyramid would change if one streamline were
+replaced by another.  The pyramid is not changed.
+
+Entry:
+  old_st - streamline in the pyramid
+  new_st - proposed replacement
+
+Exit:
+  returns change in the quality measure of the finest level, or zero if
+  there is no level or the old streamline isn't in the pyramid
+******************************************************************************/
+
+double LowpassPyramid::swap_delta(Streamline *old_st, Streamline *new_st)
+{
+  int s = old_st->pyramid_slot;
+
+  if (num_levels == 0 || s < 0)
+    return (0.0);
+
+  int l = num_levels - 1;
+  PyramidLevel *level = &levels[l];
+
+  level_values(l, new_st, scratch, scratch_num, scratch_max);
+
+  return (level->image->swap_delta(level->values[s], level->num_values[s],
+                                   scratch, scratch_num));
+}
+
+
+/******************************************************************************
+Find the energy of a streamline's own footprint in the finest level of the
+pyramid, that is, the sum of the squares of its contributions.  This gives a
+scale against which to measure the changes found by swap_delta().
+
+Entry:
+  st - streamline in the pyramid
+
+Exit:
+  returns the energy, or zero if the streamline isn't in the pyramid
+******************************************************************************/
+
+double LowpassPyramid::footprint_energy(Streamline *st)
+{
+  int s = st->pyramid_slot;
+
+  if (num_levels == 0 || s < 0)
+    return (0.0);
+
+  PyramidLevel *level = &levels[num_levels - 1];
+  PixelValue *values = level->values[s];
+  double sum = 0;
+
+  for (int n = 0; n < level->num_values[s]; n++)
+    sum += values[n].value * values[n].value;
+
+  return (sum);
+}
+
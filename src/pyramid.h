@@ -0,0 +1,86 @@
+//
+//  A pyramid of low-pass images, one for each stage of a cascade of
+//  optimizations that halve the streamline separation
+//
+
+/*
+Copyright (c) 1996 The University of North Carolina.  All rights reserved.
+
+Permission to use, copy, modify and distribute this software and its
+documentation for any purpose is hereby granted without fee, provided
+that the above copyright notice and this permission notice appear in
+all copies of this software and that you do not sell the software.
+
+The software is provided "as is" and without warranty of any kind,
+express, implied or otherwise, including without limitation, any
+warranty of merchantability or fitness for a particular purpose.
+*/
+
+
+#ifndef _PYRAMID_CLASS_
+#define _PYRAMID_CLASS_
+
+#include "streamline.h"
+#include "lowpass.h"
+
+#define PYRAMID_MAX_LEVELS 8
+#define PYRAMID_STRIDE 2    /* samples spanned by each filtered segment */
+
+/* one level of the pyramid */
+
+class PyramidLevel
+{
+public:
+    Lowpass *image;        /* low-pass image at this level */
+    PixelValue **values;   /* each streamline's contributions, by slot */
+    int *num_values;       /* number of contributions in each slot */
+    int *max_values;       /* memory allocated to each slot */
+};
+
+
+class LowpassPyramid
+{
+    int num_levels;        /* number of levels, all coarser than the image */
+                           /* that is being optimized */
+    PyramidLevel levels[PYRAMID_MAX_LEVELS];  /* coarsest level first */
+    int max_slots;         /* memory allocated to the slots of each level */
+    int num_slots;         /* number of slots handed out so far */
+    int *free_slots;       /* slots that have been given back */
+    int num_free;
+    PixelValue *scratch;   /* contributions of a proposed streamline */
+    int scratch_num;
+    int scratch_max;
+
+    void init_level(Lowpass *);
+
+    int new_slot();
+
+    void level_values(int, Streamline *, PixelValue *&, int &, int &);
+public:
+    int rejects;           /* moves turned down at a coarse level */
+    int passes;            /* moves passed on to the fine level */
+
+    LowpassPyramid();
+
+    ~LowpassPyramid();
+
+    int get_levels()
+    { return (num_levels); }
+
+    void add_level(Lowpass *, Bundle *);
+
+    void push_level(Lowpass *, Bundle *);
+
+    void set_target(float);
+
+    void add_line(Streamline *);
+
+    void delete_line(Streamline *);
+
+    double swap_delta(Streamline *, Streamline *);
+
+    double footprint_energy(Streamline *);
+};
+
+#endif /* _PYRAMID_CLASS_ */
+
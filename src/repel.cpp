@@ -32,7 +32,7 @@ warranty of merchantability or fitness for a particular purpose.
 #include "stplace.h"
 #include "repel.h"
 #include "lowpass.h"
-#include "dissolve.h"
+#include "threads.h"
 
 
 /******************************************************************************
@@ -61,33 +61,51 @@ RepelTable::RepelTable(VectorField *vfield, float r)
 
   dist_max = radius * radius;
 
-  /* create a table of cells, which is 2D array of pointers to SamplePoint's */
+  /* create a table of cells, with room for some sample points to start */
 
-  cells = new CellEntry **[x_wrap];
-  for (int i = 0; i < x_wrap; i++) {
-    cells[i] = new CellEntry *[y_wrap];
-    for (int j = 0; j < y_wrap; j++)
-      cells[i][j] = NULL;
-  }
+  max_points = 64;
+  points = new SamplePoint[max_points];
+  point_cells = new int[max_points];
+  sorted = new SamplePoint[max_points];
+  cell_start = new int[x_wrap * y_wrap + 1];
+
+  clear_points();
+
+  /* and an empty table of endpoints */
+
+  max_slots = 64;
+  num_slots = 0;
+  ends = new SamplePoint[2 * max_slots];
+  end_cells = new int[2 * max_slots];
+  end_next = new int[2 * max_slots];
+  end_prev = new int[2 * max_slots];
+  free_slots = new int[max_slots];
+  num_free = 0;
+
+  first_end = new int[x_wrap * y_wrap];
+  for (int i = 0; i < x_wrap * y_wrap; i++)
+    first_end[i] = -1;
+
+  max_changed = 64;
+  changed = new int[max_changed];
+  num_changed = 0;
+
+  max_near = 64;
+  near = new int[max_near];
+  num_near = 0;
+  is_near = new char[max_slots];
 }
 
 
 /******************************************************************************
-Delete the linked list of samples in the cell table.
+Remove all the sample points from the table.  The memory for them is kept
+for the next time the table is filled.
 ******************************************************************************/
 
-void RepelTable::delete_cell_entries()
+void RepelTable::clear_points()
 {
-  for (int i = 0; i < x_wrap; i++)
-    for (int j = 0; j < y_wrap; j++) {
-      CellEntry *cell = cells[i][j];
-      while (cell != NULL) {
-        CellEntry *next = cell->next;
-        delete cell;
-        cell = next;
-      }
-      cells[i][j] = NULL;
-    }
+  num_points = 0;
+  is_sorted = 0;
 }
 
 
@@ -97,17 +115,214 @@ Destroy a table for point repulsion.
 
 RepelTable::~RepelTable()
 {
-  delete_cell_entries();
+  delete[] points;
+  delete[] point_cells;
+  delete[] sorted;
+  delete[] cell_start;
+
+  delete[] ends;
+  delete[] end_cells;
+  delete[] end_next;
+  delete[] end_prev;
+  delete[] free_slots;
+  delete[] first_end;
+  delete[] changed;
+  delete[] near;
+  delete[] is_near;
+}
+
+
+/******************************************************************************
+Add a sample point to the table, if it lies within the table's cells.
+
+Entry:
+  x,y       - position of the sample
+  st        - streamline that the sample is on
+  which_end - HEAD, TAIL or -1 for neither
+******************************************************************************/
+
+void RepelTable::add_point(float x, float y, Streamline *st, int which_end)
+{
+  int a = (int) (x_scale * x);
+  int b = (int) (y_scale * y);
+  if (a < 0 || a >= x_wrap || b < 0 || b >= y_wrap)
+    return;
+
+  /* make more room if need be */
+
+  if (num_points == max_points) {
+    max_points *= 2;
+    SamplePoint *new_points = new SamplePoint[max_points];
+    int *new_cells = new int[max_points];
+    for (int i = 0; i < num_points; i++) {
+      new_points[i] = points[i];
+      new_cells[i] = point_cells[i];
+    }
+    delete[] points;
+    delete[] point_cells;
+    delete[] sorted;
+    points = new_points;
+    point_cells = new_cells;
+    sorted = new SamplePoint[max_points];
+  }
+
+  SamplePoint *s = &points[num_points];
+  s->x = x;
+  s->y = y;
+  s->st = st;
+  s->which_end = which_end;
+  point_cells[num_points] = a * y_wrap + b;
+  num_points++;
+
+  is_sorted = 0;
+}
+
+
+/******************************************************************************
+Sort the sample points by cell, so that the points of each cell lie
+together.  This counts the points in each cell and then places each point
+at the end of what is left of its cell's range.  Each cell's points then
+come out newest first, which is the order in which they used to be found.
+******************************************************************************/
+
+void RepelTable::sort_points()
+{
+  int num_cells = x_wrap * y_wrap;
+  int i;
+
+  for (i = 0; i <= num_cells; i++)
+    cell_start[i] = 0;
+
+  for (i = 0; i < num_points; i++)
+    cell_start[point_cells[i]]++;
+
+  /* find where each cell ends */
+
+  for (i = 1; i <= num_cells; i++)
+    cell_start[i] += cell_start[i - 1];
+
+  /* moving back from the ends leaves each one at the start of its cell */
+
+  for (i = 0; i < num_points; i++)
+    sorted[--cell_start[point_cells[i]]] = points[i];
+
+  is_sorted = 1;
+}
+
+
+/* what the jobs of one step of repulsion share */
+
+class RepelJobs
+{
+public:
+    RepelTable *table;
+    Bundle *bundle;           /* streamlines being repelled */
+    Streamline **new_lines;   /* where each one moves to */
+    float delta;
+    float rmove;
+};
+
+
+/******************************************************************************
+Find how the sample points of other streamlines push a streamline around.
+Only the streamline's own sums are changed, so many streamlines can be
+pushed at once.
+
+Entry:
+  st - streamline to push
+
+Exit:
+  st->xsum,ysum - how far the streamline is pushed
+******************************************************************************/
+
+void RepelTable::push_line(Streamline *st)
+{
+  st->xsum = 0;
+  st->ysum = 0;
+
+  /* look at each sample on the streamline */
+
+  for (int j = 0; j < st->samples; j++) {
+    float x = st->xpts[j];
+    float y = st->ypts[j];
+    int aa = (int) (x_scale * x);
+    int bb = (int) (y_scale * y);
+    int amin = x_wrap + aa - 1;
+    int amax = x_wrap + aa + 1;
+    int bmin = y_wrap + bb - 1;
+    int bmax = y_wrap + bb + 1;
+
+    /* see what the nearby points are */
+
+    SamplePoint *s;
+
+    for (int a = amin; a <= amax; a++)
+      for (int b = bmin; b <= bmax; b++) {
+        int c = (a % x_wrap) * y_wrap + b % y_wrap;
+        for (s = &sorted[cell_start[c]]; s < &sorted[cell_start[c + 1]]; s++) {
+          if (s->st == st)
+            continue;
+          float dx = x - s->x;
+          float dy = y - s->y;
+          float dist = dx * dx + dy * dy;
+          if (dist > dist_max)
+            continue;
+          dist = sqrt(dist);
+          float weight = (radius - dist) / dist;
+          st->xsum += dx * weight;
+          st->ysum += dy * weight;
+        }
+      }
+
+  }
+}
+
+
+/******************************************************************************
+Push one streamline, as a job for parallel_for().
+******************************************************************************/
+
+void RepelTable::push_job(int num, int, void *arg)
+{
+  RepelJobs *jobs = (RepelJobs *) arg;
+
+  jobs->table->push_line(jobs->bundle->get_line(num));
+}
+
+
+/******************************************************************************
+Make the streamline that one streamline moves to after it is pushed, as a
+job for parallel_for().
+******************************************************************************/
+
+void RepelTable::move_job(int num, int, void *arg)
+{
+  RepelJobs *jobs = (RepelJobs *) arg;
+  VectorField *vf = jobs->table->vf;
+
+  Streamline *st = jobs->bundle->get_line(num);
+  float x, y;
+  st->get_origin(x, y);
+  float len = st->get_length();
 
-  for (int i = 0; i < x_wrap; i++)
-    delete cells[i];
+  /* change position based on repulsion */
+  x += st->xsum * jobs->rmove;
+  y += st->ysum * jobs->rmove;
 
-  delete cells;
+  /* clamp to edge of window */
+  if (x < 0) x = 0;
+  if (x > 1) x = 1;
+  if (y < 0) y = 0;
+  if (y > vf->getaspect()) y = vf->getaspect();
+
+  jobs->new_lines[num] = new Streamline(vf, x, y, len, jobs->delta);
 }
 
 
 /******************************************************************************
-Do one step of repulsion.
+Do one step of repulsion.  The sample points of all the streamlines are
+placed in the table, and then the streamlines are pushed apart and followed
+again from their new origins, both spread over the threads.
 
 Exit:
   returns new bundle of streamlines
@@ -115,9 +330,7 @@ Exit:
 
 Bundle *RepelTable::repel(Bundle *bundle, float delta, float rmove)
 {
-  for (int i = 0; i < x_wrap; i++)
-    for (int j = 0; j < y_wrap; j++)
-      cells[i][j] = NULL;
+  clear_points();
 
   Bundle *new_bundle = new Bundle();
 
@@ -128,87 +341,31 @@ Bundle *RepelTable::repel(Bundle *bundle, float delta, float rmove)
     Streamline *st = bundle->get_line(i);
 
     /* place all streamline's points in the table */
-    for (int j = 0; j < st->samples; j++) {
-      SamplePoint *sample = &st->pts[j];
-      CellEntry *cell = new CellEntry(sample);
-      int a = (int) (x_scale * sample->x);
-      int b = (int) (y_scale * sample->y);
-      if (a < 0 || a >= x_wrap || b < 0 || b >= y_wrap)
-        continue;
-      sample->st = st;
-      cell->next = cells[a][b];
-      cells[a][b] = cell;
-    }
+    for (int j = 0; j < st->samples; j++)
+      add_point(st->xpts[j], st->ypts[j], st, -1);
   }
 
-  /* see how each streamline is pushed around */
-
-  for (int i = 0; i < bundle->num_lines; i++) {
-
-    Streamline *st = bundle->get_line(i);
-    st->xsum = 0;
-    st->ysum = 0;
-
-    /* look at each sample on the streamline */
-
-    for (int j = 0; j < st->samples; j++) {
-      SamplePoint *sample = &st->pts[j];
-      float x = sample->x;
-      float y = sample->y;
-      int aa = (int) (x_scale * x);
-      int bb = (int) (y_scale * y);
-      int amin = x_wrap + aa - 1;
-      int amax = x_wrap + aa + 1;
-      int bmin = y_wrap + bb - 1;
-      int bmax = y_wrap + bb + 1;
-
-      /* see what the nearby points are */
-
-      CellEntry *cell;
-      SamplePoint *s;
-
-      for (int a = amin; a <= amax; a++)
-        for (int b = bmin; b <= bmax; b++)
-          for (cell = cells[a % x_wrap][b % y_wrap]; cell != NULL; cell = cell->next) {
-            s = cell->sample;
-            if (s->st == st)
-              continue;
-            float dx = x - s->x;
-            float dy = y - s->y;
-            float dist = dx * dx + dy * dy;
-            if (dist > dist_max)
-              continue;
-            dist = sqrt(dist);
-            float weight = (radius - dist) / dist;
-            st->xsum += dx * weight;
-            st->ysum += dy * weight;
-          }
+  sort_points();
 
-    }
-  }
+  RepelJobs jobs;
+  jobs.table = this;
+  jobs.bundle = bundle;
+  jobs.new_lines = new Streamline *[bundle->num_lines];
+  jobs.delta = delta;
+  jobs.rmove = rmove;
 
-  /* move each streamline */
+  /* see how each streamline is pushed around */
 
-  for (int i = 0; i < bundle->num_lines; i++) {
-    Streamline *st = bundle->get_line(i);
-    float x, y;
-    st->get_origin(x, y);
-    float len = st->get_length();
+  parallel_for(bundle->num_lines, push_job, &jobs);
 
-    /* change position based on repulsion */
-    x += st->xsum * rmove;
-    y += st->ysum * rmove;
+  /* move each streamline, keeping them in the same order */
 
-    /* clamp to edge of window */
-    if (x < 0) x = 0;
-    if (x > 1) x = 1;
-    if (y < 0) y = 0;
-    if (y > vf->getaspect()) y = vf->getaspect();
+  parallel_for(bundle->num_lines, move_job, &jobs);
 
-    Streamline *new_st = new Streamline(vf, x, y, len, delta);
-    new_bundle->add_line(new_st);
-  }
+  for (int i = 0; i < bundle->num_lines; i++)
+    new_bundle->add_line(jobs.new_lines[i]);
 
+  delete[] jobs.new_lines;
 
 #if 0
   for (i = 0; i < bundle->num_lines; i++) {
@@ -233,7 +390,125 @@ Bundle *RepelTable::repel(Bundle *bundle, float delta, float rmove)
 
 
 /******************************************************************************
-Add the endpoints of a streamline to a table.
+Find an unused slot for the endpoints of a streamline.
+
+Exit:
+  returns the slot
+******************************************************************************/
+
+int RepelTable::new_slot()
+{
+  if (num_free > 0)
+    return (free_slots[--num_free]);
+
+  if (num_slots >= max_slots) {
+
+    int new_max = max_slots * 2;
+
+    SamplePoint *new_ends = new SamplePoint[2 * new_max];
+    int *new_cells = new int[2 * new_max];
+    int *new_next = new int[2 * new_max];
+    int *new_prev = new int[2 * new_max];
+    for (int e = 0; e < 2 * max_slots; e++) {
+      new_ends[e] = ends[e];
+      new_cells[e] = end_cells[e];
+      new_next[e] = end_next[e];
+      new_prev[e] = end_prev[e];
+    }
+    delete[] ends;
+    delete[] end_cells;
+    delete[] end_next;
+    delete[] end_prev;
+    ends = new_ends;
+    end_cells = new_cells;
+    end_next = new_next;
+    end_prev = new_prev;
+
+    int *temp = new int[new_max];
+    for (int i = 0; i < num_free; i++)
+      temp[i] = free_slots[i];
+    delete[] free_slots;
+    free_slots = temp;
+
+    char *flags = new char[new_max];
+    for (int i = 0; i < max_slots; i++)
+      flags[i] = is_near[i];
+    delete[] is_near;
+    is_near = flags;
+
+    max_slots = new_max;
+  }
+
+  is_near[num_slots] = 0;
+  return (num_slots++);
+}
+
+
+/******************************************************************************
+Put one end of a streamline into the list of the cell it lies in.
+
+Entry:
+  e         - which end, 2 * slot for the tail or 2 * slot + 1 for the head
+  x,y       - position of the end
+  st        - streamline the end is on
+  which_end - HEAD or TAIL, or -1 to keep the end out of the cells
+******************************************************************************/
+
+void RepelTable::link_end(int e, float x, float y, Streamline *st,
+                          int which_end)
+{
+  ends[e].x = x;
+  ends[e].y = y;
+  ends[e].st = st;
+  ends[e].which_end = which_end;
+  end_cells[e] = -1;
+
+  int a = (int) (x_scale * x);
+  int b = (int) (y_scale * y);
+  if (which_end < 0 || a < 0 || a >= x_wrap || b < 0 || b >= y_wrap)
+    return;
+
+  /* newest first in each cell */
+
+  int c = a * y_wrap + b;
+  end_cells[e] = c;
+  end_prev[e] = -1;
+  end_next[e] = first_end[c];
+  if (first_end[c] >= 0)
+    end_prev[first_end[c]] = e;
+  first_end[c] = e;
+}
+
+
+/******************************************************************************
+Take one end of a streamline out of its cell's list.
+
+Entry:
+  e - which end
+******************************************************************************/
+
+void RepelTable::unlink_end(int e)
+{
+  int c = end_cells[e];
+
+  if (c >= 0) {
+    if (end_prev[e] >= 0)
+      end_next[end_prev[e]] = end_next[e];
+    else
+      first_end[c] = end_next[e];
+    if (end_next[e] >= 0)
+      end_prev[end_next[e]] = end_prev[e];
+  }
+
+  end_cells[e] = -1;
+  ends[e].st = NULL;
+}
+
+
+/******************************************************************************
+Add the endpoints of a streamline to a table.  They stay there until the
+streamline is removed with remove_endpoints(), so the table only needs to
+be told about the streamlines that change.
 
 Entry:
   st - streamline whose endpoints we should add
@@ -243,45 +518,36 @@ Entry:
 
 void RepelTable::add_endpoints(Streamline *st, int head, int tail)
 {
-  int a, b;
-  SamplePoint *sample;
-  CellEntry *cell;
-
-  /* first point */
+  float x, y;
 
-  if (tail) {
+  if (st->join_slot >= 0)
+    remove_endpoints(st);
 
-    sample = &st->pts[0];
-    cell = new CellEntry(sample);
+  int s = new_slot();
+  st->join_slot = s;
 
-    a = (int) (x_scale * sample->x);
-    b = (int) (y_scale * sample->y);
-    if (a >= 0 && a < x_wrap && b >= 0 && b < y_wrap) {
-      sample->st = st;
-      sample->which_end = TAIL;
-      cell->next = cells[a][b];
-      cells[a][b] = cell;
-    }
+  /* first point */
 
-  }
+  st->get_tail(x, y);
+  link_end(2 * s, x, y, st, tail ? TAIL : -1);
 
   /* last point */
 
-  if (head) {
+  st->get_head(x, y);
+  link_end(2 * s + 1, x, y, st, head ? HEAD : -1);
 
-    sample = &st->pts[st->samples - 1];
-    cell = new CellEntry(sample);
-
-    a = (int) (x_scale * sample->x);
-    b = (int) (y_scale * sample->y);
-    if (a >= 0 && a < x_wrap && b >= 0 && b < y_wrap) {
-      sample->st = st;
-      sample->which_end = HEAD;
-      cell->next = cells[a][b];
-      cells[a][b] = cell;
-    }
+  /* remember to look for joins at these ends */
 
+  if (num_changed == max_changed) {
+    max_changed *= 2;
+    int *temp = new int[max_changed];
+    for (int i = 0; i < num_changed; i++)
+      temp[i] = changed[i];
+    delete[] changed;
+    changed = temp;
   }
+
+  changed[num_changed++] = s;
 }
 
 
@@ -298,25 +564,14 @@ void RepelTable::add_all_points(Streamline *st)
 
   for (int i = 0; i < st->samples; i++) {
 
-    SamplePoint *sample = &st->pts[i];
-    CellEntry *cell = new CellEntry(sample);
+    /* label the sample as head, tail or other */
+    int which_end = -1;
+    if (i == 0)
+      which_end = TAIL;
+    else if (i == st->samples - 1)
+      which_end = HEAD;
 
-    int a = (int) (x_scale * sample->x);
-    int b = (int) (y_scale * sample->y);
-    if (a >= 0 && a < x_wrap && b >= 0 && b < y_wrap) {
-      sample->st = st;
-
-      /* label the sample as head, tail or other */
-      if (i == 0)
-        sample->which_end = TAIL;
-      else if (i == st->samples - 1)
-        sample->which_end = HEAD;
-      else
-        sample->which_end = -1;
-
-      cell->next = cells[a][b];
-      cells[a][b] = cell;
-    }
+    add_point(st->xpts[i], st->ypts[i], st, which_end);
   }
 }
 
@@ -330,6 +585,16 @@ Entry:
 
 void RepelTable::remove_endpoints(Streamline *st)
 {
+  int s = st->join_slot;
+
+  if (s < 0)
+    return;
+
+  unlink_end(2 * s);
+  unlink_end(2 * s + 1);
+
+  free_slots[num_free++] = s;
+  st->join_slot = -1;
 }
 
 
@@ -340,44 +605,179 @@ Entry:
   x,y - given position
 
 Exit:
-  returns pointer to the nearest sample, or NULL if none found
+  returns pointer to the nearest sample, or NULL if the table is empty
 ******************************************************************************/
 
 SamplePoint *RepelTable::find_nearest(float x, float y)
 {
-  float minimum = 1e20;  /* minimum distance so far */
-  SamplePoint *closest = NULL;
+  SamplePoint *closest;
+
+  if (find_nearest(x, y, 1, NEAREST_ANY, NULL, -1, 0, &closest) == 0)
+    return (NULL);
+
+  return (closest);
+}
+
+
+/******************************************************************************
+Find the sample points in a table nearest to a given position.  The cells
+are searched in square rings around the position's cell, moving outward
+until no point in the rings that are left could be nearer than the ones
+already found, so the answer is exact however far away the points are.
+
+Entry:
+  x,y       - given position
+  k         - most points to find
+  max_dist  - farthest a point may be, or NEAREST_ANY
+  skip      - streamline whose points to pass over, or NULL
+  which_end - HEAD or TAIL to find only those ends, or -1 for any point
+  unfrozen  - 1 to pass over the points of frozen streamlines, 0 not to
+
+Exit:
+  found    - the points found, nearest first
+  returns how many were found
+******************************************************************************/
+
+int RepelTable::find_nearest(
+        float x,
+        float y,
+        int k,
+        float max_dist,
+        Streamline *skip,
+        int which_end,
+        int unfrozen,
+        SamplePoint **found
+)
+{
+  int num = 0;
+
+  if (!is_sorted)
+    sort_points();
+
+  float cell = 1.0 / x_scale;   /* width of a cell */
+
+  /* cell of the position, or the nearest one if it is off the edge */
 
   int aa = (int) (x_scale * x);
   int bb = (int) (y_scale * y);
-  int amin = x_wrap + aa - 1;
-  int amax = x_wrap + aa + 1;
-  int bmin = y_wrap + bb - 1;
-  int bmax = y_wrap + bb + 1;
+  if (aa < 0) aa = 0;
+  if (aa >= x_wrap) aa = x_wrap - 1;
+  if (bb < 0) bb = 0;
+  if (bb >= y_wrap) bb = y_wrap - 1;
 
-  SamplePoint *s;
-  CellEntry *cell;
+  int rings = (x_wrap > y_wrap) ? x_wrap : y_wrap;
 
-  for (int a = amin; a <= amax; a++)
-    for (int b = bmin; b <= bmax; b++)
-      for (cell = cells[a % x_wrap][b % y_wrap]; cell != NULL; cell = cell->next) {
+  for (int r = 0; r < rings; r++) {
 
-        s = cell->sample;
+    /* look at the cells of this ring that are in the table */
 
-        float dx = x - s->x;
-        float dy = y - s->y;
-        float dist = dx * dx + dy * dy;
+    for (int b = bb - r; b <= bb + r; b++) {
+      if (b < 0 || b >= y_wrap)
+        continue;
+      int step = (b == bb - r || b == bb + r) ? 1 : 2 * r;
+      for (int a = aa - r; a <= aa + r; a += step)
+        if (a >= 0 && a < x_wrap)
+          search_cell(a * y_wrap + b, x, y, k, max_dist, skip, which_end,
+                      unfrozen, found, num);
+    }
 
-        /* closer than previous samples? */
+    /* any points beyond this ring are at least this far away */
 
-        if (dist < minimum) {
-          minimum = dist;
-          closest = s;
-        }
-      }
+    float reach = r * cell;
 
-  /* return the closest sample */
-  return (closest);
+    if (reach > max_dist)
+      break;
+
+    if (num == k) {
+      float dx = x - found[k - 1]->x;
+      float dy = y - found[k - 1]->y;
+      if (reach * reach >= dx * dx + dy * dy)
+        break;
+    }
+  }
+
+  return (num);
+}
+
+
+/******************************************************************************
+Look through the points of one cell for those nearer to a position than the
+ones found so far.
+
+Entry:
+  c         - which cell
+  x,y       - given position
+  k         - most points to find
+  max_dist  - farthest a point may be
+  skip      - streamline whose points to pass over, or NULL
+  which_end - HEAD or TAIL to find only those ends, or -1 for any point
+  unfrozen  - 1 to pass over the points of frozen streamlines, 0 not to
+  found     - the points found so far, nearest first
+  num       - how many of them there are
+
+Exit:
+  found,num - updated
+******************************************************************************/
+
+void RepelTable::search_cell(
+        int c,
+        float x,
+        float y,
+        int k,
+        float max_dist,
+        Streamline *skip,
+        int which_end,
+        int unfrozen,
+        SamplePoint **found,
+        int &num
+)
+{
+  SamplePoint *s = &sorted[cell_start[c]];
+  SamplePoint *s_end = &sorted[cell_start[c + 1]];
+  int e = first_end[c];
+
+  /* the endpoints are kept apart from the other points */
+
+  while (1) {
+
+    SamplePoint *p;
+    if (s < s_end)
+      p = s++;
+    else if (e >= 0) {
+      p = &ends[e];
+      e = end_next[e];
+    }
+    else
+      break;
+
+    if (p->st == skip)
+      continue;
+    if (which_end >= 0 && p->which_end != which_end)
+      continue;
+    if (unfrozen && p->st->frozen)
+      continue;
+
+    float dx = x - p->x;
+    float dy = y - p->y;
+    float dist = dx * dx + dy * dy;
+    if (dist > max_dist * max_dist)
+      continue;
+
+    /* insert the point in order, dropping the farthest if need be */
+
+    int i = (num < k) ? num++ : k;
+    while (i > 0) {
+      float fx = x - found[i - 1]->x;
+      float fy = y - found[i - 1]->y;
+      if (fx * fx + fy * fy <= dist)
+        break;
+      if (i < k)
+        found[i] = found[i - 1];
+      i--;
+    }
+    if (i < k)
+      found[i] = p;
+  }
 }
 
 #if 0
@@ -417,8 +817,8 @@ void RepelTable::find_new_centers(
   /* start at one end of the new streamline and follow along */
   /* half of st1's length */
 
-  x = new_st->pts[0].x;
-  y = new_st->pts[0].y;
+  x = new_st->xpts[0];
+  y = new_st->ypts[0];
 
   len = 0.5 * st1->get_length();
   steps = (int) (len / delta);
@@ -432,8 +832,8 @@ void RepelTable::find_new_centers(
 
   /* start at the other end of the new streamline */
 
-  x = new_st->pts[new_st->samples-1].x;
-  y = new_st->pts[new_st->samples-1].y;
+  x = new_st->xpts[new_st->samples-1];
+  y = new_st->ypts[new_st->samples-1];
 
   len = 0.5 * st2->get_length();
   steps = (int) (len / delta);
@@ -518,11 +918,58 @@ void RepelTable::find_new_centers(
 
 
 /******************************************************************************
-See which streamlines have endpoints that maybe should be joined.
+Look for a streamline whose end is near enough to one of the ends of a given
+streamline that they maybe should be joined.
 
 Entry:
-  bundle      - bundle of streamlines to check
-  win         - window to draw streamlines into (usually for debugging)
+  st - streamline whose ends to look near
+
+Exit:
+  end   - the end of st that is near another
+  other - the other streamline's end
+  returns 1 if one was found, 0 if not
+******************************************************************************/
+
+int RepelTable::find_join(Streamline *st, SamplePoint &end,
+                          SamplePoint *&other)
+{
+  /* skip frozen streamlines */
+  if (st->frozen)
+    return (0);
+
+  /* look at both ends of the streamline */
+
+  for (int j = 0; j < 2; j++) {
+
+    /* look at front or back end of streamline (the end may not be */
+    /* in the table, so label it here) */
+    if (j == 0) {
+      st->get_tail(end.x, end.y);
+      end.which_end = TAIL;
+    } else {
+      st->get_head(end.x, end.y);
+      end.which_end = HEAD;
+    }
+    end.st = st;
+
+    /* find the nearest end of the other kind on another streamline, */
+    /* not joining to a frozen streamline */
+
+    int other_end = (end.which_end == HEAD) ? TAIL : HEAD;
+
+    if (find_nearest(end.x, end.y, 1, radius, st, other_end, 1, &other))
+      return (1);
+  }
+
+  return (0);
+}
+
+
+/******************************************************************************
+Try joining a streamline to another whose end is near one of its own.
+
+Entry:
+  st          - streamline whose ends to look near
   vf          - vector field we're visualizing
   low         - lowpass filtered version of streamlines
   quality     - current quality
@@ -531,241 +978,226 @@ Entry:
 
 Exit:
   quality - updated quality
-  returns 1 if it joined streamlines, 0 if not
+  returns 1 if it joined streamlines, 0 if it tried to and didn't, or -1 if
+  there was nothing near enough to try
 ******************************************************************************/
 
-int RepelTable::identify_neighbors(
-        Bundle *bundle,
-        Window2d *win,
+int RepelTable::join_ends(
+        Streamline *st,
         VectorField *vf,
         Lowpass *low,
-        float &quality,
+        double &quality,
         float delta,
         int debug_print
 )
 {
-  int a, b;
   float len1, len2;
-  int num_tries = 0;  /* number of attempts to join two streamlines */
   int orientation;
+  SamplePoint end;
+  SamplePoint *s;
 
-  /* clear out the cell entry table */
+  if (!find_join(st, end, s))
+    return (-1);
 
-  delete_cell_entries();
+  Streamline *st2 = s->st;
+  float x = end.x;
+  float y = end.y;
 
-  /* place all streamline endpoints in the table */
+  /* draw a link between the ends */
+  // win->set_color_index (RED);
+  // win->line (x, y, s->x, s->y);
 
-#if 1
-  /* do this in a random order */
-  Dissolve rand_seq(bundle->num_lines, 1);
-  rand_seq.set_initial_value((int) (bundle->num_lines * drand48()));
-  for (int i = 0; i < bundle->num_lines; i++) {
-    int j = rand_seq.next_value();
-    if (j < bundle->num_lines)
-      add_endpoints(bundle->get_line(j), 1, 1);
+  /* delete the two streamlines and create a new one */
+
+  float len_a, len_b;
+  st->get_lengths(len_a, len_b);
+  len1 = len_a + len_b;
+  st2->get_lengths(len_a, len_b);
+  len2 = len_a + len_b;
+
+  /* weighted average of position, based on streamline lengths */
+  float x_mid = (len1 * x + len2 * s->x) / (len1 + len2);
+  float y_mid = (len1 * y + len2 * s->y) / (len1 + len2);
+  clamp_to_screen(x_mid, y_mid, vf->getaspect());
+
+  if (debug_print) {
+    printf("line 1: x,y = %f %f\n", x, y);
+    st->get_lengths(len_a, len_b);
+    printf("len1 len2: %f %f\n", len_a, len_b);
+    printf("\n");
+
+    printf("line 2: x,y = %f %f\n", s->x, s->y);
+    st2->get_lengths(len_a, len_b);
+    printf("len1 len2: %f %f\n", len_a, len_b);
+    printf("\n");
   }
-#endif
 
-#if 0
-  for (int i = 0; i < bundle->num_lines; i++)
-    add_endpoints (bundle->get_line(i), 1, 1);
-#endif
+  /* determine lengths for new streamline */
+  if (s->which_end == HEAD) {
+    len1 = st->get_length();
+    len2 = st2->get_length();
+    orientation = 1;
+  } else {
+    len2 = st->get_length();
+    len1 = st2->get_length();
+    orientation = 2;
+  }
 
-  /* see which streamlines are near enough to be joined */
+  /* delete old streamlines */
+  low->delete_line(st);
+  low->delete_line(st2);
+  double delete_quality = low->current_quality();
 
-  Dissolve rand_seq2(bundle->num_lines, 1);
-  rand_seq2.set_initial_value((int) (bundle->num_lines * drand48()));
+  /* create new streamline */
 
-  for (int i = 0; i < bundle->num_lines; i++) {
+  Streamline *new_st = new Streamline(vf, x_mid, y_mid, len1, len2, delta);
 
-    int k = rand_seq2.next_value();
-    if (k >= bundle->num_lines)
-      continue;
+  if (debug_print) {
+    printf("new line: x,y = %f %f\n", x_mid, y_mid);
+    printf("len1 len2: %f %f\n", len1, len2);
+    printf("\n");
+  }
 
-    Streamline *st = bundle->get_line(k);
+  double new_quality = low->new_quality(new_st);
 
-    /* skip frozen streamlines */
-    if (st->frozen)
-      continue;
+  /* if the join doesn't make the quality too bad, accept it */
+
+  float ratio = 0.25;
+  double diff1 = new_quality - quality;
+  double diff2 = delete_quality - quality;
 
-    /* look at both ends of the streamline */
+  if (new_quality < quality || diff1 < ratio * diff2) {
 
-    for (int j = 0; j < 2; j++) {
+    quality = new_quality;
 
-      SamplePoint *sample;
+    /* maybe write to animation file */
+    if (animation_flag) {
 
-      /* look at front or back end of streamline */
-      if (j == 0)
-        sample = &st->pts[0];
+      float x1, y1, x2, y2;
+
+      if (orientation == 1)
+        find_new_centers(st2, st, new_st, delta, x2, y2, x1, y1);
       else
-        sample = &st->pts[st->samples - 1];
-
-      /* find out location and cell */
-      float x = sample->x;
-      float y = sample->y;
-      int aa = (int) (x_scale * x);
-      int bb = (int) (y_scale * y);
-      int amin = x_wrap + aa - 1;
-      int amax = x_wrap + aa + 1;
-      int bmin = y_wrap + bb - 1;
-      int bmax = y_wrap + bb + 1;
-
-      /* see what the nearby points are */
-
-      SamplePoint *s;
-      CellEntry *cell;
-
-      for (int a = amin; a <= amax; a++)
-        for (int b = bmin; b <= bmax; b++)
-          for (cell = cells[a % x_wrap][b % y_wrap]; cell != NULL; cell = cell->next) {
-
-            s = cell->sample;
-            Streamline *st2 = s->st;
-
-            /* don't join streamline to itself */
-            if (st2 == st)
-              continue;
-            /* don't join to a frozen streamline */
-            if (st2->frozen)
-              continue;
-            /* make sure the ends match (head to tail) */
-            if (s->which_end == sample->which_end)
-              continue;
-
-            float dx = x - s->x;
-            float dy = y - s->y;
-            float dist = dx * dx + dy * dy;
-            if (dist > dist_max)
-              continue;
-
-            /* draw a link between the ends */
-            // win->set_color_index (RED);
-            // win->line (x, y, s->x, s->y);
-
-            /* delete the two streamlines and create a new one */
-
-            float len_a, len_b;
-            st->get_lengths(len_a, len_b);
-            len1 = len_a + len_b;
-            st2->get_lengths(len_a, len_b);
-            len2 = len_a + len_b;
-
-            /* weighted average of position, based on streamline lengths */
-            float x_mid = (len1 * x + len2 * s->x) / (len1 + len2);
-            float y_mid = (len1 * y + len2 * s->y) / (len1 + len2);
-            clamp_to_screen(x_mid, y_mid, vf->getaspect());
-
-            if (debug_print) {
-              printf("line 1: x,y = %f %f\n", x, y);
-              st->get_lengths(len_a, len_b);
-              printf("len1 len2: %f %f\n", len_a, len_b);
-              printf("\n");
-
-              printf("line 2: x,y = %f %f\n", s->x, s->y);
-              st2->get_lengths(len_a, len_b);
-              printf("len1 len2: %f %f\n", len_a, len_b);
-              printf("\n");
-            }
-
-            /* determine lengths for new streamline */
-            if (s->which_end == HEAD) {
-              len1 = st->get_length();
-              len2 = st2->get_length();
-              orientation = 1;
-            } else {
-              len2 = st->get_length();
-              len1 = st2->get_length();
-              orientation = 2;
-            }
-
-            /* delete old streamlines */
-            low->delete_line(st);
-            low->delete_line(st2);
-            float delete_quality = low->current_quality();
-
-            /* create new streamline */
-
-            Streamline *new_st = new Streamline(vf, x_mid, y_mid,
-                                                len1, len2, delta);
-
-            if (debug_print) {
-              printf("new line: x,y = %f %f\n", x_mid, y_mid);
-              printf("len1 len2: %f %f\n", len1, len2);
-              printf("\n");
-            }
-
-            float new_quality = low->new_quality(new_st);
-            num_tries++;
-
-            /* if the join doesn't make the quality too bad, accept it */
-
-            float ratio = 0.25;
-            float diff1 = new_quality - quality;
-            float diff2 = delete_quality - quality;
-
-            if (new_quality < quality || diff1 < ratio * diff2) {
-
-              quality = new_quality;
-
-              /* maybe write to animation file */
-              if (animation_flag) {
-
-                float x1, y1, x2, y2;
-
-                if (orientation == 1)
-                  find_new_centers(st2, st, new_st, delta, x2, y2, x1, y1);
-                else
-                  find_new_centers(st, st2, new_st, delta, x1, y1, x2, y2);
-
-                new_st->anim_index = anim_index++;
-
-                float cx = new_st->xorig;
-                float cy = new_st->yorig;
-                *anim_file << "join " << st->anim_index << " "
-                           << x1 << " " << y1 << " "
-                           << st2->anim_index << " "
-                           << x2 << " " << y2 << " "
-                           << new_st->anim_index << " "
-                           << cx << " " << cy << " "
-                           << (len1 + len2)
-                           << endl;
-              }
-
-              /* finish deleting the old streamlines */
-              remove_streamline(st);
-              remove_streamline(st2);
-              delete st;
-              delete st2;
-
-              /* add streamline to the lowpass image */
-              low->add_line(new_st);
-              add_streamline(new_st);
-
-              if (num_tries > 2)
-                printf("tried %d times to join streamlines\n", num_tries);
-
-              /* signal that we joined streamlines */
-              return (1);
-            } else {   /* otherwise revert to previous state */
-
-              /* add back the old streamlines */
-
-              quality = low->new_quality(st);
-              low->add_line(st);
-
-              quality = low->new_quality(st2);
-              low->add_line(st2);
-
-              return (0);
-            }
-          }
+        find_new_centers(st, st2, new_st, delta, x1, y1, x2, y2);
+
+      new_st->anim_index = anim_index++;
+
+      float cx = new_st->xorig;
+      float cy = new_st->yorig;
+      *anim_file << "join " << st->anim_index << " "
+                 << x1 << " " << y1 << " "
+                 << st2->anim_index << " "
+                 << x2 << " " << y2 << " "
+                 << new_st->anim_index << " "
+                 << cx << " " << cy << " "
+                 << (len1 + len2)
+                 << endl;
     }
+
+    /* finish deleting the old streamlines */
+    remove_streamline(st);
+    remove_streamline(st2);
+    delete st;
+    delete st2;
+
+    /* add streamline to the lowpass image */
+    low->add_line(new_st);
+    add_streamline(new_st);
+
+    /* signal that we joined streamlines */
+    return (1);
+  } else {   /* otherwise revert to previous state */
+
+    delete new_st;
+
+    /* add back the old streamlines */
+
+    quality = low->new_quality(st);
+    low->add_line(st);
+
+    quality = low->new_quality(st2);
+    low->add_line(st2);
+
+    return (0);
   }
+}
+
 
-  if (num_tries > 2)
-    printf("tried %d times to join streamlines\n", num_tries);
+/******************************************************************************
+See which streamlines have endpoints that maybe should be joined.  The table
+keeps a list of the streamlines with an end near another's, which only the
+streamlines added since the last look can join, and one from the list is
+picked at random to try joining each time.
+
+Entry:
+  win         - window to draw streamlines into (usually for debugging)
+  vf          - vector field we're visualizing
+  low         - lowpass filtered version of streamlines
+  quality     - current quality
+  delta       - spacing between samples for new streamline
+  debug_print - flag for debugging
+
+Exit:
+  quality - updated quality
+  returns 1 if it joined streamlines, 0 if not
+******************************************************************************/
+
+int RepelTable::identify_neighbors(
+        Window2d *win,
+        VectorField *vf,
+        Lowpass *low,
+        double &quality,
+        float delta,
+        int debug_print
+)
+{
+  int slot;
+  SamplePoint end;
+  SamplePoint *other;
+
+  /* see which of the new streamlines have ends near others */
+
+  while (num_changed > 0) {
+
+    slot = changed[--num_changed];
+    Streamline *st = ends[2 * slot].st;
+
+    if (st == NULL || is_near[slot] || !find_join(st, end, other))
+      continue;
+
+    if (num_near == max_near) {
+      max_near *= 2;
+      int *temp = new int[max_near];
+      for (int i = 0; i < num_near; i++)
+        temp[i] = near[i];
+      delete[] near;
+      near = temp;
+    }
+
+    near[num_near++] = slot;
+    is_near[slot] = 1;
+  }
+
+  /* try one of them, forgetting those that have since been removed or */
+  /* have had the streamlines near them move away */
+
+  while (num_near > 0) {
+
+    int k = (int) (num_near * drand48());
+    slot = near[k];
+    Streamline *st = ends[2 * slot].st;
+
+    int result = -1;
+    if (st)
+      result = join_ends(st, vf, low, quality, delta, debug_print);
+
+    if (result >= 0)
+      return (result);
+
+    near[k] = near[--num_near];
+    is_near[slot] = 0;
+  }
 
   /* if we get here, we didn't join any streamlines */
   return (0);
 }
-
@@ -23,36 +23,73 @@ warranty of merchantability or fitness for a particular purpose.
 #ifndef _REPEL_CLASS_
 #define _REPEL_CLASS_
 
-class CellEntry
-{
-    SamplePoint *sample;
-    CellEntry *next;
-public:
-    CellEntry(SamplePoint *s)
-    {
-      sample = s;
-      next = NULL;
-    }
-
-    friend class RepelTable;
-};
+#define NEAREST_ANY  1e20   /* no limit on how far find_nearest() looks */
 
+/* The sample points are kept sorted by cell, with the points of each cell */
+/* next to one another, so the table is rebuilt by counting how many points */
+/* fall in each cell rather than by making a list entry for each point. */
 
 class RepelTable
 {
     float radius;
     float x_scale, y_scale;
     float dist_max;
-    CellEntry ***cells;    /* 2D array of pointers to SamplePoint's */
     int x_wrap;            /* number of cells in x */
     int y_wrap;            /* number of cells in y */
     VectorField *vf;
+
+    SamplePoint *points;   /* sample points in the order they were added */
+    int *point_cells;      /* which cell each of these is in */
+    SamplePoint *sorted;   /* the same points, sorted by cell */
+    int num_points;
+    int max_points;
+    int *cell_start;       /* where each cell's points start in sorted, */
+                           /* with one more entry for the end of the last */
+    int is_sorted;         /* have the points been sorted since the last */
+                           /* one was added? */
+
+    /* endpoints are kept up to date as streamlines come and go instead; */
+    /* slot s holds the tail of a streamline at 2s and its head at 2s+1 */
+
+    SamplePoint *ends;
+    int *end_cells;        /* which cell each end is in, or -1 if none */
+    int *end_next;         /* next end in the same cell, or -1 */
+    int *end_prev;         /* previous end in the same cell, or -1 */
+    int *first_end;        /* first end in each cell, or -1 */
+    int max_slots;         /* memory allocated to the slots */
+    int num_slots;         /* number of slots handed out so far */
+    int *free_slots;       /* slots that have been given back */
+    int num_free;
+    int *changed;          /* slots filled since joins were last looked for */
+    int num_changed;
+    int max_changed;
+    int *near;             /* slots whose streamlines had an end near enough */
+    int num_near;          /* to another to join, but the join was turned */
+    int max_near;          /* down */
+    char *is_near;         /* whether each slot is in the above list */
+
+    void add_point(float, float, Streamline *, int);
+    void sort_points();
+
+    void push_line(Streamline *);
+    void search_cell(int, float, float, int, float, Streamline *, int, int,
+                     SamplePoint **, int &);
+    static void push_job(int, int, void *);
+    static void move_job(int, int, void *);
+
+    int new_slot();
+    void link_end(int, float, float, Streamline *, int);
+    void unlink_end(int);
+
+    int find_join(Streamline *, SamplePoint &, SamplePoint *&);
+    int join_ends(Streamline *, VectorField *, Lowpass *, double &, float,
+                  int);
 public:
     RepelTable(VectorField *, float);
 
     ~RepelTable();
 
-    void delete_cell_entries();
+    void clear_points();
 
     void add_endpoints(Streamline *, int, int);
 
@@ -63,18 +100,17 @@ public:
     Bundle *repel(Bundle *, float, float);
 
     SamplePoint *find_nearest(float, float);
+    int find_nearest(float, float, int, float, Streamline *, int, int,
+                     SamplePoint **);
 
-    int identify_neighbors(Bundle *, Window2d *, VectorField *,
-                           Lowpass *, float &, float, int);
+    int identify_neighbors(Window2d *, VectorField *, Lowpass *, double &,
+                           float, int);
 
     void find_new_centers(Streamline *, Streamline *, Streamline *, float,
                           float &, float &, float &, float &);
 
     friend class Streamline;
-
-    friend class CellEntry;
 };
 
 
 #endif /* _REPEL_CLASS_ */
-
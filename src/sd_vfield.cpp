@@ -27,146 +27,137 @@ warranty of merchantability or fitness for a particular purpose.
 #include <unistd.h>
 #include <fcntl.h>
 #include <cstring>
-#include <bitset>
-#include <iomanip>
 #include "window.h"
 #include "floatimage.h"
 #include "sd_vfield.h"
-#include "HalfFloat.h"
-#include "MiniFloat2.h"
+#include "vecfile.h"
 
 static int integrator = MIDPOINT;
 
 
 /******************************************************************************
-Create a new vector field by reading in a file.
+Create a new vector field by reading in a file, in whichever encoding the
+file says its vectors are stored.  The vectors of a tiled file are all
+gathered into memory.
 ******************************************************************************/
 
 VectorField::VectorField(char *filename)
 {
-  int index = 0;
-  int done = 0;
-  int linefeeds = 0;
-  int zsize;
-  int rank;
+  read_file(filename, 0);
+}
 
-  /* append ".vec" to the file name if necesary */
 
-  char name[80];
-  strcpy(name, filename);
-  if (strlen(name) < 4 || strcmp(name + strlen(name) - 4, ".vec") != 0)
-    strcat(name, ".vec");
+/******************************************************************************
+Create a new vector field from one frame of a file that holds a field that
+changes over time.
 
-  std::ifstream infile(name, std::ios::in);
+Entry:
+  filename - name of the file, to which ".vec" is added if it is missing
+  frame    - which frame to read, counting from 0
+******************************************************************************/
 
-  if (!infile) {
-    fprintf(stderr, "Error openning '%s'\n", name);
-    exit(-1);
-  }
+VectorField::VectorField(char *filename, int frame)
+{
+  read_file(filename, frame);
+}
 
-  printf("reading %s\n", filename);
 
-  char *str = new char[80];
+/******************************************************************************
+Read one frame of a vector field from a file, for the constructors.
+******************************************************************************/
 
-  while (!done) {
-    infile.get(str[index]);
-    if (str[index] == '\n')
-      linefeeds++;
-    if (linefeeds == 3 || index >= 100)
-      done = 1;
-    index++;
-  }
-  str[index] = '\0';
+void VectorField::read_file(char *filename, int frame)
+{
+  /* append ".vec" to the file name if necesary */
 
-  if (index >= 100) {
-    fprintf(stderr, "Header bad in file.\n");
+  char *name = vec_file_name(filename);
+
+  VecFile file;
+  if (!open_vec_file(name, file) || !vec_frame(file, frame))
     exit(-1);
-  }
 
-  sscanf(str, "VF\n%d %d %d\n%d\n", &xsize, &ysize, &zsize, &rank);
+  if (file.zsize > 1)
+    printf("reading %s, frame %d of %d\n", filename, frame, file.zsize);
+  else
+    printf("reading %s\n", filename);
+
+  xsize = file.xsize;
+  ysize = file.ysize;
   aspect = ysize / (float) xsize;
   aspect_recip = 1.0f / aspect;
 
-//  cout << "size: " << xsize << " " << ysize << endl;
+  size_t count = (size_t) xsize * ysize * 2;
+  int tile = file.tile;
+  int side = tile + 1;
 
-  values = new float[xsize * ysize * 2];
-  //float_read(infile);
-  minifloat_read(infile);
+  if (xsize < 2 || ysize < 2 || file.data_bytes < vec_frame_bytes(file)) {
+    fprintf(stderr, "File '%s' is too short for a %d by %d field.\n",
+            name, xsize, ysize);
+    exit(-1);
+  }
 
-  infile.close();
-}
+  delete[] name;
 
+  values = new float[count];
 
-void VectorField::float_read(std::ifstream &infile)
-{
-  union
-  {
-      float f;
-      uint32_t i;
-  } u;
-
-  infile.read((char *) values, xsize * ysize * 2 * sizeof(float));
-
-  for (int i = 0; i < xsize * ysize * 2; ++i) {
-    u.f = values[i];
-    std::bitset<32> y(u.i);
-    std::cout << y << "    " << u.f << "\n";
-  }
-}
+  if (tile == 0)
+    vec_decode(file.encoding, file.data, values, count);
+  else {
 
-void VectorField::minifloat_read(std::ifstream &ifstream)
-{
-  auto tmp_values = new uint8_t[xsize * ysize * 2];
-  ifstream.read((char *) tmp_values, xsize * ysize * 2 * sizeof(uint8_t));
-
-  for (int i = 0; i < xsize * ysize * 2; ++i) {
-    values[i] = mini_to_float(tmp_values[i]);
-    std::bitset<8> y(tmp_values[i]);
-    std::cout << y << "    0x" << std::hex << std::setw(2) << static_cast<int>( tmp_values[i]) << "  " << values[i]
-              << "\n";
+    /* decode each tile and copy the vectors it holds into place */
+
+    size_t tile_count = (size_t) side * side * 2;
+    size_t tile_bytes = tile_count * vec_encoding_size(file.encoding);
+    float *block = new float[tile_count];
+    int t = 0;
+
+    for (int tj = 0; tj < vec_tiles(ysize, tile); tj++)
+      for (int ti = 0; ti < vec_tiles(xsize, tile); ti++, t++) {
+        vec_decode(file.encoding, file.data + t * tile_bytes, block,
+                   tile_count);
+        for (int j = 0; j < side && tj * tile + j < ysize; j++)
+          for (int i = 0; i < side && ti * tile + i < xsize; i++) {
+            int index = (tj * tile + j) * xsize + ti * tile + i;
+            values[2 * index] = block[2 * (j * side + i)];
+            values[2 * index + 1] = block[2 * (j * side + i) + 1];
+          }
+      }
+
+    delete[] block;
   }
 
+  close_vec_file(file);
 }
 
+
 /******************************************************************************
 Write the vector field to a file.
+
+Entry:
+  filename - name of the file, to which ".vec" is added if it is missing
+  encoding - how to store the vectors (VEC_F32, VEC_F16 or VEC_F8)
 ******************************************************************************/
 
-void VectorField::write_file(char *filename)
+void VectorField::write_file(char *filename, int encoding)
 {
-  int zsize = 1;
-  int rank = 2;
-
   /* append ".vec" to the file name if necesary */
 
-  char name[80];
-  strcpy(name, filename);
-  if (strlen(name) < 4 || strcmp(name + strlen(name) - 4, ".vec") != 0)
-    strcat(name, ".vec");
+  char *name = vec_file_name(filename);
 
-  int fd = open(name, O_CREAT | O_TRUNC | O_WRONLY, 0666);
-  if (fd < 0) {
-    fprintf(stderr, "Unable to open %s: %s\n", name, strerror(errno));
+  if (!write_vec_file(name, xsize, ysize, values, encoding))
     exit(-1);
-  }
 
-  char str[80];
-  sprintf(str, "VF\n%d %d %d\n%d\n", xsize, ysize, zsize, rank);
-  int cc = write(fd, str, strlen(str));
-  if (cc == -1) {
-    fprintf(stderr, "Can't write to file.\n");
-    exit(-1);
-  }
+  delete[] name;
+}
 
-  cc = write(fd, (char *) values, sizeof(float) * xsize * ysize * 2);
 
-  if (cc != sizeof(float) * xsize * ysize * 2) {
-    fprintf(stderr, "Write returned short: %s\n", strerror(errno));
-    close(fd);
-    exit(-1);
-  }
+/******************************************************************************
+Write the vector field to a file as floats.
+******************************************************************************/
 
-  close(fd);
+void VectorField::write_file(char *filename)
+{
+  write_file(filename, VEC_F32);
 }
 
 
@@ -25,6 +25,8 @@ class VectorField
     float *values;
     float aspect;
     float aspect_recip;
+
+    void read_file(char *, int);
 public:
     int xsize, ysize;
 
@@ -38,6 +40,7 @@ public:
     }
 
     VectorField(char *filename);
+    VectorField(char *filename, int frame);
 
     ~VectorField()
     {
@@ -91,9 +94,7 @@ public:
 
     void write_file(char *);
 
-private:
-    void float_read(std::ifstream &ifstream);
-    void minifloat_read(std::ifstream &ifstream);
+    void write_file(char *, int);
 };
 
 void set_integration(int);  /* set which type of integrator to use */
@@ -413,14 +413,16 @@ Interpret commands.
 
 void interpreter()
 {
-  char str[80];
-  char filename[80];
+  char str[MAX_CLI_LINE];
+  char filename[MAX_CLI_LINE];
 
   START_CLI ("stdraw", "cli")
 
-    COMMAND ("vload file.vec") {
+    COMMAND ("vload file.vec (frame)") {
+      int frame = 0;
       get_parameter(filename);
-      vf = new VectorField(filename);
+      get_integer(&frame);
+      vf = new VectorField(filename, frame);
       float_reg = vf->get_magnitude();
       vf->normalize();
     } COMMAND ("draw_picture") {
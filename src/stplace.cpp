@@ -26,7 +26,10 @@ warranty of merchantability or fitness for a particular purpose.
 #include <iostream>
 #include <fstream>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <limits.h>
+#include <float.h>
 #include "../libs/cli.h"
 #include "../libs/window.h"
 #include "../libs/floatimage.h"
@@ -36,8 +39,13 @@ warranty of merchantability or fitness for a particular purpose.
 #include "repel.h"
 #include "stplace.h"
 #include "intersect.h"
-#include "dissolve.h"
+#include "birth.h"
 #include "visparams.h"
+#include "footprint.h"
+#include "filter.h"
+#include "pool.h"
+#include "pyramid.h"
+#include "threads.h"
 
 /* external declarations and forward pointers to routines */
 
@@ -47,6 +55,8 @@ void interpreter();
 
 void new_interpreter();
 
+int make_best_move(int, Lowpass *, double &, unsigned long int);
+
 VectorField *vf = NULL;         /* the vector field we're visualizing */
 FloatImage *float_reg = NULL;   /* scalar field "register" */
 
@@ -166,6 +176,34 @@ int vary_arrow_intensity = 0;
 /* how much to step while integrating through the vector field */
 float delta_step = 0.005;
 
+/* how often to recompute the quality from scratch (0 = never) */
+static int verify_interval = 0;
+
+/* coarser lowpass images kept during a cascade, and whether to use them */
+/* to turn down poor moves */
+static LowpassPyramid *pyramid = NULL;
+static int coarse_reject = 0;
+static float coarse_margin = 0.0;   /* fraction of a footprint's energy */
+
+/* endpoints of the streamlines being improved, for finding joins */
+static RepelTable *joins = NULL;
+
+/* how many changes to try out at once on a streamline */
+#define MAX_PROPOSALS 64
+static int num_proposals = 1;
+
+/* change only the ends of a streamline when its origin stays put? */
+static int resize_in_place = 1;
+
+/* lattice nodes per grid cell and steps per fragment of the flow map */
+/* that streamlines are followed with while improving them (0 = none) */
+static int flow_map_res = 0;
+static int flow_map_steps = 8;
+
+/* has the lowpass image been drawn, and when? */
+static int lowimage_drawn = 0;
+static unsigned int lowimage_stamp;
+
 
 /******************************************************************************
 Main routine.
@@ -198,7 +236,8 @@ int main(int argc, char *argv[])
 
   if (argc > 0) {
     vf = new VectorField(*argv);
-    float_reg = vf->get_magnitude();
+    if (vf->get_tiles() == NULL)   /* (it would mean reading every tile) */
+      float_reg = vf->get_magnitude();
     /* normalize the field */
     vf->normalize();
   }
@@ -216,6 +255,8 @@ int main(int argc, char *argv[])
     win2->map();
     win2->flush();
   }
+  else
+    graph_the_quality = 0;   /* there is no window to graph it in */
 
   /* initialize visualization parameters */
 
@@ -255,7 +296,15 @@ Draw the lowpass filtered image of the current streamline bundle.
 void draw_lowimage(Window2d *win, int x, int y)
 {
   win2->gray_ramp();
-  low->draw(win2);
+
+  /* draw it all the first time, and after that just what has changed */
+  if (lowimage_drawn)
+    low->draw_changes(win2, lowimage_stamp);
+  else
+    low->draw(win2);
+
+  lowimage_drawn = 1;
+  lowimage_stamp = low->get_stamp();
 
   if (verbose_flag)
     printf("quality = %f\n", low->current_quality());
@@ -357,8 +406,9 @@ void line_test(int num)
   int ys = 100;
 
   low = new Lowpass(xs, ys, 2.0, target_lowpass);
+  lowimage_drawn = 0;
 
-  float quality = low->current_quality();
+  double quality = low->current_quality();
   float delta = 5.0 / (float) xsize;
 
   float slen = 0.4;
@@ -604,10 +654,11 @@ void snap_arrows_to_streamlines(
       else
         y = dist * (j + 0.75 + jy);
 
-      /* snap the arrowhead to the nearest streamline */
+      /* snap the arrowhead to the nearest streamline, if one is close */
 
-      SamplePoint *point = repel->find_nearest(x, y);
-      if (point == NULL)
+      SamplePoint *point;
+      if (repel->find_nearest(x, y, 1, max * 2.0, NULL, head ? HEAD : -1, 0,
+                              &point) == 0)
         continue;
 
       float nx = point->x;
@@ -632,6 +683,35 @@ void snap_arrows_to_streamlines(
 }
 
 
+/******************************************************************************
+Create the streamlines of a grid all at once, and add them to the bundle.
+
+Entry:
+  num   - number of streamlines
+  x,y   - their starting points
+  len   - their lengths
+  delta - step value along the streamlines
+******************************************************************************/
+
+static void add_grid_lines(int num, float *x, float *y, float *len, float delta)
+{
+  Streamline **lines = new Streamline *[num];
+
+  Streamline::create_batch(vf, num, x, y, len, delta, lines);
+
+  for (int i = 0; i < num; i++) {
+    bundle->add_line(lines[i]);
+    if (graphics_flag)
+      lines[i]->draw(win);
+  }
+
+  if (graphics_flag)
+    win->flush();
+
+  delete[] lines;
+}
+
+
 /******************************************************************************
 Create a hexagonal grid showing vector field.
 
@@ -642,7 +722,7 @@ Entry:
 void hexagonal_grid(int steps)
 {
   float x, y;
-  Streamline *st;
+  int num = 0;
 
   bundle = new Bundle();
 
@@ -658,6 +738,11 @@ void hexagonal_grid(int steps)
   float dist = 1.0 / len;
   float dist3 = dist * sqrt(3) / 2;
 
+  int most = (int) (len * 2 + 1) * (int) (len * vf->getaspect() + 1);
+  float *xs = new float[most];
+  float *ys = new float[most];
+  float *lens = new float[most];
+
   for (int i = 0; i < len * 2; i++) {
     for (int j = 0; j < len * vf->getaspect(); j++) {
 
@@ -672,16 +757,18 @@ void hexagonal_grid(int steps)
       else
         y = dist * (j + 0.75 + jy);
 
-      float blen = vis_get_birth_length(x, y);
-      st = new Streamline(vf, x, y, blen, delta);
-      bundle->add_line(st);
-      if (graphics_flag)
-        st->draw(win);
+      xs[num] = x;
+      ys[num] = y;
+      lens[num] = vis_get_birth_length(x, y);
+      num++;
     }
   }
 
-  if (graphics_flag)
-    win->flush();
+  add_grid_lines(num, xs, ys, lens, delta);
+
+  delete[] xs;
+  delete[] ys;
+  delete[] lens;
 }
 
 
@@ -695,7 +782,7 @@ Entry:
 void square_grid(int steps)
 {
   int i, j;
-  Streamline *st;
+  int num = 0;
 
   bundle = new Bundle();
 
@@ -707,22 +794,29 @@ void square_grid(int steps)
 
   float delta = delta_step;
 
+  int most = steps * (int) (steps * vf->getaspect() + 1);
+  float *xs = new float[most];
+  float *ys = new float[most];
+  float *lens = new float[most];
+
   for (i = 0; i < steps; i++) {
     for (j = 0; j < steps * vf->getaspect(); j++) {
       float jx = jitter * (drand48() - 0.5);
       float jy = jitter * (drand48() - 0.5);
       float x = (i + 0.5 + jx) / steps;
       float y = (j + 0.5 + jy) / steps;
-      float blen = vis_get_birth_length(x, y);
-      st = new Streamline(vf, x, y, blen, delta);
-      bundle->add_line(st);
-      if (graphics_flag)
-        st->draw(win);
+      xs[num] = x;
+      ys[num] = y;
+      lens[num] = vis_get_birth_length(x, y);
+      num++;
     }
   }
 
-  if (graphics_flag)
-    win->flush();
+  add_grid_lines(num, xs, ys, lens, delta);
+
+  delete[] xs;
+  delete[] ys;
+  delete[] lens;
 }
 
 
@@ -746,8 +840,9 @@ void good_random_lines()
 
   /* create a lowpass image, to be used with a radial cubic filter */
   low = new Lowpass(xs, ys, radius_lowpass, target_lowpass);
+  lowimage_drawn = 0;
 
-  float quality = low->current_quality();
+  double quality = low->current_quality();
   float delta = delta_step;
 
   /* randomly place streamlines */
@@ -762,7 +857,7 @@ void good_random_lines()
 
     /* see whether it increases the quality of the low-pass image */
 
-    float new_quality = low->new_quality(st);
+    double new_quality = low->new_quality(st);
 
     /* if so, add it to image */
 
@@ -792,8 +887,11 @@ void good_random_lines()
 }
 
 
+#define BIRTH_BATCH 256   /* birth positions whose streamlines are made at once */
+
 /******************************************************************************
-See if we want to birth new streamlines.
+See if we want to birth new streamlines.  The candidates at a batch of
+positions are created together, then tried one after another.
 
 Exit:
   returns 1 if there were births, 0 if not
@@ -802,7 +900,7 @@ Exit:
 int streamline_birth(Lowpass *low)
 {
   int i;
-  float quality;
+  double quality;
   int had_births = 0;
 
   if (verbose_flag) {
@@ -826,29 +924,65 @@ int streamline_birth(Lowpass *low)
     blur->add_line(temp_bundle->get_line(i));
   }
 
-  /* find places in this image that are too sparse, and try to */
-  /* birth a new streamline at these places */
+  /* try to birth new streamlines at the places in this image that */
+  /* are too sparse, the emptiest first */
 
-  Dissolve dissolve(xs_blur, ys_blur);
+  BirthQueue queue(blur);
 
   int count = 0;
   quality = low->current_quality();
 
-  for (i = 0; i < xs_blur * ys_blur; i++) {
+  float xs[BIRTH_BATCH], ys[BIRTH_BATCH], lens[BIRTH_BATCH];
+  float bx[BIRTH_BATCH], by[BIRTH_BATCH], blens[BIRTH_BATCH];
+  Streamline *lines[BIRTH_BATCH];
+  int slot[BIRTH_BATCH];
+  int as[BIRTH_BATCH], bs[BIRTH_BATCH];
+
+  while (1) {
+
+    /* get the sparsest positions in blur image, and create */
+    /* streamlines all at once at those that are sparse right now */
+
+    int num = queue.next_batch(birth_thresh, BIRTH_BATCH, as, bs);
+    if (num == 0)
+      break;
+
+    int nmade = 0;
+    for (int k = 0; k < num; k++) {
+      xs[k] = as[k] / (xs_blur - 1.0);
+      ys[k] = bs[k] / (ys_blur - 1.0) * vf->getaspect();
+      lens[k] = vis_get_birth_length(xs[k], ys[k]);
+      slot[k] = -1;
+      if (blur->birth_test(xs[k], ys[k], birth_thresh)) {
+        slot[k] = nmade;
+        bx[nmade] = xs[k];
+        by[nmade] = ys[k];
+        blens[nmade] = lens[k];
+        nmade++;
+      }
+    }
 
-    /* get new pseudo-random position in blur image */
-    int a, b;
-    dissolve.new_position(a, b);
-    float x = (a + 0.5) / xs_blur;
-    float y = (b + 0.5) / ys_blur * vf->getaspect();
+    Streamline::create_batch(vf, nmade, bx, by, blens, delta, lines);
 
-    if (blur->birth_test(x, y, birth_thresh)) {
+    /* births earlier in the batch may have filled in a position, */
+    /* so test each again before trying it */
 
-      Streamline *birth_st;
-      float blen = vis_get_birth_length(x, y);
-      birth_st = new Streamline(vf, x, y, blen, delta);
+    for (int k = 0; k < num; k++) {
 
-      float new_quality = low->new_quality(birth_st);
+      float x = xs[k];
+      float y = ys[k];
+      float blen = lens[k];
+      Streamline *birth_st = (slot[k] >= 0) ? lines[slot[k]] : NULL;
+
+      if (!blur->birth_test(x, y, birth_thresh)) {
+        delete birth_st;
+        continue;
+      }
+
+      if (birth_st == NULL)
+        birth_st = new Streamline(vf, x, y, blen, delta);
+
+      double new_quality = low->new_quality(birth_st);
 
       /* add streamline if it improves the quality */
 
@@ -890,7 +1024,7 @@ int streamline_birth(Lowpass *low)
   return (had_births);
 }
 
-static Dissolve *dissolve;
+static BirthQueue *birth_queue = NULL;
 static float birth_delta;
 static int xs_blur, ys_blur;
 
@@ -907,10 +1041,11 @@ void streamline_birth_init(Lowpass *low)
   xs_blur = (int) (birth_blur * vis_get_lowpass_xsize());
   ys_blur = (int) (birth_blur * vis_get_lowpass_ysize());
 
-  /* find places in this image that are too sparse, and try to */
-  /* birth a new streamline at these places */
+  /* keep track of the places in this image that are too sparse, so */
+  /* births can be tried there */
 
-  dissolve = new Dissolve(xs_blur, ys_blur);
+  delete birth_queue;
+  birth_queue = new BirthQueue(low);
 }
 
 
@@ -923,13 +1058,15 @@ Exit:
 
 int streamline_birth_trial(Lowpass *low)
 {
-  float quality = low->current_quality();
+  double quality = low->current_quality();
 
-  /* get new pseudo-random position in blur image */
+  /* get the sparsest position in the image, if there is one */
   int a, b;
-  dissolve->new_position(a, b);
-  float x = (a + 0.5) / xs_blur;
-  float y = (b + 0.5) / ys_blur * vf->getaspect();
+  if (!birth_queue->next(birth_thresh, a, b))
+    return (0);
+
+  float x = a / (low->xsize - 1.0);
+  float y = b / (low->ysize - 1.0) * vf->getaspect();
 
   if (low->birth_test(x, y, birth_thresh)) {
 
@@ -937,7 +1074,7 @@ int streamline_birth_trial(Lowpass *low)
     float blen = vis_get_birth_length(x, y);
     birth_st = new Streamline(vf, x, y, blen, birth_delta);
 
-    float new_quality = low->new_quality(birth_st);
+    double new_quality = low->new_quality(birth_st);
 
     /* add streamline if it improves the quality */
 
@@ -967,59 +1104,54 @@ int streamline_birth_trial(Lowpass *low)
 
 
 /******************************************************************************
-Make a directed change to a streamline.  Accept the change if it improves the
-overall quality.
+Return a random number between zero and one, either from the shared sequence
+or from a sequence of the caller's own.
 
 Entry:
-  num     - index to streamline that we want to change
-  low     - lowpass filtered version of streamlines
-  quality - current quality of image
-  change  - what kind of change to make to the streamline
+  seed - state of the caller's sequence, or NULL to use the shared one
+******************************************************************************/
+
+static double random_number(unsigned short *seed)
+{
+  if (seed == NULL)
+    return (drand48());
+  else
+    return (erand48(seed));
+}
+
+
+/******************************************************************************
+Come up with a changed copy of a streamline.  The streamline itself and the
+lowpass image are left alone, so that this may be called from several
+threads at once if each has its own random sequence.
+
+Entry:
+  st     - streamline to change
+  change - what kind of change to make to the streamline
+  seed   - random sequence to use, or NULL for the shared one
 
 Exit:
-  quality - new quality, if it has changed
-  returns 1 if we had to delete the streamline, 0 otherwise
+  x,y - origin of the new streamline
+  len - length of the new streamline
+  returns the new streamline
 ******************************************************************************/
 
-int make_streamline_move(
-        int num,
-        Lowpass *low,
-        float &quality,
-        unsigned long int change
+Streamline *propose_streamline_move(
+        Streamline *st,
+        unsigned long int change,
+        unsigned short *seed,
+        float &x,
+        float &y,
+        float &len
 )
 {
-  /* get the streamline to try changing */
-
-  Streamline *st = low->bundle->get_line(num);
-
   /* get info about the selected streamline */
 
-  float x, y;
   st->get_origin(x, y);
 
   float len1_orig, len2_orig;
   st->get_lengths(len1_orig, len2_orig);
 
-  /* if deleting this streamline improves the quality, get rid */
-  /* of it and return */
-
-  low->delete_line(st);
-  float new_quality = low->current_quality();
-
-  if (new_quality <= quality) {
-
-    if (animation_flag) {
-      *anim_file << "change " << st->anim_index << " "
-                 << x << " " << y << " 0.0"
-                 << endl;
-    }
-
-    remove_streamline(st);
-    delete st;
-    quality = new_quality;
-    return (1);
-  }
-
 #if 0
   /* maybe change tapering of intensity at ends */
 
@@ -1051,9 +1183,11 @@ int make_streamline_move(
 
   /* pick a new position */
 
+  int moved = (change & MOVE_CHANGE) != 0;
+
   if (change & MOVE_CHANGE) {
-    x += vis_get_delta_move(x, y) * (drand48() - 0.5);
-    y += vis_get_delta_move(x, y) * (drand48() - 0.5);
+    x += vis_get_delta_move(x, y) * (random_number(seed) - 0.5);
+    y += vis_get_delta_move(x, y) * (random_number(seed) - 0.5);
   }
 
 #if 0
@@ -1072,7 +1206,7 @@ int make_streamline_move(
   } else if (change & TAIL_CHANGE) {
     which_end = TAIL;
   } else {
-    if (drand48() < 0.5)
+    if (random_number(seed) < 0.5)
       which_end = HEAD;
     else
       which_end = TAIL;
@@ -1097,18 +1231,18 @@ int make_streamline_move(
 #if 1
   /* maybe change tapering of intensity at ends */
 
-  if ((taper_max > 0) && (drand48() < 0.5)) {
+  if ((taper_max > 0) && (random_number(seed) < 0.5)) {
 
-    if (!st->head_clipped && drand48() < 0.5) {
+    if (!st->head_clipped && random_number(seed) < 0.5) {
 
-      float pivot = drand48();
+      float pivot = random_number(seed);
       float taper_len = taper_head * (len1_orig + len2_orig);
       float taper_anchor = len1_orig - pivot * taper_len;
       float dt;
       if (taper_len == 0)
-        dt = taper_delta * drand48();
+        dt = taper_delta * random_number(seed);
       else
-        dt = taper_delta * 2 * (drand48() - 0.5);
+        dt = taper_delta * 2 * (random_number(seed) - 0.5);
       taper_len += dt;
 
       if (taper_len / (len1_orig + len2_orig) > taper_max)
@@ -1121,14 +1255,14 @@ int make_streamline_move(
       len2 = len2_orig;
     } else if (!st->tail_clipped) {
 
-      float pivot = drand48();
+      float pivot = random_number(seed);
       float taper_len = taper_tail * (len1_orig + len2_orig);
       float taper_anchor = len2_orig - pivot * taper_len;
       float dt;
       if (taper_len == 0)
-        dt = taper_delta * drand48();
+        dt = taper_delta * random_number(seed);
       else
-        dt = taper_delta * 2 * (drand48() - 0.5);
+        dt = taper_delta * 2 * (random_number(seed) - 0.5);
       taper_len += dt;
 
       if (taper_len / (len1_orig + len2_orig) > taper_max)
@@ -1186,156 +1320,666 @@ int make_streamline_move(
       len1 = len1_orig;
     }
 
-//    printf ("head tail: %f %f\n", taper_head, taper_tail);
+//    printf ("head tail: %f %f\n", taper_head, taper_tail);
+
+    change = 0;
+
+  }
+#endif
+
+  if (change & LONG_BOTH) {
+    len1 = len1_orig + delta_length1 * random_number(seed);
+    len2 = len2_orig + delta_length2 * random_number(seed);
+  }
+
+  if (change & LONG_ONE) {
+    if (which_end == HEAD)
+      len1 = len1_orig + delta_length1 * random_number(seed);
+    else
+      len2 = len2_orig + delta_length2 * random_number(seed);
+  }
+
+  if (change & SHORT_BOTH) {
+    len1 = len1_orig - delta_length1 * random_number(seed);
+    if (len1 < 0)
+      len1 = delta_length1 * random_number(seed);
+
+    len2 = len2_orig - delta_length2 * random_number(seed);
+    if (len2 < 0)
+      len2 = delta_length2 * random_number(seed);
+  }
+
+  if (change & SHORT_ONE) {
+    if (which_end == HEAD) {
+      len1 = len1_orig - delta_length1 * random_number(seed);
+      if (len1 < 0)
+        len1 = delta_length1 * random_number(seed);
+    } else {
+      len2 = len2_orig - delta_length2 * random_number(seed);
+      if (len2 < 0)
+        len2 = delta_length2 * random_number(seed);
+    }
+  }
+
+  if (change & ALL_LEN) {
+    len1 = len1_orig + delta_length1 * 2 * (random_number(seed) - 0.5);
+    if (len1 < 0)
+      len1 = delta_length1 * random_number(seed);
+
+    len2 = len2_orig + delta_length2 * 2 * (random_number(seed) - 0.5);
+    if (len2 < 0)
+      len2 = delta_length2 * random_number(seed);
+  }
+
+  /* clamp position to screen */
+
+#if 0
+  float tiny = 0.000001;
+  if (x < tiny) x = tiny;
+  if (x > 1 - tiny) x = 1 - tiny;
+  if (y < tiny) y = tiny;
+  if (y > 1 - tiny) y = 1 - tiny;
+#endif
+
+  clamp_to_screen(x, y, vf->getaspect());
+
+  /* if only the lengths change, keep the points the two have in common */
+
+  Streamline *new_st = NULL;
+
+  if (resize_in_place && !moved)
+    new_st = st->resized(len1, len2);
+
+  if (new_st == NULL) {
+    float delta = delta_step;
+    new_st = new Streamline(vf, x, y, len1, len2, delta);
+  }
+  new_st->retaper(taper_head, taper_tail);
+
+  len = len1 + len2;
+  return (new_st);
+}
+
+
+/******************************************************************************
+Make a directed change to a streamline.  Accept the change if it improves the
+overall quality.
+
+Entry:
+  num     - index to streamline that we want to change
+  low     - lowpass filtered version of streamlines
+  quality - current quality of image
+  change  - what kind of change to make to the streamline
+
+Exit:
+  quality - new quality, if it has changed
+  returns 1 if we had to delete the streamline, 0 otherwise
+******************************************************************************/
+
+int make_streamline_move(
+        int num,
+        Lowpass *low,
+        double &quality,
+        unsigned long int change
+)
+{
+  /* maybe try out several changes at once */
+
+  if (num_proposals > 1)
+    return (make_best_move(num, low, quality, change));
+
+  /* get the streamline to try changing */
+
+  Streamline *st = low->bundle->get_line(num);
+
+  float x, y;
+  st->get_origin(x, y);
+
+  /* if deleting this streamline improves the quality, get rid */
+  /* of it and return */
+
+  if (low->swap_delta(st, NULL) <= 0) {
+
+    if (animation_flag) {
+      *anim_file << "change " << st->anim_index << " "
+                 << x << " " << y << " 0.0"
+                 << endl;
+    }
+
+    low->delete_line(st);
+    remove_streamline(st);
+    delete st;
+    quality = low->current_quality();
+    return (1);
+  }
+
+  /* come up with a changed version */
+
+  float len;
+  Streamline *new_st = propose_streamline_move(st, change, NULL, x, y, len);
+
+  /* turn down moves that make a coarser image worse */
+
+  if (pyramid && coarse_reject && pyramid->get_levels() > 0) {
+    double margin = coarse_margin * pyramid->footprint_energy(st);
+    if (pyramid->swap_delta(st, new_st) > margin) {
+      pyramid->rejects++;
+      delete new_st;
+      return (0);
+    }
+    pyramid->passes++;
+  }
+
+  /* see if this new one is better than the old one; the image is */
+  /* only written to if it is */
+
+  low->compute_values(new_st);
+
+  if (low->swap_delta(st, new_st) <= 0) {
+
+    if (animation_flag) {
+      new_st->anim_index = st->anim_index;
+      *anim_file << "change " << st->anim_index << " "
+                 << x << " " << y << " " << len
+                 << endl;
+    }
+
+    low->delete_line(st);   /* take out old one */
+    low->add_line(new_st);  /* add new one */
+    remove_streamline(st);
+    add_streamline(new_st);
+    delete st;
+    quality = low->current_quality();
+  } else
+    delete new_st;
+
+  return (0);
+}
+
+
+/******************************************************************************
+Pick at random what kind of change to make to a streamline.
+
+Entry:
+  seed - random sequence to use, or NULL for the shared one
+
+Exit:
+  returns the change, as flags that make_streamline_move() understands
+******************************************************************************/
+
+unsigned long int pick_move_change(unsigned short *seed)
+{
+  unsigned long int change = 0;
+
+  /* select whether to change the length, position, or both */
+
+  float pick = random_number(seed);
+
+  if (pick < odds_move) {
+    change |= MOVE_CHANGE;
+  } else if (pick < odds_move + odds_len) {
+    change |= LEN_CHANGE;
+  } else {
+    change |= MOVE_CHANGE;
+    change |= LEN_CHANGE;
+  }
+
+  /* maybe select the kind of length change */
+
+  if (change & LEN_CHANGE) {
+    pick = random_number(seed);
+
+    if (pick < odds_short_one)
+      change |= SHORT_ONE;
+    else if (pick < odds_short_one + odds_long_one)
+      change |= LONG_ONE;
+    else if (pick < odds_short_one + odds_long_one + odds_short_both)
+      change |= SHORT_BOTH;
+    else if (pick < odds_short_one + odds_long_one + odds_short_both + odds_long_both)
+      change |= LONG_BOTH;
+    else
+      change |= ALL_LEN;
+  }
+
+  return (change);
+}
+
+
+/******************************************************************************
+Change around a streamline, and accept the change if it improves the overall
+quality.
+
+Entry:
+  num     - index to streamline that we want to change
+  low     - lowpass filtered version of streamlines
+  quality - current quality of image
+
+Exit:
+  returns 1 if we had to delete the streamline, 0 otherwise
+******************************************************************************/
+
+int move_streamline(int num, Lowpass *low, double &quality)
+{
+  int result;
+  unsigned long int change;
+
+  /* don't try to move the streamline if it is frozen */
+
+  if (low->bundle->get_line(num)->frozen)
+    return (0);
+
+  change = pick_move_change(NULL);
+
+  result = make_streamline_move(num, low, quality, change);
+
+  return (result);
+}
+
+/******************************************************************************
+Come up with a changed copy of a streamline and find how much it would change
+the quality of the lowpass image.  The image is only read.
+
+Entry:
+  low    - lowpass filtered version of streamlines
+  st     - streamline to change
+  change - what kind of change to make
+  seed   - random sequence to use, or NULL for the shared one
+  work   - scratch space to use
+
+Exit:
+  x,y   - origin of the new streamline
+  len   - length of the new streamline
+  delta - change in quality from swapping the new streamline for the old
+  returns the new streamline
+******************************************************************************/
+
+static Streamline *price_move(
+        Lowpass *low,
+        Streamline *st,
+        unsigned long int change,
+        unsigned short *seed,
+        LowpassWork *work,
+        float &x,
+        float &y,
+        float &len,
+        double &delta
+)
+{
+  Streamline *new_st = propose_streamline_move(st, change, seed, x, y, len);
+  low->compute_values(new_st, work);
+  delta = low->swap_delta(st, new_st, work);
+  return (new_st);
+}
+
+
+/* one of several changes to a streamline that are tried out at once */
+
+class MoveProposal
+{
+  public:
+    Streamline *st;            /* streamline to change */
+    unsigned long int change;  /* kind of change */
+    unsigned short seed[3];    /* random sequence for this proposal */
+    Streamline *new_st;        /* the changed streamline */
+    double delta;              /* change in quality it would make */
+    float x, y, len;           /* origin and length of the new streamline */
+};
+
+static MoveProposal proposals[MAX_PROPOSALS];
+
+
+/******************************************************************************
+Try out one of several changes to a streamline.
+
+Entry:
+  num    - which proposal to try
+  thread - number of the thread running it
+  arg    - the lowpass image
+******************************************************************************/
+
+static void proposal_job(int num, int thread, void *arg)
+{
+  Lowpass *low = (Lowpass *) arg;
+  MoveProposal *p = &proposals[num];
+
+  p->new_st = price_move(low, p->st, p->change, p->seed, low->get_work(thread),
+                         p->x, p->y, p->len, p->delta);
+}
+
+
+/******************************************************************************
+Try out several changes to a streamline at once, and make the one that
+improves the overall quality the most.  The changes are found and priced in
+parallel against the current image.
+
+Entry:
+  num     - index to streamline that we want to change
+  low     - lowpass filtered version of streamlines
+  quality - current quality of image
+  change  - kind of change to make first; the others are picked at random
+
+Exit:
+  quality - new quality, if it has changed
+  returns 1 if we had to delete the streamline, 0 otherwise
+******************************************************************************/
+
+int make_best_move(
+        int num,
+        Lowpass *low,
+        double &quality,
+        unsigned long int change
+)
+{
+  int i, k;
+  Streamline *st = low->bundle->get_line(num);
+
+  float x, y;
+  st->get_origin(x, y);
+
+  /* if deleting this streamline improves the quality, get rid */
+  /* of it and return */
+
+  if (low->swap_delta(st, NULL) <= 0) {
+
+    if (animation_flag) {
+      *anim_file << "change " << st->anim_index << " "
+                 << x << " " << y << " 0.0"
+                 << endl;
+    }
+
+    low->delete_line(st);
+    remove_streamline(st);
+    delete st;
+    quality = low->current_quality();
+    return (1);
+  }
+
+  /* try out the changes */
+
+  for (k = 0; k < num_proposals; k++) {
+    MoveProposal *p = &proposals[k];
+    p->st = st;
+    p->change = (k == 0) ? change : pick_move_change(NULL);
+    for (i = 0; i < 3; i++)
+      p->seed[i] = (unsigned short) (drand48() * 65536);
+  }
+
+  parallel_for(num_proposals, proposal_job, low);
+
+  /* find the best one */
+
+  MoveProposal *best = &proposals[0];
+  for (k = 1; k < num_proposals; k++)
+    if (proposals[k].delta < best->delta)
+      best = &proposals[k];
+
+  for (k = 0; k < num_proposals; k++)
+    if (&proposals[k] != best || best->delta > 0)
+      delete proposals[k].new_st;
+
+  if (best->delta > 0)
+    return (0);
+
+  /* make the change */
+
+  Streamline *new_st = best->new_st;
+
+  if (animation_flag) {
+    new_st->anim_index = st->anim_index;
+    *anim_file << "change " << st->anim_index << " "
+               << best->x << " " << best->y << " " << best->len
+               << endl;
+  }
+
+  low->delete_line(st);
+  low->add_line(new_st);
+  remove_streamline(st);
+  add_streamline(new_st);
+  delete st;
+  quality = low->current_quality();
+
+  return (0);
+}
+
+
+/* a trial move, made by one thread as part of a batch */
+
+class MoveTrial
+{
+  public:
+    Streamline *st;          /* streamline to change */
+    unsigned short seed[3];  /* random sequence for this trial */
+    Streamline *new_st;      /* its replacement, or NULL to delete it */
+    int accept;              /* whether the change improves the image */
+    int box[4];              /* pixels touched: min i, min j, max i, max j */
+    float x, y, len;         /* origin and length of replacement */
+};
 
-    change = 0;
+#define MOVES_PER_THREAD 4   /* trial moves per thread in each batch */
 
-  }
-#endif
+static MoveTrial trials[MAX_THREADS * MOVES_PER_THREAD];
 
-  if (change & LONG_BOTH) {
-    len1 = len1_orig + delta_length1 * drand48();
-    len2 = len2_orig + delta_length2 * drand48();
-  }
 
-  if (change & LONG_ONE) {
-    if (which_end == HEAD)
-      len1 = len1_orig + delta_length1 * drand48();
-    else
-      len2 = len2_orig + delta_length2 * drand48();
-  }
+/******************************************************************************
+Grow a box of pixels to hold those that a streamline changes.
 
-  if (change & SHORT_BOTH) {
-    len1 = len1_orig - delta_length1 * drand48();
-    if (len1 < 0)
-      len1 = delta_length1 * drand48();
+Entry:
+  st  - streamline whose values are to be included
+  box - box to grow (min i, min j, max i, max j)
+******************************************************************************/
 
-    len2 = len2_orig - delta_length2 * drand48();
-    if (len2 < 0)
-      len2 = delta_length2 * drand48();
+static void grow_box(Streamline *st, int box[4])
+{
+  for (int n = 0; n < st->num_values; n++) {
+    int i, j;
+    float value;
+    st->get_value(n, i, j, value);
+    if (i < box[0]) box[0] = i;
+    if (j < box[1]) box[1] = j;
+    if (i > box[2]) box[2] = i;
+    if (j > box[3]) box[3] = j;
   }
+}
 
-  if (change & SHORT_ONE) {
-    if (which_end == HEAD) {
-      len1 = len1_orig - delta_length1 * drand48();
-      if (len1 < 0)
-        len1 = delta_length1 * drand48();
-    } else {
-      len2 = len2_orig - delta_length2 * drand48();
-      if (len2 < 0)
-        len2 = delta_length2 * drand48();
-    }
-  }
 
-  if (change & ALL_LEN) {
-    len1 = len1_orig + delta_length1 * 2 * (drand48() - 0.5);
-    if (len1 < 0)
-      len1 = delta_length1 * drand48();
+/******************************************************************************
+Return whether two boxes of pixels overlap.
+******************************************************************************/
 
-    len2 = len2_orig + delta_length2 * 2 * (drand48() - 0.5);
-    if (len2 < 0)
-      len2 = delta_length2 * drand48();
-  }
+static int boxes_overlap(int *a, int *b)
+{
+  return (a[0] <= b[2] && b[0] <= a[2] && a[1] <= b[3] && b[1] <= a[3]);
+}
 
-  /* clamp position to screen */
 
-#if 0
-  float tiny = 0.000001;
-  if (x < tiny) x = tiny;
-  if (x > 1 - tiny) x = 1 - tiny;
-  if (y < tiny) y = tiny;
-  if (y > 1 - tiny) y = 1 - tiny;
-#endif
+/******************************************************************************
+Try out one move of a batch.  This only reads the lowpass image, so trials
+may run at the same time as long as each thread has its own work space.
 
-  clamp_to_screen(x, y, vf->getaspect());
+Entry:
+  num    - which trial to run
+  thread - number of the thread running it
+  arg    - the lowpass image
+******************************************************************************/
 
-  float delta = delta_step;
-  set_taper(taper_head, taper_tail);
-  Streamline *new_st = new Streamline(vf, x, y, len1, len2, delta);
-  set_taper(0.0, 0.0);
-  new_quality = low->new_quality(new_st);
+static void trial_job(int num, int thread, void *arg)
+{
+  Lowpass *low = (Lowpass *) arg;
+  LowpassWork *work = low->get_work(thread);
+  MoveTrial *t = &trials[num];
+  Streamline *st = t->st;
 
-  /* see if this new one is better than the old one */
+  /* see if deleting this streamline improves the quality */
 
-  if (new_quality <= quality) {
+  t->new_st = NULL;
 
-    if (animation_flag) {
-      new_st->anim_index = st->anim_index;
-      *anim_file << "change " << st->anim_index << " "
-                 << x << " " << y << " " << (len1 + len2)
-                 << endl;
-    }
+  if (low->swap_delta(st, NULL, work) <= 0) {
+    t->accept = 1;
+    return;
+  }
 
-    low->add_line(new_st);  /* add new one */
-    remove_streamline(st);
-    add_streamline(new_st);
-    delete st;
-    quality = new_quality;
-  } else {
-    low->add_line(st);      /* add back old one */
-    delete new_st;
+  /* otherwise try changing it, keeping the best of the changes tried */
+
+  double best = DBL_MAX;
+
+  for (int k = 0; k < num_proposals; k++) {
+    float x, y, len;
+    double delta;
+    Streamline *new_st = price_move(low, st, pick_move_change(t->seed),
+                                    t->seed, work, x, y, len, delta);
+    if (k == 0 || delta < best) {
+      if (t->new_st)
+        delete t->new_st;
+      t->new_st = new_st;
+      t->x = x;
+      t->y = y;
+      t->len = len;
+      best = delta;
+    } else
+      delete new_st;
   }
 
-  return (0);
+  grow_box(t->new_st, t->box);
+  t->accept = (best <= 0);
+
+  /* give back a rejected streamline to the pool it came from */
+
+  if (!t->accept) {
+    delete t->new_st;
+    t->new_st = NULL;
+  }
 }
 
 
 /******************************************************************************
-Change around a streamline, and accept the change if it improves the overall
-quality.
+Move a batch of streamlines, with the moves tried out in parallel.  The
+streamlines are picked at random just as in the serial loop, and a batch
+ends at the first pick whose footprint overlaps one already in it; that
+pick is saved to start the next batch, so that no streamline is passed over
+for being in a crowded spot.  The accepted moves are then made one at a
+time, re-checking any that a move made earlier in the batch may have
+affected.  Each trial has its own random sequence, seeded from the shared
+one, so results don't depend on which thread runs which trial.
 
 Entry:
-  num     - index to streamline that we want to change
   low     - lowpass filtered version of streamlines
   quality - current quality of image
+  pick    - index of the streamline to start with, or -1 for a random one
 
 Exit:
-  returns 1 if we had to delete the streamline, 0 otherwise
+  quality - new quality
+  pick    - streamline to start the next batch with, or -1
+  returns the number of moves tried, at least one
 ******************************************************************************/
 
-int move_streamline(int num, Lowpass *low, float &quality)
+int parallel_moves(Lowpass *low, double &quality, int &pick)
 {
-  int result;
-  unsigned long int change = 0;
+  int i, k;
+  Bundle *bundle = low->bundle;
+  int most = get_threads() * MOVES_PER_THREAD;
+  int num = 0;
 
-  /* don't try to move the streamline if it is frozen */
+  /* pick streamlines until one overlaps those already picked */
 
-  if (low->bundle->get_line(num)->frozen)
-    return (0);
+  while (num < most && bundle->num_lines > 0) {
 
-  /* select whether to change the length, position, or both */
+    if (pick < 0 || pick >= bundle->num_lines)
+      pick = (int) floor(drand48() * bundle->num_lines);
 
-  float pick = drand48();
+    Streamline *st = bundle->get_line(pick);
+    if (st->frozen == 1) {
+      pick = -1;
+      continue;
+    }
 
-  if (pick < odds_move) {
-    change |= MOVE_CHANGE;
-  } else if (pick < odds_move + odds_len) {
-    change |= LEN_CHANGE;
-  } else {
-    change |= MOVE_CHANGE;
-    change |= LEN_CHANGE;
+    MoveTrial *t = &trials[num];
+    t->box[0] = t->box[1] = INT_MAX;
+    t->box[2] = t->box[3] = INT_MIN;
+    grow_box(st, t->box);
+
+    for (i = 0; i < num; i++)
+      if (trials[i].st == st || boxes_overlap(trials[i].box, t->box))
+        break;
+    if (i < num)
+      break;
+
+    t->st = st;
+    for (i = 0; i < 3; i++)
+      t->seed[i] = (unsigned short) (drand48() * 65536);
+    num++;
+    pick = -1;
   }
 
-  /* maybe select the kind of length change */
+  /* try out the moves */
 
-  if (change & LEN_CHANGE) {
-    pick = drand48();
+  parallel_for(num, trial_job, low);
 
-    if (pick < odds_short_one)
-      change |= SHORT_ONE;
-    else if (pick < odds_short_one + odds_long_one)
-      change |= LONG_ONE;
-    else if (pick < odds_short_one + odds_long_one + odds_short_both)
-      change |= SHORT_BOTH;
-    else if (pick < odds_short_one + odds_long_one + odds_short_both + odds_long_both)
-      change |= LONG_BOTH;
-    else
-      change |= ALL_LEN;
+  /* make the moves that improve things, in the order they were picked */
+
+  int changed = 0;
+
+  for (k = 0; k < num; k++) {
+
+    MoveTrial *t = &trials[k];
+    Streamline *st = t->st;
+    Streamline *new_st = t->new_st;
+
+    /* re-check moves near others that have already been made */
+
+    for (i = 0; i < changed; i++)
+      if (boxes_overlap(trials[i].box, t->box))
+        break;
+
+    if (t->accept && i < changed)
+      t->accept = (low->swap_delta(st, new_st) <= 0);
+
+    if (!t->accept) {
+      if (new_st)
+        delete new_st;
+
+      /* the serial loop sends a streamline it failed to move to the end */
+      /* of the bundle, so do the same to keep the bundles in step */
+
+      bundle->delete_line(st);
+      bundle->add_line(st);
+      continue;
+    }
+
+    if (animation_flag) {
+      float x, y;
+      st->get_origin(x, y);
+      if (new_st) {
+        new_st->anim_index = st->anim_index;
+        *anim_file << "change " << st->anim_index << " "
+                   << t->x << " " << t->y << " " << t->len << endl;
+      } else
+        *anim_file << "change " << st->anim_index << " "
+                   << x << " " << y << " 0.0" << endl;
+    }
+
+    low->delete_line(st);
+    remove_streamline(st);
+
+    if (new_st) {
+      low->add_line(new_st);
+      add_streamline(new_st);
+    }
+
+    delete st;
+
+    /* keep the changed trials at the front, for the overlap tests */
+
+    if (changed != k) {
+      MoveTrial temp = trials[changed];
+      trials[changed] = *t;
+      trials[k] = temp;
+    }
+    changed++;
   }
 
-  result = make_streamline_move(num, low, quality, change);
+  quality = low->current_quality();
 
-  return (result);
+  return (num > 0 ? num : 1);
 }
 
 static float graph_x;
@@ -1523,7 +2167,7 @@ void initialize_streamline_quality()
 See which streamlines have poor quality and try to improve one of them.
 ******************************************************************************/
 
-void examine_streamline_quality(float &quality)
+void examine_streamline_quality(double &quality)
 {
   int index;
   Bundle *bundle = low->bundle;
@@ -1602,26 +2246,52 @@ void improve_lines(int num)
   int ys = vis_get_lowpass_ysize();
 
   if (verbose_flag)
-    printf("lowpass size = %d %d\n", xs, ys);
+    printf("lowpass size = %d %d (%s footprints, %s filter)\n", xs, ys,
+           footprint_kernel_name(), filter_type_name(get_filter_type()));
 
   /* create a lowpass image, to be used with a radial cubic filter */
   low = new Lowpass(xs, ys, radius_lowpass, target_lowpass);
+  low->make_works(get_threads());
+  lowimage_drawn = 0;
+
+  if (verbose_flag && get_threads() > 1)
+    printf("moving streamlines with %d threads\n", get_threads());
 
   /* add all the streamlines to this lowpass image */
   for (i = 0; i < bundle->num_lines; i++) {
-    float quality = low->new_quality(bundle->get_line(i));
+    low->compute_values(bundle->get_line(i));
     low->add_line(bundle->get_line(i));
   }
 
-  float quality = low->current_quality();
+  /* in a cascade, keep a coarser image to try out moves on */
+  if (pyramid) {
+    if (pyramid->get_levels() == 0)
+      pyramid->add_level(new Lowpass(xs / 2, ys / 2, radius_lowpass,
+                                     target_lowpass), bundle);
+    pyramid->set_target(target_lowpass);
+  }
+
+  double quality = low->current_quality();
   float delta = delta_step;
 
+  /* maybe follow the streamlines with a flow map for the whole run */
+  FlowMap *flow = NULL;
+
+  if (flow_map_res > 0) {
+    flow = new FlowMap(vf, flow_map_res, flow_map_steps, delta);
+    vf->set_flow_map(flow);
+    if (verbose_flag)
+      printf("flow map: %d nodes per cell, %d steps, %ld bytes\n",
+             flow_map_res, flow->get_steps(), flow->get_bytes());
+  }
+
   /* make table to use for joining endpoints */
-  RepelTable *repel;
 
   float join_dist = vis_get_max_join_distance();
   if (join_dist > 0.0) {
-    repel = new RepelTable(vf, join_dist);
+    joins = new RepelTable(vf, join_dist);
+    for (i = 0; i < low->bundle->num_lines; i++)
+      joins->add_endpoints(low->bundle->get_line(i), 1, 1);
     float radius = radius_lowpass / vis_get_lowpass_xsize();
     if (verbose_flag) {
       printf("max join distance = %f\n", join_dist);
@@ -1671,23 +2341,51 @@ void improve_lines(int num)
   /* try to improve the positions of the streamlines */
 
   keep_reading_events = 1;
-  float last_quality = quality;
+  double last_quality = quality;
 
-  for (int k = 0; k < num; k++) {
+  /* count heap allocations, overall and since the last thousand iterations */
+  long alloc_start = get_heap_allocations();
+  long alloc_mark = alloc_start;
+  int k, k_mark = 0;
 
-    /* pick a random streamline (making sure it isn't frozen) */
+  /* largest difference between running and recomputed quality */
+  double max_drift = 0;
 
-    int pick;
-    do {
-      pick = (int) floor(drand48() * low->bundle->num_lines);
-    } while (low->bundle->get_line(pick)->frozen == 1);
+  /* iterations left in the current batch of parallel moves, and the */
+  /* streamline that the next batch starts with */
+  int batch_left = 0;
+  int batch_pick = -1;
 
-    /* move it around one or more times */
+  for (k = 0; k < num; k++) {
 
-    if (low->bundle->num_lines > 0)
-      for (i = 0; i < move_times; i++)
-        if (move_streamline(pick, low, quality))
-          break;
+    if (k % 1000 == 0) {
+      alloc_mark = get_heap_allocations();
+      k_mark = k;
+    }
+
+    /* with several threads, move a batch of streamlines at once, and */
+    /* count each move as one iteration */
+
+    if (get_threads() > 1) {
+      if (batch_left == 0)
+        batch_left = parallel_moves(low, quality, batch_pick);
+      batch_left--;
+    } else {
+
+      /* pick a random streamline (making sure it isn't frozen) */
+
+      int pick;
+      do {
+        pick = (int) floor(drand48() * low->bundle->num_lines);
+      } while (low->bundle->get_line(pick)->frozen == 1);
+
+      /* move it around one or more times */
+
+      if (low->bundle->num_lines > 0)
+        for (i = 0; i < move_times; i++)
+          if (move_streamline(pick, low, quality))
+            break;
+    }
 
     /* check the events and maybe break loop */
     check_events();
@@ -1702,7 +2400,7 @@ void improve_lines(int num)
     if (generation > 0) {
       int had_birth = streamline_birth_trial(low);
       quality = low->current_quality();
-      if (had_birth)
+      if (had_birth && graph_the_quality)
         graph_show_birth(win2);
     }
 
@@ -1710,8 +2408,8 @@ void improve_lines(int num)
 
     if (join_dist > 0.0) {
       int debug_it = 0;
-      int did_join = repel->identify_neighbors(low->bundle, win, vf,
-                                               low, quality, delta, debug_it);
+      int did_join = joins->identify_neighbors(win, vf, low, quality, delta,
+                                               debug_it);
       if (graph_the_quality && did_join)
         graph_show_join(win2);
     }
@@ -1720,6 +2418,17 @@ void improve_lines(int num)
     if (quality_guide)
       examine_streamline_quality(quality);
 
+    /* maybe check the running quality against one computed from scratch */
+    if (verify_interval > 0 && (k + 1) % verify_interval == 0) {
+      double running = low->current_quality();
+      quality = low->recalculate_quality();
+      double drift = running - quality;
+      if (fabs(drift) > max_drift)
+        max_drift = fabs(drift);
+      printf("iteration %d: quality %f, recomputed %f, drift %g\n",
+             k + 1, running, quality, drift);
+    }
+
     if (graph_the_quality)
       draw_graph_quality(quality, win2);
 
@@ -1729,11 +2438,45 @@ void improve_lines(int num)
     last_quality = quality;
   }
 
+  if (verbose_flag) {
+    int hits, misses;
+    low->get_cache_stats(hits, misses);
+    printf("footprint cache: %d hits, %d misses\n", hits, misses);
+
+    if (verify_interval > 0)
+      printf("largest quality drift: %g\n", max_drift);
+
+    long alloc_end = get_heap_allocations();
+    if (k > 0)
+      printf("heap allocations per iteration: %g overall, "
+             "%g over the last %d\n",
+             (alloc_end - alloc_start) / (float) k,
+             (k > k_mark) ? (alloc_end - alloc_mark) / (float) (k - k_mark) : 0.0,
+             k - k_mark);
+  }
+
+  if (verbose_flag && pyramid)
+    printf("coarse level: %d moves rejected, %d passed on\n",
+           pyramid->rejects, pyramid->passes);
+
+  if (flow) {
+    vf->set_flow_map(NULL);
+    delete flow;
+  }
+
+  if (joins) {
+    delete joins;
+    joins = NULL;
+  }
+
   /* get the new bundle of streamlines */
   bundle = low->bundle->copy();
 
-  /* delete the lowpass image */
-  delete low;
+  /* delete the lowpass image, or keep it as part of a cascade */
+  if (pyramid)
+    pyramid->push_level(low, bundle);
+  else
+    delete low;
 
   /* end the animation, if necessary */
   if (animation_flag)
@@ -1772,22 +2515,24 @@ void old_improve_lines(int num)
 
   /* create a lowpass image, to be used with a radial cubic filter */
   low = new Lowpass(xs, ys, radius_lowpass, target_lowpass);
+  lowimage_drawn = 0;
 
   /* add all the streamlines to this lowpass image */
   for (i = 0; i < bundle->num_lines; i++) {
-    float quality = low->new_quality(bundle->get_line(i));
+    double quality = low->new_quality(bundle->get_line(i));
     low->add_line(bundle->get_line(i));
   }
 
-  float quality = low->current_quality();
+  double quality = low->current_quality();
   float delta = delta_step;
 
   /* make table to use for joining endpoints */
-  RepelTable *repel;
 
   float join_dist = vis_get_max_join_distance();
   if (join_dist > 0.0) {
-    repel = new RepelTable(vf, join_dist);
+    joins = new RepelTable(vf, join_dist);
+    for (i = 0; i < low->bundle->num_lines; i++)
+      joins->add_endpoints(low->bundle->get_line(i), 1, 1);
     float radius = radius_lowpass / vis_get_lowpass_xsize();
     if (verbose_flag) {
       printf("max join distance = %f\n", join_dist);
@@ -1798,7 +2543,7 @@ void old_improve_lines(int num)
 #if 0
   if (join_factor > 0.0) {
     float radius = join_factor * radius_lowpass / vis_get_lowpass_xsize();
-    repel = new RepelTable(vf, radius);
+    joins = new RepelTable(vf, radius);
   }
 #endif
 
@@ -1840,7 +2585,7 @@ void old_improve_lines(int num)
   /* try to improve the positions of the streamlines */
 
   keep_reading_events = 1;
-  float last_quality = quality;
+  double last_quality = quality;
 
   for (int k = 0; k < num; k++) {
 
@@ -1871,7 +2616,7 @@ void old_improve_lines(int num)
     if (generation > 0 && k > 0 && k % generation == 0) {
       int had_birth = streamline_birth(low);
       quality = low->current_quality();
-      if (had_birth)
+      if (had_birth && graph_the_quality)
         graph_show_birth(win2);
     }
 
@@ -1879,8 +2624,8 @@ void old_improve_lines(int num)
 
     if (join_dist > 0.0) {
       int debug_it = 0;
-      int did_join = repel->identify_neighbors(low->bundle, win, vf,
-                                               low, quality, delta, debug_it);
+      int did_join = joins->identify_neighbors(win, vf, low, quality, delta,
+                                               debug_it);
       if (graph_the_quality && did_join)
         graph_show_join(win2);
     }
@@ -1888,8 +2633,8 @@ void old_improve_lines(int num)
 #if 0
     if (join_factor > 0.0) {
       int debug_it = 0;
-      int did_join = repel->identify_neighbors (low->bundle, win, vf,
-                                                low, quality, delta, debug_it);
+      int did_join = joins->identify_neighbors (win, vf, low, quality, delta,
+                                                debug_it);
       if (graph_the_quality && did_join)
         graph_show_join (win2);
     }
@@ -1908,6 +2653,11 @@ void old_improve_lines(int num)
     last_quality = quality;
   }
 
+  if (joins) {
+    delete joins;
+    joins = NULL;
+  }
+
   /* get the new bundle of streamlines */
   bundle = low->bundle->copy();
 
@@ -1991,6 +2741,80 @@ void optimize_streamlines(float sep_target)
 }
 
 
+#define FRAME_ITERATIONS 5000   /* improvements after moving to a new frame */
+
+/******************************************************************************
+Read in a vector field and make it the current one.
+
+Entry:
+  name  - name of the field's file; a run of '#' in it is replaced by the
+          frame number, padded with zeros, to name one file of a sequence
+  frame - which frame, of the sequence or of a file that holds many frames
+******************************************************************************/
+
+static void load_field(char *name, int frame)
+{
+  char path[MAX_CLI_LINE];
+  char *hash = strchr(name, '#');
+
+  if (hash) {
+    int digits = strspn(hash, "#");
+    snprintf(path, MAX_CLI_LINE, "%.*s%0*d%s", (int) (hash - name), name,
+             digits, frame, hash + digits);
+    vf = new VectorField(path);
+  }
+  else
+    vf = new VectorField(name, frame);
+
+  if (vf->get_tiles() == NULL) {   /* (it would mean reading every tile) */
+    if (float_reg)
+      delete float_reg;
+    float_reg = vf->get_magnitude();
+  }
+
+  vf->normalize();
+}
+
+
+/******************************************************************************
+Move on to the next frame of a field that changes over time.  Rather than
+placing the streamlines from scratch, those of the last frame are followed
+through the new field from the same origins, and then improved for a short
+while.  This costs much less than a new optimization, and the streamlines
+change smoothly from one frame to the next.
+
+Entry:
+  name  - name of the field's file, as for load_field()
+  frame - which frame to move to
+  num   - number of iterations to improve the streamlines for
+******************************************************************************/
+
+void next_frame(char *name, int frame, int num)
+{
+  if (bundle->num_lines == 0) {
+    printf("there are no streamlines to carry over to the next frame\n");
+    return;
+  }
+
+  VectorField *old_vf = vf;
+  Bundle *old_bundle = bundle;
+
+  load_field(name, frame);
+
+  /* nothing else refers to the old streamlines or field once they are */
+  /* followed through the new one */
+
+  bundle = old_bundle->copy(vf);
+
+  for (int i = 0; i < old_bundle->num_lines; i++)
+    delete old_bundle->get_line(i);
+  delete old_bundle;
+  delete old_vf;
+
+  improve_lines(num);
+}
+
+
 /******************************************************************************
 Cascade several calls to improve_lines.
 ******************************************************************************/
@@ -2028,6 +2852,11 @@ void cascaded_improve(float sep_target)
   gen = 100;
   len = 2.5 * sep;
 
+  /* maybe keep the lowpass image of each stage, to turn down poor moves */
+  /* in the later stages */
+  if (coarse_reject)
+    pyramid = new LowpassPyramid();
+
   while (fabs(sep - sep_target) > 0.0001) {
 
     vis_set_separation(sep);
@@ -2040,6 +2869,14 @@ void cascaded_improve(float sep_target)
     len *= 0.5;
     sep *= 0.5;
   }
+
+  /* the streamlines outlive the pyramid */
+  if (pyramid) {
+    for (int i = 0; i < bundle->num_lines; i++)
+      bundle->get_line(i)->pyramid_slot = -1;
+    delete pyramid;
+    pyramid = NULL;
+  }
 }
 
 
@@ -2092,6 +2929,7 @@ void four_test()
 
   /* create a lowpass image, to be used with a radial cubic filter */
   low = new Lowpass(xs, ys, radius_lowpass, target_lowpass);
+  lowimage_drawn = 0;
 
   /* add all the streamlines to this lowpass image */
   for (int i = 0; i < bundle->num_lines; i++)
@@ -2139,7 +2977,7 @@ void four_test()
 
       /* see what the correct direction to move is */
 
-      float quality = low->current_quality();
+      double quality = low->current_quality();
 
       low->delete_line(st);
       float x_quality = low->new_quality(new_x1) - low->new_quality(new_x0);
@@ -2150,7 +2988,7 @@ void four_test()
       y += dmove * y_quality;
       Streamline *new_st = new Streamline(vf, x, y, length, delta);
       printf("q qx qy, x y: %f %f %f, %f %f ", quality, x_quality, y_quality, x, y);
-      float new_quality = low->new_quality(new_st);
+      double new_quality = low->new_quality(new_st);
 
       if (new_quality <= quality) {
         low->add_line(new_st);
@@ -2258,6 +3096,15 @@ Remove a streamline from the current collection for visualization.
 
 void remove_streamline(Streamline *st)
 {
+  /* keep the coarser images of a cascade up to date */
+
+  if (pyramid)
+    pyramid->delete_line(st);
+
+  /* and the table of endpoints to join */
+
+  if (joins)
+    joins->remove_endpoints(st);
 
   /* maybe erase the old streamline */
 
@@ -2274,6 +3121,16 @@ Add a streamline to the current collection for visualization.
 
 void add_streamline(Streamline *st)
 {
+  /* keep the coarser images of a cascade up to date */
+
+  if (pyramid)
+    pyramid->add_line(st);
+
+  /* and the table of endpoints to join */
+
+  if (joins)
+    joins->add_endpoints(st, 1, 1);
+
   /* evaluate this streamline's quality */
 
   low->streamline_quality(st, sample_radius, sample_number,
@@ -2443,10 +3300,11 @@ void make_lowpass_image(int size, char *filename)
 
   /* create a lowpass image, to be used with a radial cubic filter */
   low = new Lowpass(xs, ys, radius_lowpass, target_lowpass);
+  lowimage_drawn = 0;
 
   /* add all the streamlines to this lowpass image */
   for (i = 0; i < bundle->num_lines; i++) {
-    float quality = low->new_quality(bundle->get_line(i));
+    double quality = low->new_quality(bundle->get_line(i));
     low->add_line(bundle->get_line(i));
   }
 
@@ -2523,6 +3381,7 @@ void taper_improve()
 
   /* create a lowpass image, to be used with a radial cubic filter */
   low = new Lowpass (xs, ys, radius_lowpass, target_lowpass);
+  lowimage_drawn = 0;
 
   /* add all the streamlines to this lowpass image */
   for (i = 0; i < tbundle->num_lines; i++) {
@@ -2530,7 +3389,7 @@ void taper_improve()
     low->add_line (tbundle->get_line(i));
   }
 
-  float quality = low->current_quality();
+  double quality = low->current_quality();
 
   keep_reading_events = 1;
 
@@ -2551,6 +3410,24 @@ void taper_improve()
 
 #endif
 
+/******************************************************************************
+See if the vectors of the field's grid may be changed in place.  A tiled
+field only has its tiles decoded as they are needed, so it can't be.
+
+Exit:
+  returns 1 if they may be changed, 0 (after saying why) if not
+******************************************************************************/
+
+static int field_can_change()
+{
+  if (vf->get_tiles() == NULL)
+    return (1);
+
+  printf("the vectors of a tiled field can't be changed\n");
+  return (0);
+}
+
+
 /******************************************************************************
 Interpret commands.  Many of these commands are undocumented, and users of
 this command set should be prepared to read code in order to understand
@@ -2560,7 +3437,7 @@ the various functions.  Use at your own risk!
 void interpreter()
 {
   int i, j;
-  char filename[80];
+  char filename[MAX_CLI_LINE];
   int grid_num = 40;
   float grid_dist = 0.3;
 
@@ -2571,60 +3448,72 @@ void interpreter()
       vf = new VectorField(filename);
       float_reg = vf->get_magnitude();
       vf->normalize();
-    } COMMAND ("vsave filename (xsize)") {
+    } COMMAND ("vsave filename (xsize) (f32/f16/f8)") {
       int res;
+      char name[MAX_CLI_LINE];
       get_parameter(filename);
       get_integer(&res);
       if (res == 0)
         res = vf->xsize;
-      VectorField *vtemp = new VectorField(res, res);
-      for (int i = 0; i < res; i++)
-        for (int j = 0; j < res; j++) {
-          float s = i / (float) res;
-          float t = j / (float) res;
-          vtemp->xval(i, j) = vf->xval(s, t);
-          vtemp->yval(i, j) = vf->yval(s, t);
-        }
-      vtemp->write_file(filename);
-      delete vtemp;
+      int encoding = VEC_F32;
+      if (get_parameter(name))
+        encoding = vec_encoding(name);
+      if (encoding < 0)
+        printf("encodings are f32, f16 and f8\n");
+      else {
+        VectorField *vtemp = new VectorField(res, res);
+        for (int i = 0; i < res; i++)
+          for (int j = 0; j < res; j++) {
+            float s = i / (float) res;
+            float t = j / (float) res;
+            vtemp->xval(i, j) = vf->xval(s, t);
+            vtemp->yval(i, j) = vf->yval(s, t);
+          }
+        vtemp->write_file(filename, encoding);
+        delete vtemp;
+      }
     } COMMAND ("vflip") {
-      for (int i = 0; i < vf->xsize; i++)
-        for (int j = 0; j < vf->ysize / 2; j++) {
-          int jj = vf->ysize - j - 1;
-          float tx = vf->xval(i, j);
-          float ty = vf->yval(i, j);
-          vf->xval(i, j) = vf->xval(i, jj);
-          vf->yval(i, j) = vf->yval(i, jj);
-          vf->xval(i, jj) = tx;
-          vf->yval(i, jj) = ty;
-        }
+      if (field_can_change())
+        for (int i = 0; i < vf->xsize; i++)
+          for (int j = 0; j < vf->ysize / 2; j++) {
+            int jj = vf->ysize - j - 1;
+            float tx = vf->xval(i, j);
+            float ty = vf->yval(i, j);
+            vf->xval(i, j) = vf->xval(i, jj);
+            vf->yval(i, j) = vf->yval(i, jj);
+            vf->xval(i, jj) = tx;
+            vf->yval(i, jj) = ty;
+          }
     } COMMAND ("hflip") {
-      for (int i = 0; i < vf->xsize / 2; i++)
-        for (int j = 0; j < vf->ysize; j++) {
-          int ii = vf->xsize - i - 1;
-          float tx = vf->xval(i, j);
-          float ty = vf->yval(i, j);
-          vf->xval(i, j) = vf->xval(ii, j);
-          vf->yval(i, j) = vf->yval(ii, j);
-          vf->xval(ii, j) = tx;
-          vf->yval(ii, j) = ty;
-        }
+      if (field_can_change())
+        for (int i = 0; i < vf->xsize / 2; i++)
+          for (int j = 0; j < vf->ysize; j++) {
+            int ii = vf->xsize - i - 1;
+            float tx = vf->xval(i, j);
+            float ty = vf->yval(i, j);
+            vf->xval(i, j) = vf->xval(ii, j);
+            vf->yval(i, j) = vf->yval(ii, j);
+            vf->xval(ii, j) = tx;
+            vf->yval(ii, j) = ty;
+          }
     } COMMAND ("xyswap") {
-      for (int i = 0; i < vf->xsize; i++)
-        for (int j = 0; j < vf->ysize; j++) {
-          float temp = vf->xval(i, j);
-          vf->xval(i, j) = vf->yval(i, j);
-          vf->yval(i, j) = temp;
-        }
+      if (field_can_change())
+        for (int i = 0; i < vf->xsize; i++)
+          for (int j = 0; j < vf->ysize; j++) {
+            float temp = vf->xval(i, j);
+            vf->xval(i, j) = vf->yval(i, j);
+            vf->yval(i, j) = temp;
+          }
     } COMMAND ("vscale  x y") {
       float xs, ys;
       get_real(&xs);
       get_real(&ys);
-      for (int i = 0; i < vf->xsize; i++)
-        for (int j = 0; j < vf->ysize; j++) {
-          vf->xval(i, j) *= xs;
-          vf->yval(i, j) *= ys;
-        }
+      if (field_can_change())
+        for (int i = 0; i < vf->xsize; i++)
+          for (int j = 0; j < vf->ysize; j++) {
+            vf->xval(i, j) *= xs;
+            vf->yval(i, j) *= ys;
+          }
     } COMMAND ("vcut  xorg yorg size") {
       int xs, ys;
       int size;
@@ -2634,8 +3523,7 @@ void interpreter()
       VectorField *vf2 = new VectorField(size, size);
       for (int i = 0; i < size; i++)
         for (int j = 0; j < size; j++) {
-          vf2->xval(i, j) = vf->xval(i + xs, j + ys);
-          vf2->yval(i, j) = vf->yval(i + xs, j + ys);
+          vf->grid_vector(i + xs, j + ys, vf2->xval(i, j), vf2->yval(i, j));
         }
       delete vf;
       vf = vf2;
@@ -2645,13 +3533,14 @@ void interpreter()
       theta *= 3.1415926535 / 180.0;
       float cs = cos(theta);
       float sn = sin(theta);
-      for (int i = 0; i < vf->xsize; i++)
-        for (int j = 0; j < vf->ysize; j++) {
-          float x = vf->xval(i, j);
-          float y = vf->yval(i, j);
-          vf->xval(i, j) = cs * x + sn * y;
-          vf->yval(i, j) = -sn * x + cs * y;
-        }
+      if (field_can_change())
+        for (int i = 0; i < vf->xsize; i++)
+          for (int j = 0; j < vf->ysize; j++) {
+            float x = vf->xval(i, j);
+            float y = vf->yval(i, j);
+            vf->xval(i, j) = cs * x + sn * y;
+            vf->yval(i, j) = -sn * x + cs * y;
+          }
     } COMMAND ("vstretch  xmag") {
 
       float xmag;
@@ -3086,14 +3975,15 @@ void interpreter()
 
       float_reg->blur(steps);
     } COMMAND ("fcombine (vector-field and float_reg)") {
-      for (j = 0; j < vf->ysize; j++)
-        for (i = 0; i < vf->xsize; i++) {
-          float s = i / (float) vf->xsize;
-          float t = j / (float) vf->ysize;
-          float mag = float_reg->get_value(s, t);
-          vf->xval(i, j) = vf->xval(i, j) * mag;
-          vf->yval(i, j) = vf->yval(i, j) * mag;
-        }
+      if (field_can_change())
+        for (j = 0; j < vf->ysize; j++)
+          for (i = 0; i < vf->xsize; i++) {
+            float s = i / (float) vf->xsize;
+            float t = j / (float) vf->ysize;
+            float mag = float_reg->get_value(s, t);
+            vf->xval(i, j) = vf->xval(i, j) * mag;
+            vf->yval(i, j) = vf->yval(i, j) * mag;
+          }
     } COMMAND ("fblur  steps") {
       int steps;
       get_integer(&steps);
@@ -3160,6 +4050,8 @@ void interpreter()
       set_integration(MIDPOINT);
     } COMMAND ("runge_kutta") {
       set_integration(RUNGE_KUTTA);
+    } COMMAND ("rk45") {
+      set_integration(RK45);
     } COMMAND ("animation  off/on") {
       animation_flag = get_boolean();
     } COMMAND ("graphics  off/on") {
@@ -3178,17 +4070,17 @@ Interpret commands.  These are the documented commands only.
 void new_interpreter()
 {
   int i, j;
-  char filename[80];
+  char filename[MAX_CLI_LINE];
   int grid_num = 40;
   float grid_dist = 0.3;
 
   START_CLI ("stplace", "cli")
 
-    COMMAND ("vload file.vec") {
+    COMMAND ("vload file.vec (frame)") {
+      int frame = 0;
       get_parameter(filename);
-      vf = new VectorField(filename);
-      float_reg = vf->get_magnitude();
-      vf->normalize();
+      get_integer(&frame);
+      load_field(filename, frame);
     } COMMAND ("write_streamlines filename") {
       get_parameter(filename);
       if (taper_max > 0)
@@ -3261,6 +4153,92 @@ void new_interpreter()
       bundle->add_line(st);
     } COMMAND ("delta_step  value") {
       get_real(&delta_step);
+    } COMMAND ("footprint_cache  off/on") {
+      set_footprint_cache(get_boolean());
+    } COMMAND ("filter_type  table/hires/analytic") {
+      char name[MAX_CLI_LINE];
+      if (get_parameter(name)) {
+        int type;
+        for (type = FILTER_TABLE; type <= FILTER_ANALYTIC; type++)
+          if (strcmp(name, filter_type_name(type)) == 0)
+            break;
+        if (!set_filter_type(type))
+          printf("filter types are table, hires and analytic\n");
+      }
+      printf("filter type is %s\n", filter_type_name(get_filter_type()));
+    } COMMAND ("filter_benchmark  segments") {
+      int num = 0;
+      get_integer(&num);
+      if (num <= 0)
+        num = 100000;
+      filter_benchmark(num);
+    } COMMAND ("coarse_reject  off/on") {
+      coarse_reject = get_boolean();
+    } COMMAND ("coarse_margin  fraction") {
+      get_real(&coarse_margin);
+    } COMMAND ("verify_quality  iterations") {
+      get_integer(&verify_interval);
+    } COMMAND ("integrator  euler/midpoint/runge_kutta/rk45") {
+      char name[MAX_CLI_LINE];
+      if (get_parameter(name)) {
+        int type;
+        for (type = EULER; type <= RK45; type++)
+          if (strcmp(name, integration_name(type)) == 0)
+            break;
+        if (type <= RK45)
+          set_integration(type);
+        else
+          printf("integrators are euler, midpoint, runge_kutta and rk45\n");
+      }
+      printf("integrator is %s\n", integration_name(get_integration()));
+    } COMMAND ("integrator_tolerance  distance") {
+      float tol = get_integration_tolerance();
+      get_real(&tol);
+      set_integration_tolerance(tol);
+    } COMMAND ("integrator_benchmark  lines") {
+      int num = 0;
+      get_integer(&num);
+      if (num <= 0)
+        num = 200;
+      integration_benchmark(num, delta_step);
+    } COMMAND ("proposals  count") {
+      get_integer(&num_proposals);
+      if (num_proposals < 1)
+        num_proposals = 1;
+      if (num_proposals > MAX_PROPOSALS)
+        num_proposals = MAX_PROPOSALS;
+    } COMMAND ("resize_in_place  off/on") {
+      resize_in_place = get_boolean();
+    } COMMAND ("flow_map  resolution steps") {
+      get_integer(&flow_map_res);
+      get_integer(&flow_map_steps);
+    } COMMAND ("tile_cache  megabytes") {
+      float mb = get_tile_cache() / 1048576.0;
+      get_real(&mb);
+      set_tile_cache((long) (mb * 1048576));
+      printf("tile cache is %g megabytes\n", get_tile_cache() / 1048576.0);
+      FieldTiles *tiles = vf ? vf->get_tiles() : NULL;
+      if (tiles)
+        printf("%d tiles of %d cells kept, %ld decoded so far\n",
+               tiles->get_resident(), tiles->get_tile(), tiles->loads);
+    } COMMAND ("next_frame  file.vec  frame (iterations)") {
+      int frame = 0;
+      int num = 0;
+      get_parameter(filename);
+      get_integer(&frame);
+      get_integer(&num);
+      next_frame(filename, frame, num > 0 ? num : FRAME_ITERATIONS);
+    } COMMAND ("repel  (iterations)") {
+      int num = 0;
+      get_integer(&num);
+      if (num == 0)
+        repel(999999);
+      else
+        repel(num);
+    } COMMAND ("threads  number") {
+      int num = get_threads();
+      get_integer(&num);
+      printf("using %d threads\n", set_threads(num));
     } COMMAND ("quit") {
       printf("Bye-bye.\n");
       exit(0);
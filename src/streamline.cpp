@@ -62,9 +62,25 @@ Copy a streamline.
 
 Streamline *Streamline::copy()
 {
+  return (copy(vf));
+}
+
+
+/******************************************************************************
+Copy a streamline into another vector field, such as the next frame of a
+field that changes over time.  The copy starts from the same origin and has
+the same lengths, but follows the new field.
+
+Entry:
+  field - vector field for the copy to live in
+
+Exit:
+  returns the copy
+******************************************************************************/
 
-  set_taper(taper_head, taper_tail);
-  Streamline *st = new Streamline(vf, xorig, yorig, length1, length2, delta);
+Streamline *Streamline::copy(VectorField *field)
+{
+  Streamline *st = new Streamline(field, xorig, yorig, length1, length2, delta);
 
   st->frozen = frozen;
   st->label = label;
@@ -75,30 +91,37 @@ Streamline *Streamline::copy()
   st->arrow_width = arrow_width;
   st->arrow_steps = arrow_steps;
   st->intensity = intensity;
-  st->taper_head = taper_head;
-  st->taper_tail = taper_tail;
+  st->anim_index = anim_index;
+  st->retaper(taper_head, taper_tail);
 
   return (st);
 }
 
 
 /******************************************************************************
-Create a streamline.
+Set up a streamline to be created, short of following the field from its
+origin.
 
 Entry:
   field     - vector field in which streamline lives
   xx,yy     - starting point for streamline
   len1,len2 - lengths of streamline on either side of origin
   dlen      - step value along the streamline
+
+Exit:
+  samples1 - number of steps to take forward from the origin
+  samples2 - number of steps to take backward
 ******************************************************************************/
 
-void Streamline::streamline_creator(
+void Streamline::start_creation(
         VectorField *field,
         float xx,
         float yy,
         float len1,
         float len2,
-        float dlen
+        float dlen,
+        int &samples1,
+        int &samples2
 )
 {
   int i;
@@ -154,126 +177,483 @@ void Streamline::streamline_creator(
   taper_tail = taper_tail_default;
   tail_clipped = 0;
   head_clipped = 0;
+  pyramid_slot = -1;
+  join_slot = -1;
 
   /* values at pixels */
   num_values = 0;
-  max_values = 10;
-  values = new PixelValue[max_values];
+  max_values = 16;
+  values = pool_array<PixelValue>(max_values);
 
   /* determine spacing of sample points */
 
-  int samples1 = (int) (length1 / delta);
-  int samples2 = (int) (length2 / delta);
+  samples1 = (int) (length1 / delta);
+  samples2 = (int) (length2 / delta);
   delta = (length1 + length2) / (samples1 + samples2);
 
   samples = samples1 + samples2 + 1;
-  pts = new SamplePoint[samples];
+  alloc_points(samples);
 
-  /* calculate sample points along streamline */
+  xs(samples2) = xorig;
+  ys(samples2) = yorig;
+}
 
-  x = xorig;
-  y = yorig;
 
-  xs(samples2) = x;
-  ys(samples2) = y;
+/******************************************************************************
+Make room for a streamline's points.  The coordinates and intensities are
+kept in separate arrays, so that loops over the positions of the points
+don't drag the other values through the cache, but the arrays share one
+block from the pool.
 
-#define MIN_STEP 0.2
+Entry:
+  num - number of points to make room for
+******************************************************************************/
 
-  /* step forward */
+void Streamline::alloc_points(int num)
+{
+  int count = 3 * num;
 
-  int count1 = 0;
-  for (i = 0; i < samples1; i++) {
+  xpts = pool_array<float>(count);
+  max_pts = count / 3;
+  ypts = xpts + max_pts;
+  ipts = ypts + max_pts;
+}
 
-    float slen = vf->integrate(x, y, delta, 0, x, y);
-    if (slen < MIN_STEP)
-      break;
 
-    xs(samples2 + i + 1) = x;
-    ys(samples2 + i + 1) = y;
-    count1++;
+/******************************************************************************
+Finish creating a streamline once the field has been followed from its
+origin.
+
+Entry:
+  samples1, samples2 - number of steps that were to be taken forward and
+                       backward
+  count1, count2     - number of steps actually taken forward and backward
+******************************************************************************/
 
-    /* clip to screen */
-    if (x < 0 || x > 1 || y < 0 || y > vf->getaspect()) {
-      set_clip_window(0.0, 1.0, 0.0, vf->getaspect());
-      float x0 = xs(samples2 + i);
-      float y0 = ys(samples2 + i);
-// printf ("clip #1 before: %f %f %f %f\n", x0, y0, x, y);
-      clip_line(x0, y0, x, y);
-// printf ("clip #1  after: %f %f %f %f\n", x0, y0, x, y);
-// printf ("\n");
-      xs(samples2 + i + 1) = x;
-      ys(samples2 + i + 1) = y;
-      head_clipped = 1;
-      break;  /* we're off the screen, so don't extend streamline further */
+void Streamline::end_creation(int samples1, int samples2, int count1, int count2)
+{
+  int i;
+
+  head_short = (count1 < samples1);
+  tail_short = (count2 < samples2);
+
+  /* compute number of samples, taking into account the portions of */
+  /* the streamline that may have been clipped */
+
+  samples = count1 + count2 + 1;
+  origin_pt = count2;
+
+  /* may have to shift the sample points */
+
+  int diff2 = samples2 - count2;
+  if (diff2 > 0)
+    for (i = 0; i < samples; i++) {
+      xs(i) = xs(i + diff2);
+      ys(i) = ys(i + diff2);
     }
+
+  int smp = samples - 1;
+  if (xs(0) < 0 || xs(0) > 1 || ys(0) < 0 || ys(0) > vf->getaspect() ||
+      xs(smp) < 0 || xs(smp) > 1 || ys(smp) < 0 || ys(smp) > vf->getaspect()) {
+    printf("origin: %f %f\n", xorig, yorig);
+    printf("ends:   %f %f %f %f\n", xs(0), ys(0), xs(smp), ys(smp));
+    printf("\n");
   }
 
-  /* step backwards */
+  /* compute intensity tapering */
 
-  x = xorig;
-  y = yorig;
+  retaper(taper_head, taper_tail);
+}
+
+
+#define MIN_STEP 0.2
+
+/******************************************************************************
+Follow the field from one of the sample points to find more of them, either
+forward towards the head or backward towards the tail.  This stops early if
+the field gets too weak or the streamline leaves the screen, in which case
+the last point is clipped to the screen.
+
+Entry:
+  from  - index of the sample point to start from
+  steps - most steps to take
+  dir   - 1 to go forward, -1 to go backward
+
+Exit:
+  returns the number of points found
+******************************************************************************/
+
+int Streamline::trace(int from, int steps, int dir)
+{
+  float x = xs(from);
+  float y = ys(from);
+  int count = 0;
 
-  int count2 = 0;
-  for (i = samples2 - 1; i >= 0; i--) {
+  FieldTracer tracer(vf, x, y, dir * delta);
 
-    float slen = vf->integrate(x, y, -delta, 0, x, y);
+  for (int i = from + dir; count < steps; i += dir) {
+
+    float slen = tracer.step(x, y);
     if (slen < MIN_STEP)
       break;
 
     xs(i) = x;
     ys(i) = y;
-    count2++;
+    count++;
 
     /* clip to screen */
     if (x < 0 || x > 1 || y < 0 || y > vf->getaspect()) {
       set_clip_window(0.0, 1.0, 0.0, vf->getaspect());
-      float x0 = xs(i + 1);
-      float y0 = ys(i + 1);
-// printf ("clip #2 before: %f %f %f %f\n", x0, y0, x, y);
+      float x0 = xs(i - dir);
+      float y0 = ys(i - dir);
       clip_line(x0, y0, x, y);
-// printf ("clip #2  after: %f %f %f %f\n", x0, y0, x, y);
-// printf ("\n");
       xs(i) = x;
       ys(i) = y;
-      tail_clipped = 1;
+      if (dir == 1)
+        head_clipped = 1;
+      else
+        tail_clipped = 1;
       break;  /* we're off the screen, so don't extend streamline further */
     }
   }
 
-  /* compute number of samples, taking into account the portions of */
-  /* the streamline that may have been clipped */
+  return (count);
+}
 
-  samples = count1 + count2 + 1;
 
-  /* may have to shift the sample points */
+/******************************************************************************
+Create a streamline.
 
-  int diff2 = samples2 - count2;
-  if (diff2 > 0)
-    for (i = 0; i < samples; i++) {
-      xs(i) = xs(i + diff2);
-      ys(i) = ys(i + diff2);
+Entry:
+  field     - vector field in which streamline lives
+  xx,yy     - starting point for streamline
+  len1,len2 - lengths of streamline on either side of origin
+  dlen      - step value along the streamline
+******************************************************************************/
+
+void Streamline::streamline_creator(
+        VectorField *field,
+        float xx,
+        float yy,
+        float len1,
+        float len2,
+        float dlen
+)
+{
+  int samples1, samples2;
+
+  start_creation(field, xx, yy, len1, len2, dlen, samples1, samples2);
+
+  /* calculate sample points along streamline */
+
+  int count1 = trace(samples2, samples1, 1);
+  int count2 = trace(samples2, samples2, -1);
+
+  end_creation(samples1, samples2, count1, count2);
+}
+
+
+/******************************************************************************
+Make a copy of a streamline with different lengths on either side of its
+origin.  The sample points that the two have in common are copied rather
+than found again, and only the new parts at either end are integrated, so
+that the footprints of the segments that didn't change can be found in the
+footprint cache.  Unlike a streamline created from scratch, the copy keeps
+the origin and spacing of the points of the original.
+
+That is only the same as creating the streamline afresh if the ends that
+change reached their full lengths.  An end cut short by the edge of the
+screen or by a weak field would instead move the origin, and with it the
+whole streamline, so such changes are left to the caller.
+
+Entry:
+  len1,len2 - new lengths of streamline on either side of origin
+
+Exit:
+  returns the new streamline, or NULL if it must be created from scratch
+******************************************************************************/
+
+Streamline *Streamline::resized(float len1, float len2)
+{
+  if ((head_short && len1 != length1) || (tail_short && len2 != length2))
+    return (NULL);
+
+  /* an end whose length doesn't change keeps all of its points; the */
+  /* others get the nearest whole number of steps, since the spacing */
+  /* can't be stretched to fit as it is for a new streamline */
+
+  int samples1 = (len1 == length1) ? samples - 1 - origin_pt
+                                   : (int) (len1 / delta + 0.5);
+  int samples2 = (len2 == length2) ? origin_pt
+                                   : (int) (len2 / delta + 0.5);
+
+  if (samples1 + samples2 == 0)
+    return (NULL);
+
+  Streamline *st = new Streamline();
+  *st = *this;
+
+  st->length1 = len1;
+  st->length2 = len2;
+  st->pyramid_slot = -1;
+  st->join_slot = -1;
+
+  st->num_values = 0;
+  st->max_values = 16;
+  st->values = pool_array<PixelValue>(st->max_values);
+
+  st->samples = samples1 + samples2 + 1;
+  st->alloc_points(st->samples);
+
+  /* copy the points that are kept */
+
+  int kept1 = samples - 1 - origin_pt;
+  int kept2 = origin_pt;
+
+  if (kept1 > samples1)
+    kept1 = samples1;
+  if (kept2 > samples2)
+    kept2 = samples2;
+
+  for (int i = -kept2; i <= kept1; i++) {
+    st->xpts[samples2 + i] = xpts[origin_pt + i];
+    st->ypts[samples2 + i] = ypts[origin_pt + i];
+  }
+
+  /* an end that changes length no longer reaches where it was clipped, */
+  /* unless tracing it clips it again */
+
+  if (len1 != length1)
+    st->head_clipped = 0;
+  if (len2 != length2)
+    st->tail_clipped = 0;
+
+  /* extend the ends that are to be longer */
+
+  int count1 = kept1 + st->trace(samples2 + kept1, samples1 - kept1, 1);
+  int count2 = kept2 + st->trace(samples2 - kept2, samples2 - kept2, -1);
+
+  st->end_creation(samples1, samples2, count1, count2);
+
+  /* an end that was left alone may still have been cut short */
+
+  if (len1 == length1)
+    st->head_short = head_short;
+  if (len2 == length2)
+    st->tail_short = tail_short;
+
+  return (st);
+}
+
+
+/* one end of a streamline being followed by create_batch() */
+
+class BatchLane
+{
+  public:
+    Streamline *st;       /* streamline being created */
+    int dir;              /* 1 going forward from the origin, -1 backward */
+    int next;             /* index of the next point to set */
+    int left;             /* steps still to take */
+    int *count;           /* steps taken so far in this direction */
+};
+
+
+/******************************************************************************
+Create a group of streamlines at once, for create_batch().  The ends of all
+the streamlines are followed through the field in lockstep, a step at a
+time, so that the field is sampled at many points in one go.  Each end drops
+out of the group when it reaches its length, the field gets too weak or it
+leaves the screen, just as when creating one streamline.
+
+Entry:
+  field - vector field in which the streamlines live
+  num   - number of streamlines to create, at most CREATE_GROUP
+  x,y   - starting points of the streamlines
+  len   - lengths of the streamlines
+  dlen  - step value along the streamlines
+
+Exit:
+  lines - the new streamlines
+******************************************************************************/
+
+void Streamline::create_group(
+        VectorField *field,
+        int num,
+        float *x,
+        float *y,
+        float *len,
+        float dlen,
+        Streamline **lines
+)
+{
+  int i, k;
+  int samples1[CREATE_GROUP];
+  int samples2[CREATE_GROUP];
+  int count1[CREATE_GROUP];
+  int count2[CREATE_GROUP];
+
+  BatchLane lanes[2 * CREATE_GROUP];
+  float lx[2 * CREATE_GROUP];
+  float ly[2 * CREATE_GROUP];
+  float ldt[2 * CREATE_GROUP];
+  float llen[2 * CREATE_GROUP];
+  int active = 0;
+
+  /* set up the streamlines, and an end to follow for each direction */
+  /* that has steps to take */
+
+  for (i = 0; i < num; i++) {
+
+    Streamline *st = new Streamline();
+    st->start_creation(field, x[i], y[i], len[i] * 0.5, len[i] * 0.5, dlen,
+                       samples1[i], samples2[i]);
+    lines[i] = st;
+    count1[i] = count2[i] = 0;
+
+    for (int dir = 1; dir >= -1; dir -= 2) {
+      int steps = (dir == 1) ? samples1[i] : samples2[i];
+      if (steps == 0)
+        continue;
+      BatchLane *lane = &lanes[active];
+      lane->st = st;
+      lane->dir = dir;
+      lane->next = samples2[i] + dir;
+      lane->left = steps;
+      lane->count = (dir == 1) ? &count1[i] : &count2[i];
+      lx[active] = st->xorig;
+      ly[active] = st->yorig;
+      ldt[active] = dir * st->delta;
+      active++;
     }
+  }
 
-  int smp = samples - 1;
-  if (xs(0) < 0 || xs(0) > 1 || ys(0) < 0 || ys(0) > vf->getaspect() ||
-      xs(smp) < 0 || xs(smp) > 1 || ys(smp) < 0 || ys(smp) > vf->getaspect()) {
-    printf("origin: %f %f\n", xx, yy);
-    printf("ends:   %f %f %f %f\n", xs(0), ys(0), xs(smp), ys(smp));
-    printf("\n");
+  float aspect = field->getaspect();
+  set_clip_window(0.0, 1.0, 0.0, aspect);
+
+  /* step all the ends that are still going */
+
+  while (active > 0) {
+
+    field->integrate_batch(active, lx, ly, ldt, 0, llen);
+
+    /* go backwards, so that a finished end can be replaced by */
+    /* the last one, which has already been looked at */
+
+    for (k = active - 1; k >= 0; k--) {
+
+      BatchLane *lane = &lanes[k];
+      Streamline *st = lane->st;
+      int done = 0;
+
+      if (llen[k] < MIN_STEP)
+        done = 1;
+      else {
+
+        st->xs(lane->next) = lx[k];
+        st->ys(lane->next) = ly[k];
+        (*lane->count)++;
+
+        /* clip to screen */
+        if (lx[k] < 0 || lx[k] > 1 || ly[k] < 0 || ly[k] > aspect) {
+          float x0 = st->xs(lane->next - lane->dir);
+          float y0 = st->ys(lane->next - lane->dir);
+          clip_line(x0, y0, lx[k], ly[k]);
+          st->xs(lane->next) = lx[k];
+          st->ys(lane->next) = ly[k];
+          if (lane->dir == 1)
+            st->head_clipped = 1;
+          else
+            st->tail_clipped = 1;
+          done = 1;
+        }
+
+        lane->next += lane->dir;
+        if (--lane->left == 0)
+          done = 1;
+      }
+
+      if (done) {
+        active--;
+        lanes[k] = lanes[active];
+        lx[k] = lx[active];
+        ly[k] = ly[active];
+        ldt[k] = ldt[active];
+      }
+    }
   }
 
-  /* compute intensity tapering */
+  for (i = 0; i < num; i++)
+    lines[i]->end_creation(samples1[i], samples2[i], count1[i], count2[i]);
+}
+
+
+/******************************************************************************
+Create many streamlines at once, in groups small enough that the ends being
+followed together stay in the cache.  The results are the same as creating
+the streamlines one by one.  The adaptive integrator and the flow map don't
+step in lockstep, so with them the streamlines simply are created one by one.
+
+Entry:
+  field - vector field in which the streamlines live
+  num   - number of streamlines to create
+  x,y   - starting points of the streamlines
+  len   - lengths of the streamlines
+  dlen  - step value along the streamlines
+
+Exit:
+  lines - the new streamlines
+******************************************************************************/
+
+void Streamline::create_batch(
+        VectorField *field,
+        int num,
+        float *x,
+        float *y,
+        float *len,
+        float dlen,
+        Streamline **lines
+)
+{
+  if (get_integration() == RK45 || field->get_flow_map()) {
+    for (int i = 0; i < num; i++)
+      lines[i] = new Streamline(field, x[i], y[i], len[i], dlen);
+    return;
+  }
 
-  for (i = 0; i < samples; i++) {
+  for (int start = 0; start < num; start += CREATE_GROUP) {
+    int count = num - start;
+    if (count > CREATE_GROUP)
+      count = CREATE_GROUP;
+    create_group(field, count, x + start, y + start, len + start, dlen,
+                 lines + start);
+  }
+}
+
+
+/******************************************************************************
+Change how the intensity of a streamline tapers off at its ends.
+
+Entry:
+  head - fraction of the streamline's length over which the head tapers
+  tail - same for the tail
+******************************************************************************/
+
+void Streamline::retaper(float head, float tail)
+{
+  taper_head = head;
+  taper_tail = tail;
+
+  for (int i = 0; i < samples; i++) {
     float t = i / (samples - 1.0);
     if (t < taper_tail) {
       t = t / taper_tail;
-      pts[i].intensity = t;
+      ipts[i] = t;
     } else if (1 - t < taper_head) {
       t = (1 - t) / taper_head;
-      pts[i].intensity = t;
+      ipts[i] = t;
     } else
-      pts[i].intensity = 1.0;
+      ipts[i] = 1.0;
   }
 }
 
@@ -462,7 +842,7 @@ void Streamline::draw_tapered(Window2d *win)
     float x = xs(i);
     float y = ys(i);
 
-    win->set_color_index ((int) (255 * pts[i].intensity));
+    win->set_color_index ((int) (255 * ipts[i]));
     win->line (x, y, x_old, y_old);
 
     x_old = x;
@@ -514,7 +894,7 @@ void Streamline::draw_helper(Window2d *win, int color_change_flag)
     float x = xs(i);
     float y = ys(i);
     if (color_change_flag)
-      win->set_color_index((int) (255 * intensity * pts[i].intensity));
+      win->set_color_index((int) (255 * intensity * ipts[i]));
     win->thick_line(x, y, x_old, y_old, (int) thickness_default);
     x_old = x;
     y_old = y;
@@ -762,10 +1142,10 @@ void Streamline::draw_fancy_arrow(
 
   win->polygon_fill();
 
-  delete xverts1;
-  delete yverts1;
-  delete xverts2;
-  delete yverts2;
+  delete[] xverts1;
+  delete[] yverts1;
+  delete[] xverts2;
+  delete[] yverts2;
 }
 
 
@@ -882,10 +1262,10 @@ void Streamline::draw_fancy_arrow_ps(
   *file_out << xorig << " " << yorig << " lineto" << endl;
   *file_out << " closepath fill" << endl;
 
-  delete xverts1;
-  delete yverts1;
-  delete xverts2;
-  delete yverts2;
+  delete[] xverts1;
+  delete[] yverts1;
+  delete[] xverts2;
+  delete[] yverts2;
 }
 
 
@@ -1013,8 +1393,8 @@ int Streamline::search_on_streamline(float dist, float &xout, float &yout)
     return (1);
 
   float fract = (dist - lens[pos - 1]) / (lens[pos] - lens[pos - 1]);
-  xout = pts[pos - 1].x + fract * (pts[pos].x - pts[pos - 1].x);
-  yout = pts[pos - 1].y + fract * (pts[pos].y - pts[pos - 1].y);
+  xout = xpts[pos - 1] + fract * (xpts[pos] - xpts[pos - 1]);
+  yout = ypts[pos - 1] + fract * (ypts[pos] - ypts[pos - 1]);
 
   return (0);
 }
@@ -1184,8 +1564,8 @@ void Streamline::variable_draw_dashed(
 
   len_sum = 0;
   for (i = 1; i < samples; i++) {
-    float dx = pts[i].x - pts[i - 1].x;
-    float dy = pts[i].y - pts[i - 1].y;
+    float dx = xpts[i] - xpts[i - 1];
+    float dy = ypts[i] - ypts[i - 1];
     float len = sqrt(dx * dx + dy * dy);
     len_sum += len;
     lens[i] = len_sum;
@@ -1198,12 +1578,12 @@ void Streamline::variable_draw_dashed(
   if (file_out == NULL) {
     win->gray_ramp();
     win->set_color_index(100);
-    xold = pts[0].x;
-    yold = pts[0].y;
+    xold = xpts[0];
+    yold = ypts[0];
 
     for (i = 1; i < samples; i++) {
-      x = pts[i].x;
-      y = pts[i].y;
+      x = xpts[i];
+      y = ypts[i];
       win->line(x, y, xold, yold);
       xold = x;
       yold = y;
@@ -1341,7 +1721,7 @@ void Streamline::variable_draw_dashed(
 
   here:
 
-  delete lens;
+  delete[] lens;
 
   win->flush();
 }
@@ -1378,8 +1758,8 @@ void Streamline::draw_dashed(
   /* compute the lengths of all the tiny segments between the point samples */
 
   for (i = 1; i < samples; i++) {
-    float dx = pts[i].x - pts[i - 1].x;
-    float dy = pts[i].y - pts[i - 1].y;
+    float dx = xpts[i] - xpts[i - 1];
+    float dy = ypts[i] - ypts[i - 1];
     float len = sqrt(dx * dx + dy * dy);
     len_sum += len;
     lens[i] = len_sum;
@@ -1407,15 +1787,15 @@ void Streamline::draw_dashed(
       pos++;
 
     fract = (start - lens[pos - 1]) / (lens[pos] - lens[pos - 1]);
-    float x1 = pts[pos - 1].x + fract * (pts[pos].x - pts[pos - 1].x);
-    float y1 = pts[pos - 1].y + fract * (pts[pos].y - pts[pos - 1].y);
+    float x1 = xpts[pos - 1] + fract * (xpts[pos] - xpts[pos - 1]);
+    float y1 = ypts[pos - 1] + fract * (ypts[pos] - ypts[pos - 1]);
 
     while (lens[pos] < end)
       pos++;
 
     fract = (end - lens[pos - 1]) / (lens[pos] - lens[pos - 1]);
-//    float x2 = pts[pos-1].x + fract * (pts[pos].x - pts[pos-1].x);
-//    float y2 = pts[pos-1].y + fract * (pts[pos].y - pts[pos-1].y);
+//    float x2 = xpts[pos-1] + fract * (xpts[pos] - xpts[pos-1]);
+//    float y2 = ypts[pos-1] + fract * (ypts[pos] - ypts[pos-1]);
 
 //    win->line (x1, y1, x2, y2);
 
@@ -1438,7 +1818,7 @@ void Streamline::draw_dashed(
 
   }
 
-  delete lens;
+  delete[] lens;
 }
 
 
@@ -1454,15 +1834,16 @@ Entry:
 void Streamline::add_value(int i, int j, float value)
 {
   if (num_values >= max_values - 1) {
-    PixelValue *temp = new PixelValue[max_values * 2];
-    for (int i = 0; i < max_values; i++) {
+    int new_max = max_values * 2;
+    PixelValue *temp = pool_array<PixelValue>(new_max);
+    for (int i = 0; i < num_values; i++) {
       temp[i].i = values[i].i;
       temp[i].j = values[i].j;
       temp[i].value = values[i].value;
     }
-    delete values;
+    pool_release(values, max_values);
     values = temp;
-    max_values *= 2;
+    max_values = new_max;
   }
 
   values[num_values].i = i;
@@ -1521,7 +1902,7 @@ void Streamline::write_postscript(ofstream *file_out)
     }
 
     if (taper_head != 0.0 || taper_tail != 0.0) {
-      width *= pts[i].intensity;
+      width *= ipts[i];
       set_width = 1;
     }
 
@@ -1604,6 +1985,27 @@ Bundle *Bundle::copy()
 }
 
 
+/******************************************************************************
+Return a copy of a bundle whose streamlines follow another vector field
+from the same origins.
+
+Entry:
+  field - vector field for the copies to live in
+******************************************************************************/
+
+Bundle *Bundle::copy(VectorField *field)
+{
+  Bundle *bundle = new Bundle();
+
+  for (int i = 0; i < num_lines; i++) {
+    Streamline *st = lines[i]->copy(field);
+    bundle->add_line(st);
+  }
+
+  return (bundle);
+}
+
+
 /******************************************************************************
 Perform one or more sorting passes on the streamlines based on the quality.
 
@@ -1726,6 +2128,7 @@ void Bundle::add_line(Streamline *st)
     Streamline **temp = new Streamline *[max_lines];
     for (int i = 0; i < num_lines; i++)
       temp[i] = lines[i];
+    delete[] lines;
     lines = temp;
   }
 
@@ -1769,7 +2172,7 @@ FloatImage *Bundle::filtered_render(int xsize, int ysize, float radius)
   for (int i = 0; i < num_lines; i++) {
     Streamline *st = lines[i];
     for (int j = 0; j < st->samples - 1; j++) {
-      float taper_scale = 0.5 * (st->pts[j].intensity + st->pts[j + 1].intensity);
+      float taper_scale = 0.5 * (st->ipts[j] + st->ipts[j + 1]);
       low->filter_segment(st->xs(j), st->ys(j), st->xs(j + 1), st->ys(j + 1),
                           taper_scale);
     }
@@ -1798,7 +2201,7 @@ void Bundle::write_pgm(char *filename, int xsize, int ysize)
   for (int i = 0; i < num_lines; i++) {
     Streamline *st = lines[i];
     for (int j = 0; j < st->samples - 1; j++) {
-      float taper_scale = 0.5 * (st->pts[j].intensity + st->pts[j + 1].intensity);
+      float taper_scale = 0.5 * (st->ipts[j] + st->ipts[j + 1]);
       low->filter_segment(st->xs(j), st->ys(j), st->xs(j + 1), st->ys(j + 1),
                           taper_scale);
     }
@@ -23,6 +23,7 @@ warranty of merchantability or fitness for a particular purpose.
 #include "vfield.h"
 #include "../libs/window.h"
 #include "../libs/floatimage.h"
+#include "pool.h"
 
 using namespace std;
 
@@ -41,15 +42,15 @@ public:
 #define LEFT  4
 #define RIGHT 5
 
+/* a point of a streamline, as entered in a table of nearby points; the */
+/* streamline itself keeps its points as separate arrays of coordinates */
+
 class SamplePoint
 {
 public:
     float x, y;           /* position of sample point */
-    SamplePoint *next;   /* next point in linked list */
-    Streamline *st;
-    unsigned char which_end;
-    float intensity;
-    float len_pos;       /* how far along streamline? (for intensity taper) */
+    Streamline *st;       /* streamline the point is on */
+    unsigned char which_end;  /* HEAD, TAIL or neither */
 };
 
 class Streamline
@@ -61,7 +62,12 @@ class Streamline
     float length2;        /* backward length */
     float delta;          /* step size factor */
     int samples;          /* number of points representing the streamline */
-    SamplePoint *pts;     /* the points along the streamline */
+    int origin_pt;        /* which of the points is the origin */
+    int head_short;       /* did the head stop short of its length? */
+    int tail_short;       /* did the tail? */
+    float *xpts, *ypts;   /* the points along the streamline */
+    float *ipts;          /* intensity at each point, for tapering */
+    int max_pts;          /* room for points in the arrays above */
     PixelValue *values;   /* pixel differences that we cause to lowpass image */
     int max_values;       /* memory allocated to values */
     int list_index;       /* where we are in lowpass image bundle */
@@ -77,11 +83,28 @@ class Streamline
     int end_reduction;    /* reduction of length at end, fr drawing */
     float intensity;      /* how bright to draw it */
 
+    Streamline() {}       /* left unset, for create_batch() to fill in */
+
+    void start_creation(VectorField *, float, float, float, float, float,
+                        int &, int &);
+
+    void end_creation(int, int, int, int);
+
+    void alloc_points(int);
+
+    int trace(int, int, int);
+
+    static void create_group(VectorField *, int, float *, float *, float *,
+                             float, Streamline **);
+
 public:
 
     int frozen;           /* a frozen streamline is one that isn't to be moved */
     int num_values;       /* current number of values */
     int anim_index;       /* index number for animation */
+    int pyramid_slot;     /* where we are in a lowpass pyramid, or -1 */
+    int join_slot;        /* where our endpoints are in a table for */
+                          /* joining, or -1 */
 
     float taper_head;     /* intensity tapering at head */
     float taper_tail;     /* intensity tapering at tail */
@@ -96,12 +119,23 @@ public:
 
     void streamline_creator(VectorField *, float, float, float, float, float);
 
+    static void create_batch(VectorField *, int, float *, float *, float *,
+                             float, Streamline **);
+
     ~Streamline()
     {
-      delete values;
-      delete pts;
+      pool_release(values, max_values);
+      pool_release(xpts, 3 * max_pts);
     }
 
+    /* streamlines come and go constantly, so keep them in a pool */
+
+    static void *operator new(size_t bytes)
+    { return (pool_alloc(bytes)); }
+
+    static void operator delete(void *ptr, size_t bytes)
+    { pool_free(ptr, bytes); }
+
     void draw(Window2d *);
 
     void draw_for_taper(Window2d *);
@@ -146,14 +180,14 @@ public:
 
     void get_head(float &x, float &y)
     {
-      x = pts[samples - 1].x;
-      y = pts[samples - 1].y;
+      x = xpts[samples - 1];
+      y = ypts[samples - 1];
     }
 
     void get_tail(float &x, float &y)
     {
-      x = pts[0].x;
-      y = pts[0].y;
+      x = xpts[0];
+      y = ypts[0];
     }
 
     float get_length()
@@ -168,6 +202,8 @@ public:
       tail = taper_tail;
     }
 
+    void retaper(float, float);
+
     void get_lengths(float &len1, float &len2)
     {
       len1 = length1;
@@ -175,12 +211,15 @@ public:
     }
 
     Streamline *copy();
+    Streamline *copy(VectorField *);
+
+    Streamline *resized(float, float);
 
     float &xs(int index)
-    { return pts[index].x; }
+    { return xpts[index]; }
 
     float &ys(int index)
-    { return pts[index].y; }
+    { return ypts[index]; }
 
     int get_samples()
     { return (samples); }
@@ -192,8 +231,12 @@ public:
     friend class Lowpass;
 
     friend class RepelTable;
+
+    friend class LowpassPyramid;
 };
 
+#define CREATE_GROUP 32   /* streamlines followed together by create_batch() */
+
 /* routines that set default streamline parameters */
 
 void set_reduction(int, int);
@@ -233,7 +276,7 @@ public:
 
     ~Bundle()
     {
-      delete lines;
+      delete[] lines;
     }
 
     void add_line(Streamline *);
@@ -241,6 +284,7 @@ public:
     void delete_line(Streamline *);
 
     Bundle *copy();
+    Bundle *copy(VectorField *);
 
     Streamline *get_line(int index)
     { return (lines[index]); }
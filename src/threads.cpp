@@ -0,0 +1,206 @@
+/*
+
+A pool of worker threads for running independent jobs in parallel.
+
+The workers are started when the number of threads is set, and sleep until
+parallel_for() hands them a set of jobs.  The calling thread works on the
+jobs too, as thread number zero.  Jobs are handed out one at a time from a
+shared counter, so which thread runs which job changes from run to run;
+callers that want repeatable results must not let a job's outcome depend
+on the thread that runs it, other than through per-thread scratch space.
+
+---------------------------------------------------------------------
+
+Copyright (c) 1996 The University of North Carolina.  All rights reserved.
+
+Permission to use, copy, modify and distribute this software and its
+documentation for any purpose is hereby granted without fee, provided
+that the above copyright notice and this permission notice appear in
+all copies of this software and that you do not sell the software.
+
+The software is provided "as is" and without warranty of any kind,
+express, implied or otherwise, including without limitation, any
+warranty of merchantability or fitness for a particular purpose.
+
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "threads.h"
+
+static int num_threads = 1;             /* number of threads, main included */
+static std::thread *workers[MAX_THREADS];
+
+static std::mutex lock;
+static std::condition_variable wake;    /* signals a new set of jobs */
+static std::condition_variable done;    /* signals that workers are idle */
+static unsigned long generation = 0;    /* count of sets of jobs */
+static int quitting = 0;                /* tells the workers to exit */
+static int busy = 0;                    /* workers still on this set */
+
+/* the current set of jobs */
+static void (*job)(int, int, void *);
+static void *job_arg;
+static int job_count;
+static std::atomic<int> next_job;
+
+
+/******************************************************************************
+Run jobs from the current set until there are none left.
+
+Entry:
+  thread - number of the thread doing the jobs
+******************************************************************************/
+
+static void run_jobs(int thread)
+{
+  int n;
+
+  while ((n = next_job++) < job_count)
+    job(n, thread, job_arg);
+}
+
+
+/******************************************************************************
+The body of a worker thread.
+
+Entry:
+  thread - number of this thread, from 1 up
+******************************************************************************/
+
+static void worker_main(int thread)
+{
+  unsigned long seen = 0;
+
+  for (;;) {
+
+    /* wait for a new set of jobs */
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      wake.wait(guard, [&] { return (quitting || generation != seen); });
+      if (quitting)
+        return;
+      seen = generation;
+    }
+
+    run_jobs(thread);
+
+    /* let the main thread know when everyone is finished */
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if (--busy == 0)
+        done.notify_one();
+    }
+  }
+}
+
+
+/******************************************************************************
+Stop the workers when the program exits, since they can't be left waiting
+on a condition variable that is being destroyed.
+******************************************************************************/
+
+static void stop_workers()
+{
+  set_threads(1);
+}
+
+
+/******************************************************************************
+Set the number of threads to use, starting or stopping workers as needed.
+
+Entry:
+  num - number of threads, including the main one
+
+Exit:
+  returns the number of threads actually used
+******************************************************************************/
+
+int set_threads(int num)
+{
+  if (num < 1)
+    num = 1;
+  if (num > MAX_THREADS)
+    num = MAX_THREADS;
+
+  /* stop the old workers */
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    quitting = 1;
+  }
+  wake.notify_all();
+
+  for (int i = 1; i < num_threads; i++) {
+    workers[i]->join();
+    delete workers[i];
+  }
+
+  quitting = 0;
+  num_threads = num;
+
+  /* start new ones */
+
+  static int at_exit = 0;
+  if (num_threads > 1 && !at_exit) {
+    atexit(stop_workers);
+    at_exit = 1;
+  }
+
+  for (int i = 1; i < num_threads; i++)
+    workers[i] = new std::thread(worker_main, i);
+
+  return (num_threads);
+}
+
+
+/******************************************************************************
+Return the number of threads in use, including the main one.
+******************************************************************************/
+
+int get_threads()
+{
+  return (num_threads);
+}
+
+
+/******************************************************************************
+Run a number of jobs in parallel, and wait for them all to finish.
+
+Entry:
+  num - number of jobs
+  fn  - function that runs a job, given the job's number, the number of
+        the thread running it (zero to get_threads() - 1) and arg
+  arg - passed along to fn
+******************************************************************************/
+
+void parallel_for(int num, void (*fn)(int, int, void *), void *arg)
+{
+  job = fn;
+  job_arg = arg;
+  job_count = num;
+  next_job = 0;
+
+  if (num_threads == 1) {
+    run_jobs(0);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    busy = num_threads - 1;
+    generation++;
+  }
+  wake.notify_all();
+
+  run_jobs(0);
+
+  std::unique_lock<std::mutex> guard(lock);
+  done.wait(guard, [] { return (busy == 0); });
+}
+
@@ -0,0 +1,31 @@
+//
+//  A pool of worker threads for running independent jobs in parallel
+//
+
+/*
+Copyright (c) 1996 The University of North Carolina.  All rights reserved.
+
+Permission to use, copy, modify and distribute this software and its
+documentation for any purpose is hereby granted without fee, provided
+that the above copyright notice and this permission notice appear in
+all copies of this software and that you do not sell the software.
+
+The software is provided "as is" and without warranty of any kind,
+express, implied or otherwise, including without limitation, any
+warranty of merchantability or fitness for a particular purpose.
+*/
+
+
+#ifndef _THREADS_
+#define _THREADS_
+
+#define MAX_THREADS 64   /* most threads, the main one included */
+
+int set_threads(int);
+
+int get_threads();
+
+void parallel_for(int, void (*)(int, int, void *), void *);
+
+#endif /* _THREADS_ */
+
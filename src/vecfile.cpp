@@ -0,0 +1,796 @@
+/*
+
+Reading the header of a .vec file and mapping the file into memory.
+
+A .vec file is a short text header ("VF", the x, y and z sizes, and the
+rank, on three lines) followed by the vectors.  Rather than reading the
+vectors into memory, the whole file is mapped, so that a large field is
+ready almost at once and its pages are shared with any other program that
+has the same file open.  Headers are written padded out so that the
+vectors after them are aligned; older files whose vectors aren't must be
+copied out of the mapping instead.
+
+The vectors were always 32-bit floats, but can also be stored as 16-bit
+half floats or 8-bit minifloats to make files smaller.  A file that isn't
+in floats says so with a version number after the "VF" and the name of
+its encoding after the rank:
+
+  VF2
+  256 256 1
+  2 f16
+
+Files in floats are still written without a version, as before, so that
+older programs can read them.
+
+A field too large to fit in memory is better stored in square tiles, so
+that the vectors near any one place are together in the file.  Version 3
+gives the number of cells on a side of each tile after the encoding:
+
+  VF3
+  32768 32768 1
+  2 f16 tiles 256
+
+Tiles go across and then down the field, and each holds its vectors row by
+row.  A tile of T cells holds T + 1 vectors on a side, sharing its last row
+and column with the tiles beyond it, so that the four corners of any cell
+are all in one tile.  Tiles at the far edges are padded out with zeros.
+
+---------------------------------------------------------------------
+
+Copyright (c) 1996 The University of North Carolina.  All rights reserved.
+
+Permission to use, copy, modify and distribute this software and its
+documentation for any purpose is hereby granted without fee, provided
+that the above copyright notice and this permission notice appear in
+all copies of this software and that you do not sell the software.
+
+The software is provided "as is" and without warranty of any kind,
+express, implied or otherwise, including without limitation, any
+warranty of merchantability or fitness for a particular purpose.
+
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "vecfile.h"
+#include "HalfFloat.h"
+#include "MiniFloat2.h"
+
+
+static void decode_f32(const char *, float *, size_t);
+static void encode_f32(const float *, char *, size_t);
+static void decode_f16(const char *, float *, size_t);
+static void encode_f16(const float *, char *, size_t);
+static void decode_f8(const char *, float *, size_t);
+static void encode_f8(const float *, char *, size_t);
+
+/* the ways of storing the vectors, in the order of their VEC_ numbers */
+
+class VecEncoding
+{
+  public:
+    const char *name;   /* as given in the header */
+    int size;           /* bytes for each component */
+    void (*decode)(const char *, float *, size_t);
+    void (*encode)(const float *, char *, size_t);
+};
+
+static const VecEncoding encodings[VEC_ENCODINGS] = {
+  {"f32", 4, decode_f32, encode_f32},
+  {"f16", 2, decode_f16, encode_f16},
+  {"f8", 1, decode_f8, encode_f8},
+};
+
+/* every minifloat's value, and the values in increasing order along with */
+/* the minifloat for each, for finding the nearest one to a float */
+
+static float mini_values[256];
+static float mini_sorted[256];
+static unsigned char mini_codes[256];
+static int num_sorted = 0;
+
+
+/******************************************************************************
+Return a file name with ".vec" on the end, adding it if necessary.
+
+Entry:
+  filename - name to start with
+
+Exit:
+  returns the new name, to be freed with delete[]
+******************************************************************************/
+
+char *vec_file_name(const char *filename)
+{
+  size_t len = strlen(filename);
+  char *name = new char[len + 5];
+
+  strcpy(name, filename);
+  if (len < 4 || strcmp(name + len - 4, ".vec") != 0)
+    strcat(name, ".vec");
+
+  return (name);
+}
+
+
+/******************************************************************************
+Make the header of a .vec file.  The last line is padded with spaces so
+that the vectors after it start on a boundary that lets them be used where
+they lie when the file is mapped; programs that read the file with scanf
+skip the spaces.
+
+Entry:
+  xsize,ysize,zsize - size of the field
+  rank              - number of components of each vector
+  encoding          - how the components are stored
+  tile              - cells on a side of each tile, or 0 for none
+
+Exit:
+  str - the header, which needs room for VEC_MAX_HEADER characters
+  returns the length of the header
+******************************************************************************/
+
+static int vec_file_header(char *str, int xsize, int ysize, int zsize,
+                           int rank, int encoding, int tile)
+{
+  int len;
+
+  /* (the oldest version that can say it is used) */
+
+  if (tile > 0)
+    len = sprintf(str, "VF3\n%d %d %d\n%d %s tiles %d", xsize, ysize, zsize,
+                  rank, encodings[encoding].name, tile);
+  else if (encoding != VEC_F32)
+    len = sprintf(str, "VF2\n%d %d %d\n%d %s", xsize, ysize, zsize, rank,
+                  encodings[encoding].name);
+  else
+    len = sprintf(str, "VF\n%d %d %d\n%d", xsize, ysize, zsize, rank);
+
+  while ((len + 1) % VEC_ALIGN != 0)
+    str[len++] = ' ';
+  str[len++] = '\n';
+  str[len] = '\0';
+
+  return (len);
+}
+
+
+/******************************************************************************
+Read a word from the last line of a .vec header.
+
+Entry:
+  p - where to start looking, on the line
+
+Exit:
+  p    - just past the word
+  word - the word, which needs room for 16 characters
+  returns 1 if there was a word before the end of the line, 0 if not
+******************************************************************************/
+
+static int header_word(char *&p, char *word)
+{
+  while (*p == ' ' || *p == '\t')
+    p++;
+
+  int i;
+  for (i = 0; i < 15 && *p > ' '; i++)
+    word[i] = *p++;
+  word[i] = '\0';
+
+  return (i > 0);
+}
+
+
+/******************************************************************************
+Read the header at the start of a .vec file.
+
+Entry:
+  buf - start of the file
+  len - length of the file
+
+Exit:
+  file   - version, sizes, rank and encoding from the header
+  header - length of the header, up to where the vectors start
+  returns 1 if the header is good, 0 if not, or -1 if it is of a newer
+  version than can be read
+******************************************************************************/
+
+static int parse_header(const char *buf, size_t len, VecFile &file,
+                        size_t &header)
+{
+  char text[VEC_MAX_HEADER + 1];
+  size_t n = (len < VEC_MAX_HEADER) ? len : VEC_MAX_HEADER;
+
+  memcpy(text, buf, n);
+  text[n] = '\0';
+
+  if (strncmp(text, "VF", 2) != 0)
+    return (0);
+
+  char *p = text + 2;
+
+  /* a version number may follow right after the "VF" */
+
+  file.version = 1;
+  if (*p >= '0' && *p <= '9') {
+    file.version = (int) strtol(p, &p, 10);
+    if (file.version > VEC_VERSION)
+      return (-1);
+    if (file.version < 1)
+      return (0);
+  }
+
+  /* the sizes and rank, separated by any white space */
+
+  int nums[4];
+
+  for (int k = 0; k < 4; k++) {
+    char *end;
+    long val = strtol(p, &end, 10);
+    if (end == p || val < 0 || val > INT_MAX)
+      return (0);
+    nums[k] = (int) val;
+    p = end;
+  }
+
+  /* the name of the encoding, and maybe the size of the tiles, are on */
+  /* the same line as the rank */
+
+  file.encoding = VEC_F32;
+  file.tile = 0;
+
+  if (file.version >= 2) {
+    char name[16];
+    if (!header_word(p, name))
+      return (0);
+    file.encoding = vec_encoding(name);
+    if (file.encoding < 0)
+      return (0);
+  }
+
+  if (file.version >= 3) {
+    char word[16];
+    if (header_word(p, word)) {
+      char *end;
+      long val = strtol(p, &end, 10);
+      if (strcmp(word, "tiles") != 0 || end == p || val < 1 || val > 65535)
+        return (0);
+      file.tile = (int) val;
+      p = end;
+    }
+  }
+
+  /* the vectors start on the line after the rank */
+
+  while (*p == ' ' || *p == '\t' || *p == '\r')
+    p++;
+  if (*p != '\n')
+    return (0);
+
+  file.xsize = nums[0];
+  file.ysize = nums[1];
+  file.zsize = nums[2];
+  file.rank = nums[3];
+  header = p + 1 - text;
+
+  return (1);
+}
+
+
+/******************************************************************************
+Map a .vec file into memory and read its header.
+
+Entry:
+  name - name of the file
+
+Exit:
+  file - the mapped file
+  returns 1 on success, 0 (after saying what went wrong) on failure
+******************************************************************************/
+
+int open_vec_file(const char *name, VecFile &file)
+{
+  int fd = open(name, O_RDONLY);
+
+  if (fd < 0) {
+    fprintf(stderr, "Error openning '%s': %s\n", name, strerror(errno));
+    return (0);
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) < 0 || info.st_size == 0) {
+    fprintf(stderr, "Header bad in file '%s'.\n", name);
+    close(fd);
+    return (0);
+  }
+
+  file.length = info.st_size;
+  file.base = mmap(NULL, file.length, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                   fd, 0);
+  close(fd);
+
+  if (file.base == MAP_FAILED) {
+    fprintf(stderr, "Can't map '%s': %s\n", name, strerror(errno));
+    return (0);
+  }
+
+  size_t header;
+  int good = parse_header((char *) file.base, file.length, file, header);
+
+  if (good <= 0) {
+    if (good < 0)
+      fprintf(stderr, "File '%s' is from a newer version.\n", name);
+    else
+      fprintf(stderr, "Header bad in file '%s'.\n", name);
+    munmap(file.base, file.length);
+    return (0);
+  }
+
+  file.data = (char *) file.base + header;
+  file.data_bytes = file.length - header;
+
+  return (1);
+}
+
+
+/******************************************************************************
+Unmap a .vec file.
+******************************************************************************/
+
+void close_vec_file(VecFile &file)
+{
+  munmap(file.base, file.length);
+}
+
+
+/******************************************************************************
+Release the pages of a mapped .vec file that hold some of its vectors, once
+they have been copied out and won't be looked at again for a while.  They
+are read from the file again if they are, so this must only be used on
+vectors that haven't been changed.
+
+Entry:
+  file   - the mapped file
+  offset - where the vectors start, in bytes from the start of the vectors
+  bytes  - length of the vectors
+******************************************************************************/
+
+void release_vec_data(VecFile &file, size_t offset, size_t bytes)
+{
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t start = (file.data - (char *) file.base) + offset;
+  size_t end = start + bytes;
+
+  /* the span mustn't reach past the mapping, where other memory lies */
+
+  size_t last = (file.length + page - 1) / page * page;
+
+  /* reading one page maps in the pages around it that the system has */
+  /* already read as well, so those go too; pages that were never written */
+  /* come back from the file as they were if they are needed again */
+
+  if (page < VEC_RELEASE)
+    page = VEC_RELEASE;
+
+  start = start / page * page;
+  end = (end + page - 1) / page * page;
+  if (end > last)
+    end = last;
+
+  if (end > start)
+    madvise((char *) file.base + start, end - start, MADV_DONTNEED);
+}
+
+
+/******************************************************************************
+Return the number of tiles needed across a given number of vectors.
+
+Entry:
+  size - number of vectors across
+  tile - cells on a side of each tile
+******************************************************************************/
+
+int vec_tiles(int size, int tile)
+{
+  return ((size - 2) / tile + 1);
+}
+
+
+/******************************************************************************
+Return the number of bytes that the vectors of one frame of a file take up,
+counting the padding of the tiles if the file is tiled.
+******************************************************************************/
+
+size_t vec_frame_bytes(const VecFile &file)
+{
+  size_t count = (size_t) file.xsize * file.ysize * 2;
+
+  if (file.tile > 0 && file.xsize >= 2 && file.ysize >= 2)
+    count = (size_t) vec_tiles(file.xsize, file.tile) *
+            vec_tiles(file.ysize, file.tile) *
+            (file.tile + 1) * (file.tile + 1) * 2;
+
+  return (count * vec_encoding_size(file.encoding));
+}
+
+
+/******************************************************************************
+Pick out one frame of a file that holds a field changing over time.  The
+z size in the header gives the number of frames, and the vectors of each
+frame follow those of the one before.
+
+Entry:
+  file  - the mapped file
+  frame - which frame, counting from 0
+
+Exit:
+  file     - data and data_bytes now cover just that frame and those after
+  returns 1 on success, 0 (after saying what went wrong) on failure
+******************************************************************************/
+
+int vec_frame(VecFile &file, int frame)
+{
+  int frames = file.zsize < 1 ? 1 : file.zsize;
+
+  if (frame < 0 || frame >= frames) {
+    fprintf(stderr, "There is no frame %d in a file of %d frames.\n",
+            frame, frames);
+    return (0);
+  }
+
+  size_t skip = frame * vec_frame_bytes(file);
+
+  if (skip > file.data_bytes)
+    skip = file.data_bytes;
+
+  file.data += skip;
+  file.data_bytes -= skip;
+
+  return (1);
+}
+
+
+/******************************************************************************
+Write all of a block of data to a file, going on after writes that are cut
+short, as large ones can be.
+
+Exit:
+  returns 1 on success, 0 (after saying what went wrong) on failure
+******************************************************************************/
+
+static int write_all(int fd, const char *data, size_t bytes)
+{
+  size_t done = 0;
+
+  while (done < bytes) {
+    ssize_t cc = write(fd, data + done, bytes - done);
+    if (cc <= 0) {
+      fprintf(stderr, "Write returned short: %s\n", strerror(errno));
+      return (0);
+    }
+    done += cc;
+  }
+
+  return (1);
+}
+
+
+/******************************************************************************
+Write a two-dimensional field of vectors to a .vec file, possibly in tiles.
+
+Entry:
+  name        - name of the file
+  xsize,ysize - size of the field
+  values      - x and y of each vector, row by row
+  encoding    - how to store the vectors
+  tile        - cells on a side of each tile, or 0 to write the vectors
+                row by row
+
+Exit:
+  returns 1 on success, 0 (after saying what went wrong) on failure
+******************************************************************************/
+
+int write_vec_file(
+        const char *name,
+        int xsize,
+        int ysize,
+        const float *values,
+        int encoding,
+        int tile
+)
+{
+  if (tile < 0 || tile > 65535) {
+    fprintf(stderr, "Bad tile size: %d\n", tile);
+    return (0);
+  }
+
+  int fd = open(name, O_CREAT | O_TRUNC | O_WRONLY, 0666);
+  if (fd < 0) {
+    fprintf(stderr, "Unable to open %s: %s\n", name, strerror(errno));
+    return (0);
+  }
+
+  char str[VEC_MAX_HEADER];
+  int len = vec_file_header(str, xsize, ysize, 1, 2, encoding, tile);
+  if (write(fd, str, len) != len) {
+    fprintf(stderr, "Can't write to file.\n");
+    close(fd);
+    return (0);
+  }
+
+  int size = encodings[encoding].size;
+  int good = 1;
+
+  if (tile == 0) {
+
+    /* floats are written as they are, and anything else is encoded first */
+
+    size_t count = (size_t) xsize * ysize * 2;
+    if (encoding == VEC_F32)
+      good = write_all(fd, (const char *) values, count * size);
+    else {
+      char *coded = new char[count * size];
+      vec_encode(encoding, values, coded, count);
+      good = write_all(fd, coded, count * size);
+      delete[] coded;
+    }
+
+  } else {
+
+    /* gather each tile, with zeros past the edges of the field */
+
+    int side = tile + 1;
+    size_t count = (size_t) side * side * 2;
+    float *block = new float[count];
+    char *coded = new char[count * size];
+
+    for (int tj = 0; good && tj < vec_tiles(ysize, tile); tj++)
+      for (int ti = 0; good && ti < vec_tiles(xsize, tile); ti++) {
+        for (int j = 0; j < side; j++)
+          for (int i = 0; i < side; i++) {
+            int x = ti * tile + i;
+            int y = tj * tile + j;
+            float *v = &block[2 * (j * side + i)];
+            if (x < xsize && y < ysize) {
+              v[0] = values[2 * ((size_t) y * xsize + x)];
+              v[1] = values[2 * ((size_t) y * xsize + x) + 1];
+            } else {
+              v[0] = 0;
+              v[1] = 0;
+            }
+          }
+        vec_encode(encoding, block, coded, count);
+        good = write_all(fd, coded, count * size);
+      }
+
+    delete[] block;
+    delete[] coded;
+  }
+
+  close(fd);
+
+  return (good);
+}
+
+
+/******************************************************************************
+Write a two-dimensional field of vectors to a .vec file, row by row.
+
+Entry:
+  name        - name of the file
+  xsize,ysize - size of the field
+  values      - x and y of each vector, row by row
+  encoding    - how to store the vectors
+
+Exit:
+  returns 1 on success, 0 (after saying what went wrong) on failure
+******************************************************************************/
+
+int write_vec_file(
+        const char *name,
+        int xsize,
+        int ysize,
+        const float *values,
+        int encoding
+)
+{
+  return (write_vec_file(name, xsize, ysize, values, encoding, 0));
+}
+
+
+/******************************************************************************
+Return the encoding with a given name, or -1 if there is none.
+******************************************************************************/
+
+int vec_encoding(const char *name)
+{
+  for (int i = 0; i < VEC_ENCODINGS; i++)
+    if (strcmp(name, encodings[i].name) == 0)
+      return (i);
+
+  return (-1);
+}
+
+
+/******************************************************************************
+Return the name of an encoding.
+******************************************************************************/
+
+const char *vec_encoding_name(int encoding)
+{
+  return (encodings[encoding].name);
+}
+
+
+/******************************************************************************
+Return the number of bytes each component takes in an encoding.
+******************************************************************************/
+
+int vec_encoding_size(int encoding)
+{
+  return (encodings[encoding].size);
+}
+
+
+/******************************************************************************
+Turn stored components into floats.
+
+Entry:
+  encoding - how the components are stored
+  data     - the stored components
+  num      - number of components
+
+Exit:
+  values - the components as floats
+******************************************************************************/
+
+void vec_decode(int encoding, const char *data, float *values, size_t num)
+{
+  encodings[encoding].decode(data, values, num);
+}
+
+
+/******************************************************************************
+Store floats in a given encoding, rounding each to the nearest value that
+the encoding can hold.
+
+Entry:
+  encoding - how to store the components
+  values   - the components
+  num      - number of components
+
+Exit:
+  data - the stored components
+******************************************************************************/
+
+void vec_encode(int encoding, const float *values, char *data, size_t num)
+{
+  encodings[encoding].encode(values, data, num);
+}
+
+
+/******************************************************************************
+Convert between floats and the stored components of each encoding.  The
+stored components need not be aligned.
+******************************************************************************/
+
+static void decode_f32(const char *data, float *values, size_t num)
+{
+  memcpy(values, data, num * sizeof(float));
+}
+
+
+static void encode_f32(const float *values, char *data, size_t num)
+{
+  memcpy(data, values, num * sizeof(float));
+}
+
+
+static void decode_f16(const char *data, float *values, size_t num)
+{
+  for (size_t i = 0; i < num; i++) {
+    uint16_t half;
+    memcpy(&half, data + 2 * i, 2);
+    values[i] = HalfFloat::half_to_float(half);
+  }
+}
+
+
+static void encode_f16(const float *values, char *data, size_t num)
+{
+  for (size_t i = 0; i < num; i++) {
+    uint16_t half = HalfFloat::float_to_half(values[i]);
+    memcpy(data + 2 * i, &half, 2);
+  }
+}
+
+
+/******************************************************************************
+Fill in the tables of minifloat values.
+
+Exit:
+  returns the number of distinct values
+******************************************************************************/
+
+static int fill_mini_tables()
+{
+  for (int v = 0; v < 256; v++)
+    mini_values[v] = mini_to_float(v);
+
+  /* many minifloats share a value, so keep just the first of each */
+
+  for (int v = 0; v < 256; v++) {
+    float val = mini_values[v];
+    int i;
+    for (i = 0; i < num_sorted; i++)
+      if (mini_sorted[i] >= val)
+        break;
+    if (i < num_sorted && mini_sorted[i] == val)
+      continue;
+    memmove(mini_sorted + i + 1, mini_sorted + i,
+            (num_sorted - i) * sizeof(float));
+    memmove(mini_codes + i + 1, mini_codes + i, num_sorted - i);
+    mini_sorted[i] = val;
+    mini_codes[i] = v;
+    num_sorted++;
+  }
+
+  return (num_sorted);
+}
+
+
+/******************************************************************************
+Fill in the tables of minifloat values, the first time they are needed.
+Several threads may decode at once, and the initializer of a local static
+is only run once however many of them get here together.
+******************************************************************************/
+
+static void make_mini_tables()
+{
+  static int filled = fill_mini_tables();
+  (void) filled;
+}
+
+
+static void decode_f8(const char *data, float *values, size_t num)
+{
+  make_mini_tables();
+
+  for (size_t i = 0; i < num; i++)
+    values[i] = mini_values[(unsigned char) data[i]];
+}
+
+
+static void encode_f8(const float *values, char *data, size_t num)
+{
+  make_mini_tables();
+
+  for (size_t i = 0; i < num; i++) {
+
+    /* find the first value at least as large, and see whether the one */
+    /* below it is nearer */
+
+    float val = values[i];
+    int lo = 0;
+    int hi = num_sorted - 1;
+    while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      if (mini_sorted[mid] < val)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    if (lo > 0 && val - mini_sorted[lo - 1] < mini_sorted[lo] - val)
+      lo--;
+
+    data[i] = mini_codes[lo];
+  }
+}
@@ -0,0 +1,80 @@
+//
+//  Reading the header of a .vec file and mapping the file into memory
+//
+
+/*
+Copyright (c) 1996 The University of North Carolina.  All rights reserved.
+
+Permission to use, copy, modify and distribute this software and its
+documentation for any purpose is hereby granted without fee, provided
+that the above copyright notice and this permission notice appear in
+all copies of this software and that you do not sell the software.
+
+The software is provided "as is" and without warranty of any kind,
+express, implied or otherwise, including without limitation, any
+warranty of merchantability or fitness for a particular purpose.
+*/
+
+
+#ifndef _VEC_FILE_
+#define _VEC_FILE_
+
+#include <stddef.h>
+
+#define VEC_MAX_HEADER  256   /* longest header that is looked for */
+#define VEC_ALIGN        16   /* headers written are padded to a multiple */
+                              /* of this, so the vectors can be mapped */
+#define VEC_VERSION       3   /* newest version of the header */
+#define VEC_RELEASE   65536   /* span of pages released at once, which is */
+                              /* how far around it reading a page reaches */
+
+/* how each component of the vectors is stored; files from before the */
+/* header had a version are all VEC_F32 */
+
+#define VEC_F32           0   /* 32-bit floats */
+#define VEC_F16           1   /* 16-bit half floats */
+#define VEC_F8            2   /* 8-bit 1:4:3 minifloats */
+#define VEC_ENCODINGS     3
+
+
+/* a .vec file mapped into memory; the mapping is private, so the vectors */
+/* can be changed in place without the file changing, and only the pages */
+/* that are changed stop being shared with other processes */
+
+class VecFile
+{
+  public:
+    int version;                     /* of the header (1 if none given) */
+    int xsize, ysize, zsize, rank;   /* from the header */
+    int encoding;                    /* how the vectors are stored */
+    int tile;                        /* cells on a side of each tile, or 0 */
+                                     /* if the vectors are row by row */
+    char *data;                      /* the vectors, just past the header */
+    size_t data_bytes;               /* length of the file past the header */
+    void *base;                      /* start of the mapping */
+    size_t length;                   /* length of the mapping */
+};
+
+char *vec_file_name(const char *);
+
+int open_vec_file(const char *, VecFile &);
+
+void close_vec_file(VecFile &);
+
+void release_vec_data(VecFile &, size_t, size_t);
+
+int write_vec_file(const char *, int, int, const float *, int);
+int write_vec_file(const char *, int, int, const float *, int, int);
+
+int vec_tiles(int, int);
+
+size_t vec_frame_bytes(const VecFile &);
+int vec_frame(VecFile &, int);
+
+int vec_encoding(const char *);
+const char *vec_encoding_name(int);
+int vec_encoding_size(int);
+void vec_decode(int, const char *, float *, size_t);
+void vec_encode(int, const float *, char *, size_t);
+
+#endif /* _VEC_FILE_ */
@@ -29,185 +29,553 @@ warranty of merchantability or fitness for a particular purpose.
 #include <unistd.h>
 #include <fcntl.h>
 #include <cstring>
+#include <atomic>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "../libs/floatimage.h"
 #include "vfield.h"
 
 static int integrator = MIDPOINT;
+static float tolerance = 1e-7;     /* error allowed in each adaptive step */
+static long tile_cache = TILE_CACHE_MB * 1048576L;   /* bytes of tiles kept */
+
+#define NORMAL_SLOP  4e-7   /* how far from 1 a length may be rounded */
+
+
+/* the tiles that one thread holds on to; a set of tiles gets a new id */
+/* whenever its vectors change, so no tile held is mistaken for one of */
+/* another set or of the same set before the change */
+
+class TileHolds
+{
+public:
+    long id[TILE_HOLDS];          /* which set of tiles each is of, or 0 */
+    int tile[TILE_HOLDS];         /* which tile of the set */
+    TileBuffer *buf[TILE_HOLDS];  /* the tile's vectors, or NULL */
+    long used[TILE_HOLDS];        /* when each was last looked at */
+    long clock;
+
+    TileHolds()
+    {
+      for (int k = 0; k < TILE_HOLDS; k++) {
+        id[k] = 0;
+        tile[k] = -1;
+        buf[k] = NULL;
+        used[k] = 0;
+      }
+      clock = 0;
+    }
+
+    ~TileHolds()
+    {
+      for (int k = 0; k < TILE_HOLDS; k++)
+        if (buf[k] && --buf[k]->refs == 0)
+          delete buf[k];
+    }
+};
+
+static thread_local TileHolds tile_holds;
+static std::atomic<long> next_tiles_id(1);
 
 
 /******************************************************************************
-Create a new vector field by reading in a file.
+Create a new vector field by reading in a file.  The file is mapped into
+memory and, if it holds floats, the vectors are used where they lie, so
+nothing is read until it is needed.  Changes to the vectors are copied on
+write and never reach the file.  Vectors stored more compactly are decoded
+into floats instead, and those of a tiled file are decoded a tile at a time
+as they are looked at, so that the field needn't fit in memory.
 ******************************************************************************/
 
 VectorField::VectorField(char *filename)
 {
-  int index = 0;
-  int done = 0;
-  int linefeeds = 0;
-  int zsize;
-  int rank;
+  read_file(filename, 0);
+}
+
+
+/******************************************************************************
+Create a new vector field from one frame of a file that holds a field that
+changes over time.
+
+Entry:
+  filename - name of the file, to which ".vec" is added if it is missing
+  frame    - which frame to read, counting from 0
+******************************************************************************/
+
+VectorField::VectorField(char *filename, int frame)
+{
+  read_file(filename, frame);
+}
 
+
+/******************************************************************************
+Read one frame of a vector field from a file, for the constructors.
+
+Entry:
+  filename - name of the file, to which ".vec" is added if it is missing
+  frame    - which frame to read, counting from 0
+******************************************************************************/
+
+void VectorField::read_file(char *filename, int frame)
+{
   /* append ".vec" to the file name if necesary */
 
-  char name[80];
-  strcpy(name, filename);
-  if (strlen(name) < 4 || strcmp(name + strlen(name) - 4, ".vec") != 0)
-    strcat(name, ".vec");
+  char *name = vec_file_name(filename);
 
-  std::ifstream infile(name, std::ios::in);
+  file = new VecFile;
+  if (!open_vec_file(name, *file) || !vec_frame(*file, frame))
+    exit(-1);
 
-  if (!infile) {
-    fprintf(stderr, "Error openning '%s'\n", name);
+  if (file->zsize > 1)
+    printf("reading %s, frame %d of %d\n", filename, frame, file->zsize);
+  else
+    printf("reading %s\n", filename);
+
+  xsize = file->xsize;
+  ysize = file->ysize;
+  aspect = ysize / (float) xsize;
+  aspect_recip = 1.0 / aspect;
+  xscale = xsize - 1;
+  yscale = ysize - 1;
+  flow_map = NULL;
+  tiles = NULL;
+  values = NULL;
+
+  size_t count = (size_t) xsize * ysize * 2;
+  size_t bytes = vec_frame_bytes(*file);
+
+  if (xsize < 2 || ysize < 2 || file->data_bytes < bytes) {
+    fprintf(stderr, "File '%s' is too short for a %d by %d field.\n",
+            name, xsize, ysize);
     exit(-1);
   }
 
-  printf("reading %s\n", filename);
+  delete[] name;
+
+  /* vectors that aren't floats starting on a float boundary are decoded */
+  /* into a copy instead, unless they are tiled */
+
+  if (file->tile > 0)
+    tiles = new FieldTiles(file);
+  else if (file->encoding == VEC_F32 &&
+           (size_t) file->data % sizeof(float) == 0)
+    values = (float *) file->data;
+  else {
+    values = new float[count];
+    vec_decode(file->encoding, file->data, values, count);
+    close_vec_file(*file);
+    delete file;
+    file = NULL;
+  }
+}
 
-  char *str = new char[80];
 
-  while (!done) {
-    infile.get(str[index]);
-    if (str[index] == '\n')
-      linefeeds++;
-    if (linefeeds == 3 || index >= 100)
-      done = 1;
-    index++;
-  }
-  str[index] = '\0';
+/******************************************************************************
+Write the vector field to a file.
 
-  if (index >= 100) {
-    fprintf(stderr, "Header bad in file.\n");
-    exit(-1);
+Entry:
+  filename - name of the file, to which ".vec" is added if it is missing
+  encoding - how to store the vectors (VEC_F32, VEC_F16 or VEC_F8)
+******************************************************************************/
+
+void VectorField::write_file(char *filename, int encoding)
+{
+  if (tiles) {
+    fprintf(stderr, "Can't write a tiled field.\n");
+    return;
   }
 
-  sscanf(str, "VF\n%d %d %d\n%d\n", &xsize, &ysize, &zsize, &rank);
-  aspect = ysize / (float) xsize;
-  aspect_recip = 1.0 / aspect;
+  /* append ".vec" to the file name if necesary */
 
-//  cout << "size: " << xsize << " " << ysize << endl;
+  char *name = vec_file_name(filename);
 
-  values = new float[xsize * ysize * 2];
-  infile.read((char *) values, xsize * ysize * 2 * sizeof(float));
+  if (!write_vec_file(name, xsize, ysize, values, encoding))
+    exit(-1);
 
-  infile.close();
+  delete[] name;
 }
 
 
 /******************************************************************************
-Write the vector field to a file.
+Write the vector field to a file as floats.
 ******************************************************************************/
 
 void VectorField::write_file(char *filename)
 {
-  int zsize = 1;
-  int rank = 2;
+  write_file(filename, VEC_F32);
+}
 
-  /* append ".vec" to the file name if necesary */
 
-  char name[80];
-  strcpy(name, filename);
-  if (strlen(name) < 4 || strcmp(name + strlen(name) - 4, ".vec") != 0)
-    strcat(name, ".vec");
+/******************************************************************************
+Get ready to look up the vectors of a tiled file.
 
-  int fd = open(name, O_CREAT | O_TRUNC | O_WRONLY, 0666);
-  if (fd < 0) {
-    fprintf(stderr, "Unable to open %s: %s\n", name, strerror(errno));
-    exit(-1);
+Entry:
+  vecfile - the mapped file, which must stay open as long as the tiles
+******************************************************************************/
+
+FieldTiles::FieldTiles(VecFile *vecfile)
+{
+  file = vecfile;
+  tile = file->tile;
+  side = tile + 1;
+  xtiles = vec_tiles(file->xsize, tile);
+  ytiles = vec_tiles(file->ysize, tile);
+  normalized = 0;
+  clock = 0;
+  id = next_tiles_id++;
+  loads = 0;
+
+  int num = xtiles * ytiles;
+  data = new TileBuffer *[num];
+  last_used = new long[num];
+  resident = new int[num];
+  num_resident = 0;
+
+  for (int t = 0; t < num; t++) {
+    data[t] = NULL;
+    last_used[t] = 0;
   }
+}
 
-  char str[80];
-  sprintf(str, "VF\n%d %d %d\n%d\n", xsize, ysize, zsize, rank);
-  int cc = write(fd, str, strlen(str));
-  if (cc == -1) {
-    fprintf(stderr, "Can't write to file.\n");
-    exit(-1);
+
+/******************************************************************************
+Free the decoded tiles.
+******************************************************************************/
+
+FieldTiles::~FieldTiles()
+{
+  /* threads still holding a tile free it when they let go */
+
+  for (int k = 0; k < num_resident; k++) {
+    TileBuffer *buf = data[resident[k]];
+    if (--buf->refs == 0)
+      delete buf;
   }
 
-  cc = write(fd, (char *) values, sizeof(float) * xsize * ysize * 2);
+  delete[] data;
+  delete[] last_used;
+  delete[] resident;
+}
 
-  if (cc != sizeof(float) * xsize * ysize * 2) {
-    fprintf(stderr, "Write returned short: %s\n", strerror(errno));
-    close(fd);
-    exit(-1);
+
+/******************************************************************************
+Decode a tile, first dropping the one that has gone longest without being
+looked at if the tiles already take up all the memory they may.  A dropped
+tile that some thread still holds lives on until the thread lets go of it.
+This is called with the lock held.
+
+Entry:
+  t - which tile, counting across and then down
+******************************************************************************/
+
+void FieldTiles::load(int t)
+{
+  size_t count = (size_t) side * side * 2;
+  long most = tile_cache / (count * sizeof(float));
+  TileBuffer *buf = NULL;
+
+  if (most < TILE_MIN)
+    most = TILE_MIN;
+
+  while (num_resident >= most) {
+    int oldest = 0;
+    for (int k = 1; k < num_resident; k++)
+      if (last_used[resident[k]] < last_used[resident[oldest]])
+        oldest = k;
+    int old = resident[oldest];
+    if (buf)
+      delete buf;
+    buf = data[old];
+    data[old] = NULL;
+    resident[oldest] = resident[--num_resident];
+
+    /* (threads only take a hold with the lock held, so no thread can */
+    /* take one on this tile now) */
+
+    if (--buf->refs > 0)
+      buf = NULL;
   }
 
-  close(fd);
+  /* the dropped tile's memory is reused for the new one, unless a thread */
+  /* is still reading it */
+
+  if (buf)
+    buf->refs = 1;
+  else
+    buf = new TileBuffer(count);
+
+  float *block = buf->data;
+
+  size_t bytes = count * vec_encoding_size(file->encoding);
+  vec_decode(file->encoding, file->data + t * bytes, block, count);
+  release_vec_data(*file, t * bytes, bytes);
+
+  /* (normalized just as VectorField::normalize() does it) */
+
+  if (normalized)
+    for (size_t i = 0; i < count; i += 2) {
+      float x2 = block[i] * block[i];
+      float y2 = block[i + 1] * block[i + 1];
+      float len = sqrt(x2 + y2);
+      if (len != 0 && fabs(len - 1) > NORMAL_SLOP) {
+        float recip = 1 / len;
+        block[i] *= recip;
+        block[i + 1] *= recip;
+      }
+    }
+
+  data[t] = buf;
+  resident[num_resident++] = t;
+  loads++;
 }
 
 
 /******************************************************************************
-Return the interpolated X vector value of a given position in a vector field.
+Have the calling thread hold on to a tile, in place of the tile it has gone
+longest without looking at.  The tile is decoded first if it isn't already.
 
 Entry:
-  x,y - position in vector field, in [0,1] x [0,1]
+  t - which tile, counting across and then down
 
 Exit:
-  returns interpolated x value
+  returns which of the thread's holds it is in
 ******************************************************************************/
 
-float VectorField::xval(float x, float y)
+int FieldTiles::hold_tile(int t)
 {
-  if (x < 0 || x > 1 || y < 0 || y > aspect)
-    return (0.0);
+  TileHolds &holds = tile_holds;
+
+  int k = 0;
+  for (int n = 1; n < TILE_HOLDS; n++)
+    if (holds.used[n] < holds.used[k])
+      k = n;
+
+  /* let go of the old tile, which may have been dropped by its field */
+
+  TileBuffer *old = holds.buf[k];
+  holds.buf[k] = NULL;
+  holds.id[k] = 0;
+  if (old && --old->refs == 0)
+    delete old;
+
+  std::lock_guard<std::mutex> hold(lock);
+
+  if (data[t] == NULL)
+    load(t);
+  last_used[t] = ++clock;
+
+  data[t]->refs++;
+  holds.buf[k] = data[t];
+  holds.id[k] = id;
+  holds.tile[k] = t;
+
+  return (k);
+}
+
+
+/******************************************************************************
+Copy out the vectors at the corners of a cell of the field.  They are read
+from a tile the thread holds, so no lock is needed unless the thread has
+moved on to a tile it doesn't hold.
+
+Entry:
+  i,j - the cell's lower left corner, with i < xsize - 1 and j < ysize - 1
+
+Exit:
+  corners - x and y of the vectors at (i,j), (i+1,j), (i,j+1) and (i+1,j+1)
+******************************************************************************/
+
+void FieldTiles::cell(int i, int j, float *corners)
+{
+  int ti = i / tile;
+  int tj = j / tile;
+  int t = tj * xtiles + ti;
+
+  TileHolds &holds = tile_holds;
+
+  int k;
+  for (k = 0; k < TILE_HOLDS; k++)
+    if (holds.tile[k] == t && holds.id[k] == id)
+      break;
+
+  if (k == TILE_HOLDS)
+    k = hold_tile(t);
+  holds.used[k] = ++holds.clock;
+
+  const float *p = &holds.buf[k]->data[2 * ((j - tj * tile) * side +
+                                            (i - ti * tile))];
+  memcpy(corners, p, 4 * sizeof(float));
+  memcpy(corners + 4, p + 2 * side, 4 * sizeof(float));
+}
+
+
+/******************************************************************************
+Find the vector at a point of the field's grid.
+
+Entry:
+  i,j - the point
+
+Exit:
+  x,y - the vector there
+******************************************************************************/
+
+void FieldTiles::vector(int i, int j, float &x, float &y)
+{
+  float corners[8];
+  int ci = (i < file->xsize - 1) ? i : i - 1;
+  int cj = (j < file->ysize - 1) ? j : j - 1;
+
+  cell(ci, cj, corners);
+
+  const float *p = &corners[(j - cj) * 4 + (i - ci) * 2];
+  x = p[0];
+  y = p[1];
+}
 
-  x = x * (xsize - 1);
-  y = y * (ysize - 1) * aspect_recip;
+
+/******************************************************************************
+Have all vectors normalized from now on, dropping the tiles already decoded
+so that they are decoded again.  No other thread may be looking at the field
+while this is called.
+******************************************************************************/
+
+void FieldTiles::set_normalized()
+{
+  std::lock_guard<std::mutex> hold(lock);
+
+  for (int k = 0; k < num_resident; k++) {
+    TileBuffer *buf = data[resident[k]];
+    if (--buf->refs == 0)
+      delete buf;
+    data[resident[k]] = NULL;
+  }
+  num_resident = 0;
+  normalized = 1;
+
+  /* the tiles the threads hold are of the vectors before normalizing */
+  id = next_tiles_id++;
+}
+
+
+/******************************************************************************
+Interpolate the field bilinearly at a position known to be inside it.  Both
+components are found at once: the two vectors on each of the two rows around
+the position are fetched with one load per row, and blended in parallel.
+The vectors of a tiled field are first copied out of their tile.
+
+Entry:
+  x,y - position in vector field, in [0,1] x [0,aspect]
+
+Exit:
+  xv,yv - the interpolated x and y values
+******************************************************************************/
+
+inline void VectorField::bilinear(float x, float y, float &xv, float &yv)
+{
+  x = x * xscale;
+  y = y * yscale * aspect_recip;
 
   int i = (int) x;
   int j = (int) y;
 
+  /* don't read past the last column or row at the far edges */
+
+  if (i > xsize - 2)
+    i = xsize - 2;
+  if (j > ysize - 2)
+    j = ysize - 2;
+
   float xfract = x - i;
   float yfract = y - j;
 
-  int index = 2 * (j * xsize + i);
-  float x00 = values[index];
-  float x01 = values[index + 2];
-  float x10 = values[index + 2 * xsize];
-  float x11 = values[index + 2 * xsize + 2];
+  const float *p;
+  int stride;
+  float corners[8];
+
+  if (tiles) {
+    tiles->cell(i, j, corners);
+    p = corners;
+    stride = 4;
+  } else {
+    p = &values[2 * ((size_t) j * xsize + i)];
+    stride = 2 * xsize;
+  }
+
+#ifdef __SSE2__
+
+  /* each row holds x and y of the left vector, then x and y of the right */
+
+  __m128 row0 = _mm_loadu_ps(p);
+  __m128 row1 = _mm_loadu_ps(p + stride);
+
+  __m128 xf = _mm_set1_ps(xfract);
+  row0 = _mm_add_ps(row0, _mm_mul_ps(xf, _mm_sub_ps(_mm_movehl_ps(row0, row0),
+                                                    row0)));
+  row1 = _mm_add_ps(row1, _mm_mul_ps(xf, _mm_sub_ps(_mm_movehl_ps(row1, row1),
+                                                    row1)));
+
+  __m128 v = _mm_add_ps(row0, _mm_mul_ps(_mm_set1_ps(yfract),
+                                         _mm_sub_ps(row1, row0)));
+
+  xv = _mm_cvtss_f32(v);
+  yv = _mm_cvtss_f32(_mm_shuffle_ps(v, v, 1));
 
-  float x0 = x00 + xfract * (x01 - x00);
-  float x1 = x10 + xfract * (x11 - x10);
-  float xinterp = x0 + yfract * (x1 - x0);
+#else
 
-  return (xinterp);
+  float x0 = p[0] + xfract * (p[2] - p[0]);
+  float x1 = p[stride] + xfract * (p[stride + 2] - p[stride]);
+  xv = x0 + yfract * (x1 - x0);
+
+  float y0 = p[1] + xfract * (p[3] - p[1]);
+  float y1 = p[stride + 1] + xfract * (p[stride + 3] - p[stride + 1]);
+  yv = y0 + yfract * (y1 - y0);
+
+#endif
 }
 
 
 /******************************************************************************
-Return the interpolated Y vector value of a given position in a vector field.
+Return the interpolated X vector value of a given position in a vector field.
 
 Entry:
   x,y - position in vector field, in [0,1] x [0,1]
 
 Exit:
-  returns interpolated y value
+  returns interpolated x value
 ******************************************************************************/
 
-float VectorField::yval(float x, float y)
+float VectorField::xval(float x, float y)
 {
-  if (x < 0 || x > 1 || y < 0 || y > aspect)
+  if (!(x >= 0 && x <= 1 && y >= 0 && y <= aspect))
     return (0.0);
 
-  x = x * (xsize - 1);
-  y = y * (ysize - 1) * aspect_recip;
+  float xv, yv;
+  bilinear(x, y, xv, yv);
 
-  int i = (int) x;
-  int j = (int) y;
+  return (xv);
+}
 
-  float xfract = x - i;
-  float yfract = y - j;
 
-  int index = 2 * (j * xsize + i) + 1;
-  float y00 = values[index];
-  float y01 = values[index + 2];
-  float y10 = values[index + 2 * xsize];
-  float y11 = values[index + 2 * xsize + 2];
+/******************************************************************************
+Return the interpolated Y vector value of a given position in a vector field.
+
+Entry:
+  x,y - position in vector field, in [0,1] x [0,1]
+
+Exit:
+  returns interpolated y value
+******************************************************************************/
 
-  float y0 = y00 + xfract * (y01 - y00);
-  float y1 = y10 + xfract * (y11 - y10);
-  float yinterp = y0 + yfract * (y1 - y0);
+float VectorField::yval(float x, float y)
+{
+  if (!(x >= 0 && x <= 1 && y >= 0 && y <= aspect))
+    return (0.0);
 
-  return (yinterp);
+  float xv, yv;
+  bilinear(x, y, xv, yv);
+
+  return (yv);
 }
 
 
@@ -232,43 +600,17 @@ float VectorField::xyval(
         float &yval
 )
 {
-  int index;
   float xv, yv;
 
-  if (x < 0 || x > 1 || y < 0 || y > aspect) {
+  /* (written so that positions that are not numbers count as outside) */
+
+  if (!(x >= 0 && x <= 1 && y >= 0 && y <= aspect)) {
     xval = 0.0;
     yval = 0.0;
     return (0.0);
   }
 
-  x = x * (xsize - 1);
-  y = y * (ysize - 1) * aspect_recip;
-
-  int i = (int) x;
-  int j = (int) y;
-
-  float xfract = x - i;
-  float yfract = y - j;
-
-  index = 2 * (j * xsize + i);
-  float x00 = values[index];
-  float x01 = values[index + 2];
-  float x10 = values[index + 2 * xsize];
-  float x11 = values[index + 2 * xsize + 2];
-
-  float x0 = x00 + xfract * (x01 - x00);
-  float x1 = x10 + xfract * (x11 - x10);
-  xv = x0 + yfract * (x1 - x0);
-
-  index = 2 * (j * xsize + i) + 1;
-  float y00 = values[index];
-  float y01 = values[index + 2];
-  float y10 = values[index + 2 * xsize];
-  float y11 = values[index + 2 * xsize + 2];
-
-  float y0 = y00 + xfract * (y01 - y00);
-  float y1 = y10 + xfract * (y11 - y10);
-  yv = y0 + yfract * (y1 - y0);
+  bilinear(x, y, xv, yv);
 
   float len = sqrt(xv * xv + yv * yv);
 
@@ -287,7 +629,190 @@ float VectorField::xyval(
 
 
 /******************************************************************************
-Set the type of the integrator (EULER, MIDPOINT, RUNGE_KUTTA).
+Find the interpolated vector values at many positions.
+
+Entry:
+  num       - number of positions
+  x,y       - the positions
+  normalize - 1 if we're to normalize the results, 0 if not
+
+Exit:
+  xval,yval - the interpolated x and y values
+  len       - lengths of the vectors, unless this is NULL
+******************************************************************************/
+
+void VectorField::xyval_batch(
+        int num,
+        const float *x,
+        const float *y,
+        int normalize,
+        float *xval,
+        float *yval,
+        float *len
+)
+{
+  for (int n = 0; n < num; n++) {
+    float l = xyval(x[n], y[n], normalize, xval[n], yval[n]);
+    if (len)
+      len[n] = l;
+  }
+}
+
+
+/******************************************************************************
+Take one integration step for each of many positions at once, each with a
+step size of its own.  The fixed-step integrators go through the positions
+one stage at a time, BATCH_CHUNK positions at a go, and give exactly the
+same results as integrate(); the adaptive one has no fixed stages to share,
+so it steps each position in turn.
+
+Entry:
+  num       - number of positions
+  x,y       - the positions
+  delta     - step sizes
+  normalize - whether to normalize the step lengths
+
+Exit:
+  x,y - new positions
+  len - lengths of the field vectors over the steps, unless this is NULL
+******************************************************************************/
+
+void VectorField::integrate_batch(
+        int num,
+        float *x,
+        float *y,
+        const float *delta,
+        int normalize,
+        float *len
+)
+{
+  float xv[BATCH_CHUNK], yv[BATCH_CHUNK], lv[BATCH_CHUNK];
+  float x2[BATCH_CHUNK], y2[BATCH_CHUNK];
+  float xsum[BATCH_CHUNK], ysum[BATCH_CHUNK], lsum[BATCH_CHUNK];
+
+  if (integrator != EULER && integrator != MIDPOINT &&
+      integrator != RUNGE_KUTTA) {
+    for (int n = 0; n < num; n++) {
+      float l = integrate(x[n], y[n], delta[n], normalize, x[n], y[n]);
+      if (len)
+        len[n] = l;
+    }
+    return;
+  }
+
+  for (int start = 0; start < num; start += BATCH_CHUNK) {
+
+    int count = num - start;
+    if (count > BATCH_CHUNK)
+      count = BATCH_CHUNK;
+
+    float *xs = x + start;
+    float *ys = y + start;
+    const float *dt = delta + start;
+    int n;
+
+    xyval_batch(count, xs, ys, normalize, xv, yv, lv);
+
+    if (integrator == MIDPOINT) {
+
+      for (n = 0; n < count; n++) {
+        x2[n] = xs[n] + 0.5 * dt[n] * xv[n];
+        y2[n] = ys[n] + 0.5 * dt[n] * yv[n];
+      }
+      xyval_batch(count, x2, y2, normalize, xv, yv, lv);
+
+    } else if (integrator == RUNGE_KUTTA) {
+
+      /* keep a running sum of the stages, weighted as in integrate() */
+
+      for (int stage = 1; stage < 4; stage++) {
+        for (n = 0; n < count; n++) {
+          if (stage == 1) {
+            xsum[n] = xv[n];
+            ysum[n] = yv[n];
+            lsum[n] = lv[n];
+          } else {
+            xsum[n] += 2 * xv[n];
+            ysum[n] += 2 * yv[n];
+            lsum[n] += 2 * lv[n];
+          }
+          if (stage == 3) {
+            x2[n] = xs[n] + dt[n] * xv[n];
+            y2[n] = ys[n] + dt[n] * yv[n];
+          } else {
+            x2[n] = xs[n] + 0.5 * dt[n] * xv[n];
+            y2[n] = ys[n] + 0.5 * dt[n] * yv[n];
+          }
+        }
+        xyval_batch(count, x2, y2, normalize, xv, yv, lv);
+      }
+
+      for (n = 0; n < count; n++) {
+        xs[n] = xs[n] + dt[n] * (xsum[n] + xv[n]) / 6;
+        ys[n] = ys[n] + dt[n] * (ysum[n] + yv[n]) / 6;
+        lv[n] = (lsum[n] + lv[n]) / 6;
+      }
+
+      if (len)
+        for (n = 0; n < count; n++)
+          len[start + n] = lv[n];
+
+      continue;
+    }
+
+    for (n = 0; n < count; n++) {
+      xs[n] = xs[n] + dt[n] * xv[n];
+      ys[n] = ys[n] + dt[n] * yv[n];
+    }
+
+    if (len)
+      for (n = 0; n < count; n++)
+        len[start + n] = lv[n];
+  }
+}
+
+
+/******************************************************************************
+Take one integration step for each of many positions at once, all with the
+same step size.
+
+Entry:
+  num       - number of positions
+  x,y       - the positions
+  delta     - step size
+  normalize - whether to normalize the step lengths
+
+Exit:
+  x,y - new positions
+  len - lengths of the field vectors over the steps, unless this is NULL
+******************************************************************************/
+
+void VectorField::integrate_batch(
+        int num,
+        float *x,
+        float *y,
+        float delta,
+        int normalize,
+        float *len
+)
+{
+  float dt[BATCH_CHUNK];
+
+  for (int n = 0; n < BATCH_CHUNK; n++)
+    dt[n] = delta;
+
+  for (int start = 0; start < num; start += BATCH_CHUNK) {
+    int count = num - start;
+    if (count > BATCH_CHUNK)
+      count = BATCH_CHUNK;
+    integrate_batch(count, x + start, y + start, dt, normalize,
+                    len ? len + start : NULL);
+  }
+}
+
+
+/******************************************************************************
+Set the type of the integrator (EULER, MIDPOINT, RUNGE_KUTTA, RK45).
 ******************************************************************************/
 
 void set_integration(int type)
@@ -296,6 +821,108 @@ void set_integration(int type)
 }
 
 
+/******************************************************************************
+Return the type of the integrator.
+******************************************************************************/
+
+int get_integration()
+{
+  return (integrator);
+}
+
+
+/******************************************************************************
+Return the name of a type of integrator.
+******************************************************************************/
+
+const char *integration_name(int type)
+{
+  switch (type) {
+    case EULER:
+      return ("euler");
+    case MIDPOINT:
+      return ("midpoint");
+    case RUNGE_KUTTA:
+      return ("runge_kutta");
+    case RK45:
+      return ("rk45");
+    default:
+      return ("unknown");
+  }
+}
+
+
+/******************************************************************************
+Set the error allowed in each step of the adaptive integrator, as a distance
+in the [0,1] coordinates of the field.
+******************************************************************************/
+
+void set_integration_tolerance(float tol)
+{
+  if (tol > 0)
+    tolerance = tol;
+}
+
+
+/******************************************************************************
+Return the error allowed in each step of the adaptive integrator.
+******************************************************************************/
+
+float get_integration_tolerance()
+{
+  return (tolerance);
+}
+
+
+/******************************************************************************
+Set how much memory the decoded tiles of a tiled field may take, in bytes.
+******************************************************************************/
+
+void set_tile_cache(long bytes)
+{
+  if (bytes > 0)
+    tile_cache = bytes;
+}
+
+
+/******************************************************************************
+Return how much memory the decoded tiles of a tiled field may take.
+******************************************************************************/
+
+long get_tile_cache()
+{
+  return (tile_cache);
+}
+
+
+/* the Dormand-Prince 5(4) pair: stage times, stage weights, weights of the */
+/* fifth-order result, weights of the error estimate (fifth minus fourth */
+/* order), and weights of the interpolant's last term */
+
+static const double dp_c[7] = {0.0, 1.0 / 5, 3.0 / 10, 4.0 / 5, 8.0 / 9, 1.0, 1.0};
+
+static const double dp_a[7][6] = {
+  {0},
+  {1.0 / 5},
+  {3.0 / 40, 9.0 / 40},
+  {44.0 / 45, -56.0 / 15, 32.0 / 9},
+  {19372.0 / 6561, -25360.0 / 2187, 64448.0 / 6561, -212.0 / 729},
+  {9017.0 / 3168, -355.0 / 33, 46732.0 / 5247, 49.0 / 176, -5103.0 / 18656},
+  {35.0 / 384, 0.0, 500.0 / 1113, 125.0 / 192, -2187.0 / 6784, 11.0 / 84},
+};
+
+static const double dp_e[7] = {
+  71.0 / 57600, 0.0, -71.0 / 16695, 71.0 / 1920,
+  -17253.0 / 339200, 22.0 / 525, -1.0 / 40
+};
+
+static const double dp_d[7] = {
+  -12715105075.0 / 11282082432, 0.0, 87487479700.0 / 32700410799,
+  -10690763975.0 / 1880347072, 701980252875.0 / 199316789632,
+  -1453857185.0 / 822651844, 69997945.0 / 29380423
+};
+
+
 /******************************************************************************
 Take one integration step within the vector field.
 
@@ -306,8 +933,9 @@ Entry:
 
 Exit:
   xnew,ynew - new position
-  returns the length of the step
+  returns the length of the field vector over the step
 ******************************************************************************/
+
 float VectorField::integrate(
         float x,
         float y,
@@ -336,7 +964,39 @@ float VectorField::integrate(
     ynew = y + delta * yv;
 
   } else if (integrator == RUNGE_KUTTA) {
-    return (0.0);
+
+    float x1, y1, x2, y2, x3, y3, x4, y4;
+    float len1 = xyval(x, y, normalize, x1, y1);
+    float len2 = xyval(x + 0.5 * delta * x1, y + 0.5 * delta * y1,
+                       normalize, x2, y2);
+    float len3 = xyval(x + 0.5 * delta * x2, y + 0.5 * delta * y2,
+                       normalize, x3, y3);
+    float len4 = xyval(x + delta * x3, y + delta * y3, normalize, x4, y4);
+    xnew = x + delta * (x1 + 2 * x2 + 2 * x3 + x4) / 6;
+    ynew = y + delta * (y1 + 2 * y2 + 2 * y3 + y4) / 6;
+    len = (len1 + 2 * len2 + 2 * len3 + len4) / 6;
+
+  } else if (integrator == RK45) {
+
+    /* a single fifth-order step, without any control of its size */
+
+    float kx[7], ky[7];
+    float len0 = xyval(x, y, normalize, kx[0], ky[0]);
+    for (int s = 1; s < 7; s++) {
+      double sx = x;
+      double sy = y;
+      for (int r = 0; r < s; r++) {
+        sx += delta * dp_a[s][r] * kx[r];
+        sy += delta * dp_a[s][r] * ky[r];
+      }
+      len = xyval(sx, sy, normalize, kx[s], ky[s]);
+      if (s == 6) {
+        xnew = sx;
+        ynew = sy;
+      }
+    }
+    len = 0.5 * (len0 + len);
+
   } else {
     fprintf(stderr, "Invalid integrator: %d\n", integrator);
     return (0.0);
@@ -347,16 +1007,454 @@ float VectorField::integrate(
 
 
 /******************************************************************************
-Make all non-zero vectors have magnitude 1.
+Find ahead of time where a field carries the points of a lattice.  The
+lattice has a given number of nodes across each cell of the field's grid,
+and from each node a fragment of streamline is followed forwards and
+backwards for a number of steps with the current integrator.  A finer
+lattice or shorter fragments make streamlines followed with the map closer
+to those followed through the field itself.
+
+Entry:
+  field - vector field to follow
+  res   - number of lattice nodes across each grid cell
+  num   - number of steps in each fragment
+  delta - time of each step
+******************************************************************************/
+
+FlowMap::FlowMap(VectorField *field, int res, int num, float delta)
+{
+  vf = field;
+  dt = fabs(delta);
+
+  steps = num;
+  if (steps < 1)
+    steps = 1;
+  if (steps > FLOW_MAX_STEPS)
+    steps = FLOW_MAX_STEPS;
+
+  if (res < 1)
+    res = 1;
+
+  xnodes = (vf->xsize - 1) * res + 1;
+  ynodes = (vf->ysize - 1) * res + 1;
+  xspace = 1.0 / (xnodes - 1);
+  yspace = vf->getaspect() / (ynodes - 1);
+
+  frags = new float[(long) xnodes * ynodes * 2 * steps * 3];
+  float *f = frags;
+
+  for (int j = 0; j < ynodes; j++)
+    for (int i = 0; i < xnodes; i++) {
+
+      /* (the last row and column are put right on the edge, since */
+      /* rounding could leave them outside the field) */
+
+      float x0 = (i == xnodes - 1) ? 1.0 : i * xspace;
+      float y0 = (j == ynodes - 1) ? vf->getaspect() : j * yspace;
+
+      for (int dir = 1; dir >= -1; dir -= 2) {
+        float x = x0;
+        float y = y0;
+        for (int k = 0; k < steps; k++) {
+          float len = vf->integrate(x, y, dir * dt, 0, x, y);
+          f[0] = x - x0;
+          f[1] = y - y0;
+          f[2] = len;
+          f += 3;
+        }
+      }
+    }
+
+  /* mark the cells whose corners go such different ways that blending */
+  /* their fragments would be wrong, as happens near sources and sinks, */
+  /* and those where the field is weak enough that a streamline might stop */
+
+  int node_size = 2 * steps * 3;
+  rough = new unsigned char[(long) (xnodes - 1) * (ynodes - 1) * 2];
+  unsigned char *r = rough;
+
+  for (int dir = 0; dir < 2; dir++)
+    for (int j = 0; j < ynodes - 1; j++)
+      for (int i = 0; i < xnodes - 1; i++) {
+
+        float *corner[4];
+        corner[0] = frags + (long) (j * xnodes + i) * node_size +
+                    dir * steps * 3;
+        corner[1] = corner[0] + node_size;
+        corner[2] = corner[0] + (long) xnodes * node_size;
+        corner[3] = corner[2] + node_size;
+
+        float ex[4], ey[4];
+        float travel = 0;
+        float weakest = FLOW_WEAK;
+        for (int c = 0; c < 4; c++) {
+          ex[c] = corner[c][3 * (steps - 1)];
+          ey[c] = corner[c][3 * (steps - 1) + 1];
+          for (int k = 0; k < steps; k++) {
+            float len = corner[c][3 * k + 2];
+            travel += len;
+            if (len < weakest)
+              weakest = len;
+          }
+        }
+        travel *= 0.25 * dt;
+
+        float spread = 0;
+        for (int a = 0; a < 4; a++)
+          for (int b = a + 1; b < 4; b++) {
+            float d = hypot(ex[a] - ex[b], ey[a] - ey[b]);
+            if (d > spread)
+              spread = d;
+          }
+
+        *r++ = (spread > FLOW_SPREAD * travel || weakest < FLOW_WEAK);
+      }
+}
+
+
+/******************************************************************************
+Free a flow map.
+******************************************************************************/
+
+FlowMap::~FlowMap()
+{
+  delete[] frags;
+  delete[] rough;
+}
+
+
+/******************************************************************************
+Find the fragment of streamline starting at a given position, by blending
+those of the four nearest lattice nodes.  Nothing is found in cells where
+the corners' fragments are too different to blend.
+
+Entry:
+  x,y - starting position
+  dir - 1 to go forwards, -1 to go backwards
+
+Exit:
+  xs,ys - positions at the start and after each step (steps + 1 of them)
+  lens  - length of the field vector over each step
+  returns 0 if the fragment must be found by following the field instead
+******************************************************************************/
+
+int FlowMap::fragment(
+        float x,
+        float y,
+        int dir,
+        float *xs,
+        float *ys,
+        float *lens
+)
+{
+  int k;
+
+  xs[0] = x;
+  ys[0] = y;
+
+  /* the field is zero outside itself, so nothing moves there */
+
+  if (!(x >= 0 && x <= 1 && y >= 0 && y <= vf->getaspect())) {
+    for (k = 0; k < steps; k++) {
+      xs[k + 1] = x;
+      ys[k + 1] = y;
+      lens[k] = 0.0;
+    }
+    return (1);
+  }
+
+  float s = x / xspace;
+  float t = y / yspace;
+  int i = (int) s;
+  int j = (int) t;
+  if (i > xnodes - 2)
+    i = xnodes - 2;
+  if (j > ynodes - 2)
+    j = ynodes - 2;
+  s -= i;
+  t -= j;
+
+  int which = (dir < 0) ? 1 : 0;
+  if (rough[((long) which * (ynodes - 1) + j) * (xnodes - 1) + i])
+    return (0);
+
+  float w00 = (1 - s) * (1 - t);
+  float w10 = s * (1 - t);
+  float w01 = (1 - s) * t;
+  float w11 = s * t;
+
+  int node_size = 2 * steps * 3;
+  float *f00 = frags + (long) (j * xnodes + i) * node_size + which * steps * 3;
+  float *f10 = f00 + node_size;
+  float *f01 = f00 + (long) xnodes * node_size;
+  float *f11 = f01 + node_size;
+
+  for (k = 0; k < steps; k++) {
+    xs[k + 1] = x + w00 * f00[0] + w10 * f10[0] + w01 * f01[0] + w11 * f11[0];
+    ys[k + 1] = y + w00 * f00[1] + w10 * f10[1] + w01 * f01[1] + w11 * f11[1];
+    lens[k] = w00 * f00[2] + w10 * f10[2] + w01 * f01[2] + w11 * f11[2];
+    f00 += 3;
+    f10 += 3;
+    f01 += 3;
+    f11 += 3;
+  }
+
+  return (1);
+}
+
+
+/******************************************************************************
+Start following a streamline.
+
+Entry:
+  field - vector field to follow
+  x,y   - starting position
+  delta - time between the points to hand out (negative to go backwards)
+******************************************************************************/
+
+FieldTracer::FieldTracer(VectorField *field, float x, float y, float delta)
+{
+  vf = field;
+  method = integrator;
+  dt = delta;
+  sign = (delta < 0) ? -1.0 : 1.0;
+  h = 0;
+  h_next = 4 * fabs(delta);
+  pos = 0;
+  x1 = x;
+  y1 = y;
+  samples = 0;
+  flow = vf->get_flow_map();
+}
+
+
+/******************************************************************************
+Take one adaptive step beyond the current one, shrinking it until its
+estimated error is within the tolerance, but never below the spacing of the
+points to be handed out.
+******************************************************************************/
+
+void FieldTracer::take_step()
+{
+  int s, r;
+  double min_h = fabs(dt);
+  double max_h = RK45_MAX_STEP * min_h;
+  double err;
+
+  /* the new step starts where the old one ended, with the field there */
+  /* already known unless this is the first step */
+
+  if (h == 0) {
+    float kx, ky;
+    len1 = vf->xyval(x1, y1, 0, kx, ky);
+    k[6][0] = sign * kx;
+    k[6][1] = sign * ky;
+    samples++;
+  }
+
+  x0 = x1;
+  y0 = y1;
+  len0 = len1;
+  k[0][0] = k[6][0];
+  k[0][1] = k[6][1];
+
+  h = h_next;
+  if (h < min_h) h = min_h;
+  if (h > max_h) h = max_h;
+
+  for (;;) {
+
+    /* find the field at each stage; the last stage is at the end */
+
+    for (s = 1; s < 7; s++) {
+      double sx = x0;
+      double sy = y0;
+      for (r = 0; r < s; r++) {
+        sx += h * dp_a[s][r] * k[r][0];
+        sy += h * dp_a[s][r] * k[r][1];
+      }
+      float kx, ky;
+      float len = vf->xyval(sx, sy, 0, kx, ky);
+      k[s][0] = sign * kx;
+      k[s][1] = sign * ky;
+      if (s == 6) {
+        x1 = sx;
+        y1 = sy;
+        len1 = len;
+      }
+    }
+    samples += 6;
+
+    /* estimate the error */
+
+    double ex = 0;
+    double ey = 0;
+    for (s = 0; s < 7; s++) {
+      ex += dp_e[s] * k[s][0];
+      ey += dp_e[s] * k[s][1];
+    }
+    err = h * (fabs(ex) > fabs(ey) ? fabs(ex) : fabs(ey)) / tolerance;
+
+    if (err <= 1 || h <= min_h)
+      break;
+
+    /* too large, so try a shorter step */
+
+    h *= (err > 3125) ? 0.2 : 0.9 * pow(err, -0.2);
+    if (h < min_h)
+      h = min_h;
+  }
+
+  /* suggest the size of the next step */
+
+  if (err < 1e-4)
+    h_next = 5 * h;
+  else
+    h_next = h * fmin(5.0, fmax(0.2, 0.9 * pow(err, -0.2)));
+
+  /* set up the interpolant across the step */
+
+  for (int i = 0; i < 2; i++) {
+    double start = (i == 0) ? x0 : y0;
+    double diff = ((i == 0) ? x1 : y1) - start;
+    double bspl = h * k[0][i] - diff;
+    double sum = 0;
+    for (s = 0; s < 7; s++)
+      sum += dp_d[s] * k[s][i];
+    cont[0][i] = start;
+    cont[1][i] = diff;
+    cont[2][i] = bspl;
+    cont[3][i] = diff - h * k[6][i] - bspl;
+    cont[4][i] = h * sum;
+  }
+}
+
+
+/******************************************************************************
+Start a new fragment at the last point handed out, either from the flow map
+or, where the map can't be used, by following the field itself with the
+tracer's own steps.
+
+Entry:
+  x,y - last point handed out
+******************************************************************************/
+
+void FieldTracer::take_fragment(float x, float y)
+{
+  int steps = flow->get_steps();
+  double ratio = flow->get_dt() / fabs(dt);
+
+  if (ratio * steps >= 1 && flow->fragment(x, y, (int) sign, fx, fy, flen))
+    fscale = ratio;
+  else {
+    fx[0] = x;
+    fy[0] = y;
+    for (int k = 0; k < steps; k++) {
+      flen[k] = vf->integrate(x, y, dt, 0, x, y);
+      fx[k + 1] = x;
+      fy[k + 1] = y;
+    }
+    samples += steps * ((method == EULER) ? 1 :
+                        (method == RUNGE_KUTTA) ? 4 : 2);
+    fscale = 1;
+  }
+
+  h = steps * fscale;
+  pos = 0;
+}
+
+
+/******************************************************************************
+Move on to the next point along the streamline.
+
+Entry:
+  x,y - current position, which the adaptive integrator ignores since it
+        keeps its own more precise copy
+
+Exit:
+  x,y - new position
+  returns the length of the field vector over the step
+******************************************************************************/
+
+float FieldTracer::step(float &x, float &y)
+{
+  if (flow) {
+
+    /* (times are counted in steps of the tracer from the fragment's start) */
+
+    if (h == 0 || pos + 1 > h)
+      take_fragment(x, y);
+    pos += 1;
+
+    /* the point lies on the step from n to n + 1 of the fragment */
+
+    double s = pos / fscale;
+    int n = (int) ceil(s) - 1;
+    if (n < 0)
+      n = 0;
+    float t = s - n;
+
+    if (t == 1) {
+      x = fx[n + 1];
+      y = fy[n + 1];
+    } else {
+      x = fx[n] + t * (fx[n + 1] - fx[n]);
+      y = fy[n] + t * (fy[n + 1] - fy[n]);
+    }
+
+    return (flen[n]);
+  }
+
+  if (method != RK45) {
+    samples += (method == EULER) ? 1 : (method == RUNGE_KUTTA) ? 4 : 2;
+    return (vf->integrate(x, y, dt, 0, x, y));
+  }
+
+  /* move to the step that holds the next point */
+
+  pos += fabs(dt);
+
+  while (h == 0 || pos > h) {
+    pos -= h;
+    take_step();
+  }
+
+  /* find it on the interpolant */
+
+  double theta = pos / h;
+  double theta1 = 1 - theta;
+
+  x = cont[0][0] + theta * (cont[1][0] + theta1 * (cont[2][0] +
+        theta * (cont[3][0] + theta1 * cont[4][0])));
+  y = cont[0][1] + theta * (cont[1][1] + theta1 * (cont[2][1] +
+        theta * (cont[3][1] + theta1 * cont[4][1])));
+
+  return (len0 + theta * (len1 - len0));
+}
+
+
+/******************************************************************************
+Make all non-zero vectors have magnitude 1.  A tiled field's vectors are
+normalized as each tile is decoded.
 ******************************************************************************/
 
 void VectorField::normalize()
 {
+  if (tiles) {
+    tiles->set_normalized();
+    return;
+  }
+
   for (int i = 0; i < xsize * ysize * 2; i += 2) {
     float x2 = values[i] * values[i];
     float y2 = values[i + 1] * values[i + 1];
     float len = sqrt(x2 + y2);
-    if (len != 0) {
+
+    /* (vectors already of unit length, to within rounding, are left alone */
+    /* so that the pages of a mapped file that was normalized before are */
+    /* never written and stay shared) */
+
+    if (len != 0 && fabs(len - 1) > NORMAL_SLOP) {
       float recip = 1 / len;
       values[i] *= recip;
       values[i + 1] *= recip;
@@ -366,11 +1464,50 @@ void VectorField::normalize()
 
 
 /******************************************************************************
-Return a scalar image that contains the magnitude of the vector field.
+Find the vector at a point of the field's grid, whether or not the field is
+tiled.
+
+Entry:
+  i,j - the point
+
+Exit:
+  x,y - the vector there
+******************************************************************************/
+
+void VectorField::grid_vector(int i, int j, float &x, float &y)
+{
+  if (tiles)
+    tiles->vector(i, j, x, y);
+  else {
+    x = values[2 * ((size_t) j * xsize + i)];
+    y = values[2 * ((size_t) j * xsize + i) + 1];
+  }
+}
+
+
+/******************************************************************************
+Return a scalar image that contains the magnitude of the vector field.  For
+a tiled field, the image is of every so many vectors, so that it is no more
+than MAGNITUDE_MAX on a side.
 ******************************************************************************/
 
 FloatImage *VectorField::get_magnitude()
 {
+  if (tiles) {
+    int larger = (xsize > ysize) ? xsize : ysize;
+    int every = (larger - 1) / MAGNITUDE_MAX + 1;
+    int xs = (xsize - 1) / every + 1;
+    int ys = (ysize - 1) / every + 1;
+    FloatImage *image = new FloatImage(xs, ys);
+    for (int j = 0; j < ys; j++)
+      for (int i = 0; i < xs; i++) {
+        float x, y;
+        tiles->vector(i * every, j * every, x, y);
+        image->pixel(i, j) = sqrt(x * x + y * y);
+      }
+    return (image);
+  }
+
   FloatImage *image = new FloatImage(xsize, ysize);
 
   for (int i = 0; i < xsize * ysize * 2; i += 2) {
@@ -403,8 +1540,13 @@ FloatImage *VectorField::get_vorticity(int xs, int ys)
 
   for (i = 1; i < xsize - 1; i++)
     for (j = 1; j < ysize - 1; j++) {
-      float dx = yval(i + 1, j) - yval(i - 1, j);
-      float dy = xval(i, j + 1) - xval(i, j - 1);
+      float x0, y0, x1, y1, x2, y2, x3, y3;
+      grid_vector(i - 1, j, x0, y0);
+      grid_vector(i + 1, j, x1, y1);
+      grid_vector(i, j - 1, x2, y2);
+      grid_vector(i, j + 1, x3, y3);
+      float dx = y1 - y0;
+      float dy = x3 - x2;
       float vort = (dx / d) - (dy / d);
       image->pixel(i - 1, j - 1) = vort;
     }
@@ -443,8 +1585,13 @@ FloatImage *VectorField::get_divergence(int xs, int ys)
 
   for (i = 1; i < xsize - 1; i++)
     for (j = 1; j < ysize - 1; j++) {
-      float dx = xval(i + 1, j) - xval(i - 1, j);
-      float dy = yval(i, j + 1) - yval(i, j - 1);
+      float x0, y0, x1, y1, x2, y2, x3, y3;
+      grid_vector(i - 1, j, x0, y0);
+      grid_vector(i + 1, j, x1, y1);
+      grid_vector(i, j - 1, x2, y2);
+      grid_vector(i, j + 1, x3, y3);
+      float dx = x1 - x0;
+      float dy = y3 - y2;
       float div = (dx + dy) / (2 * d);
       image->pixel(i - 1, j - 1) = div;
     }
@@ -462,3 +1609,204 @@ FloatImage *VectorField::get_divergence(int xs, int ys)
   return (image2);
 }
 
+
+/******************************************************************************
+Find the value of one of the analytic fields that mfield makes, at a point
+in the field's [0,1] x [0,1] coordinates.
+
+Entry:
+  which - 0 for the circle, 1 for the saddle, 2 for flow around a cylinder
+  x,y   - where to find the value
+
+Exit:
+  fx,fy - field value
+******************************************************************************/
+
+static void analytic_field(int which, float x, float y, float &fx, float &fy)
+{
+  x -= 0.5;
+  y -= 0.5;
+
+  if (which == 0) {
+    fx = y;
+    fy = -x;
+  } else if (which == 1) {
+    fx = y;
+    fy = x;
+  } else {
+    float U = 0.5;
+    float a = 0.25;
+    float r = sqrt(x * x + y * y);
+    float theta = (r == 0) ? 0 : atan2(y, x);
+    float rr = (r == 0) ? 1 : a * a / (r * r);
+    float u_radius = U * (1 - rr) * cos(theta);
+    float u_theta = -U * (1 + rr) * sin(theta);
+    fx = u_radius * cos(theta) - u_theta * sin(theta);
+    fy = u_radius * sin(theta) + u_theta * cos(theta);
+  }
+}
+
+
+/******************************************************************************
+Find where a streamline ends up after a given time, very accurately, for
+judging the integrators.  This takes many small fourth-order steps while
+keeping the position in double precision.
+
+Entry:
+  vf    - field to follow
+  x,y   - starting position
+  dt    - time to follow it for
+  steps - number of steps to take
+
+Exit:
+  x,y - final position
+  returns 0 if the streamline came near the edge of the field, 1 if not
+******************************************************************************/
+
+static int reference_trace(VectorField *vf, double &x, double &y,
+                           double dt, int steps)
+{
+  float x1, y1, x2, y2, x3, y3, x4, y4;
+
+  for (int i = 0; i < steps; i++) {
+    vf->xyval(x, y, 0, x1, y1);
+    vf->xyval(x + 0.5 * dt * x1, y + 0.5 * dt * y1, 0, x2, y2);
+    vf->xyval(x + 0.5 * dt * x2, y + 0.5 * dt * y2, 0, x3, y3);
+    vf->xyval(x + dt * x3, y + dt * y3, 0, x4, y4);
+    x += dt * (x1 + 2.0 * x2 + 2.0 * x3 + x4) / 6;
+    y += dt * (y1 + 2.0 * y2 + 2.0 * y3 + y4) / 6;
+    if (x < 0.02 || x > 0.98 || y < 0.02 || y > 0.98)
+      return (0);
+  }
+
+  return (1);
+}
+
+
+/******************************************************************************
+Compare the integrators on the circle, saddle and cylinder fields of mfield.
+Streamlines are followed from random points for a fixed time, and the
+number of field values looked up per unit length of streamline and the
+error in the final position are reported for each integrator.  The same is
+then reported for flow maps with 1, 2 and 4 lattice nodes per grid cell,
+made with the integrator that was chosen; streamlines followed with a map
+only look up field values where the map can't be used.
+
+Entry:
+  num   - number of streamlines to follow in each field
+  delta - time between streamline points
+******************************************************************************/
+
+void integration_benchmark(int num, float delta)
+{
+  const char *field_names[3] = {"circle", "saddle", "cylinder"};
+  int size = 64;
+  int steps = 200;
+  int refine = 64;
+  int save_integrator = integrator;
+
+  double *xs = new double[num];
+  double *ys = new double[num];
+  double *xend = new double[num];
+  double *yend = new double[num];
+
+  for (int which = 0; which < 3; which++) {
+
+    /* sample the field onto a grid, as mfield does */
+
+    VectorField *vf = new VectorField(size, size);
+    for (int j = 0; j < size; j++)
+      for (int i = 0; i < size; i++) {
+        float fx, fy;
+        analytic_field(which, i / (size - 1.0), j / (size - 1.0), fx, fy);
+        vf->xval(i, j) = fx;
+        vf->yval(i, j) = fy;
+      }
+
+    /* pick starting points whose streamlines stay clear of the edges, */
+    /* where the field drops to zero, and find where they end up */
+
+    unsigned short seed[3] = {1, 2, 3};
+    int count = 0;
+
+    for (int tries = 0; count < num && tries < 100 * num; tries++) {
+      double x = 0.05 + 0.9 * erand48(seed);
+      double y = 0.05 + 0.9 * erand48(seed);
+      double r = sqrt((x - 0.5) * (x - 0.5) + (y - 0.5) * (y - 0.5));
+      if (r < 0.1 || (which == 2 && r < 0.3))
+        continue;
+      xs[count] = x;
+      ys[count] = y;
+      if (reference_trace(vf, x, y, delta / refine, steps * refine)) {
+        xend[count] = x;
+        yend[count] = y;
+        count++;
+      }
+    }
+
+    printf("%s field, %d streamlines of %d steps:\n",
+           field_names[which], count, steps);
+
+    /* follow the same streamlines with each integrator, and then with */
+    /* flow maps of a few resolutions made with the chosen integrator */
+
+    for (int type = EULER; type <= RK45 + 3; type++) {
+
+      FlowMap *map = NULL;
+      char name[80];
+
+      if (type <= RK45) {
+        integrator = type;
+        strcpy(name, integration_name(type));
+      } else {
+        integrator = save_integrator;
+        int res = 1 << (type - RK45 - 1);
+        map = new FlowMap(vf, res, 8, delta);
+        vf->set_flow_map(map);
+        sprintf(name, "flow map %d", res);
+      }
+
+      double length = 0;
+      double max_err = 0;
+      double sum_err = 0;
+      long samples = 0;
+
+      for (int n = 0; n < count; n++) {
+        float x = xs[n];
+        float y = ys[n];
+        FieldTracer tracer(vf, x, y, delta);
+        for (int i = 0; i < steps; i++) {
+          float xold = x;
+          float yold = y;
+          tracer.step(x, y);
+          length += sqrt((x - xold) * (x - xold) + (y - yold) * (y - yold));
+        }
+        samples += tracer.samples;
+        double err = sqrt((x - xend[n]) * (x - xend[n]) +
+                          (y - yend[n]) * (y - yend[n]));
+        sum_err += err;
+        if (err > max_err)
+          max_err = err;
+      }
+
+      printf("  %-12s %8.1f samples per unit length, endpoint error %.3g max"
+             " %.3g mean\n", name,
+             length > 0 ? samples / length : 0.0,
+             max_err, count > 0 ? sum_err / count : 0.0);
+
+      if (map) {
+        vf->set_flow_map(NULL);
+        delete map;
+      }
+    }
+
+    delete vf;
+  }
+
+  integrator = save_integrator;
+
+  delete[] xs;
+  delete[] ys;
+  delete[] xend;
+  delete[] yend;
+}
@@ -19,13 +19,84 @@ warranty of merchantability or fitness for a particular purpose.
 #ifndef _VECTOR_FIELD_CLASS_
 #define _VECTOR_FIELD_CLASS_
 
+#include <mutex>
+#include <atomic>
 #include "../libs/floatimage.h"
+#include "vecfile.h"
+
+class FlowMap;
+
+
+/* the decoded vectors of one tile, shared by the field and by the threads */
+/* that are reading them; it is freed when the last of these lets go */
+
+class TileBuffer
+{
+public:
+    std::atomic<int> refs;  /* holds on the buffer, the field's included */
+    float *data;
+
+    TileBuffer(size_t count) : refs(1)
+    { data = new float[count]; }
+
+    ~TileBuffer()
+    { delete[] data; }
+};
+
+
+/* the tiles of a tiled .vec file, decoded as they are needed and kept */
+/* until the memory they are allowed is used up, when the ones that have */
+/* gone longest without being looked at are dropped; several threads may */
+/* look at the field at once, each holding on to the few tiles it looked */
+/* at last and reading them where they lie, so the lock is only taken */
+/* when a thread moves on to a tile it doesn't hold */
+
+class FieldTiles
+{
+    VecFile *file;
+    int tile;               /* cells on a side of each tile */
+    int side;               /* vectors on a side of each tile (tile + 1) */
+    int xtiles, ytiles;     /* number of tiles across and down */
+    int normalized;         /* whether vectors are normalized when decoded */
+    TileBuffer **data;      /* each tile's vectors, or NULL if not decoded */
+    long *last_used;        /* when each tile was last looked at */
+    int *resident;          /* the tiles that are decoded */
+    int num_resident;
+    long clock;             /* count of looks, for last_used */
+    long id;                /* names the tiles in the threads' holds */
+    std::mutex lock;
+
+    void load(int);
+    int hold_tile(int);
+public:
+    long loads;             /* number of tiles decoded */
+
+    FieldTiles(VecFile *);
+    ~FieldTiles();
+
+    void cell(int, int, float *);
+    void vector(int, int, float &, float &);
+    void set_normalized();
+
+    int get_tile()
+    { return (tile); }
+
+    int get_resident()
+    { return (num_resident); }
+};
 
 class VectorField
 {
     float *values;
     float aspect;
     float aspect_recip;
+    float xscale, yscale;   /* grid spacings across and down, as floats */
+    FlowMap *flow_map;      /* flow found ahead of time, or NULL */
+    VecFile *file;          /* file the values are mapped from, or NULL */
+    FieldTiles *tiles;      /* tiles to look up values in instead, or NULL */
+
+    void bilinear(float, float, float &, float &);
+    void read_file(char *, int);
 public:
     int xsize, ysize;
 
@@ -35,14 +106,25 @@ public:
       ysize = h;
       aspect = h / (float) w;
       aspect_recip = 1.0 / aspect;
+      xscale = xsize - 1;
+      yscale = ysize - 1;
       values = new float[xsize * ysize * 2];
+      flow_map = NULL;
+      file = NULL;
+      tiles = NULL;
     }
 
     VectorField(char *filename);
+    VectorField(char *filename, int frame);
 
     ~VectorField()
     {
-      delete values;
+      delete tiles;
+      if (file) {
+        close_vec_file(*file);
+        delete file;
+      } else
+        delete[] values;
     }
 
     float xval(float x, float y);
@@ -51,6 +133,12 @@ public:
 
     float xyval(float, float, int, float &, float &);
 
+    void xyval_batch(int, const float *, const float *, int,
+                     float *, float *, float *);
+
+    /* (these reach the grid's values directly, so they can only be used */
+    /* on fields that aren't tiled; grid_vector() reads either kind) */
+
     float &xval(int x, int y)
     {
       return (values[2 * (y * xsize + x)]);
@@ -71,8 +159,23 @@ public:
       return (values[2 * index + 1]);
     }
 
+    void grid_vector(int, int, float &, float &);
+
     float integrate(float, float, float, int, float &, float &);
 
+    void integrate_batch(int, float *, float *, float, int, float *);
+
+    void integrate_batch(int, float *, float *, const float *, int, float *);
+
+    void set_flow_map(FlowMap *map)
+    { flow_map = map; }
+
+    FlowMap *get_flow_map()
+    { return (flow_map); }
+
+    FieldTiles *get_tiles()
+    { return (tiles); }
+
     int getwidth()
     { return (xsize); }
 
@@ -91,13 +194,105 @@ public:
     void normalize();
 
     void write_file(char *);
+    void write_file(char *, int);
 };
 
 void set_integration(int);  /* set which type of integrator to use */
+int get_integration();
+const char *integration_name(int);
+void set_integration_tolerance(float);
+float get_integration_tolerance();
+void integration_benchmark(int, float);
+void set_tile_cache(long);
+long get_tile_cache();
 
 #define EULER        1
 #define MIDPOINT     2
 #define RUNGE_KUTTA  3
+#define RK45         4   /* adaptive Dormand-Prince */
+
+#define RK45_MAX_STEP  64   /* longest adaptive step, in output steps */
+#define BATCH_CHUNK    64   /* positions handled together by integrate_batch */
+#define FLOW_MAX_STEPS 64   /* longest fragment of a flow map, in steps */
+#define FLOW_SPREAD  0.25   /* how far apart, as a fraction of their length, */
+                            /* the fragments at a cell's corners may end */
+#define FLOW_WEAK    0.5    /* field length below which the map isn't used, */
+                            /* well above where streamlines stop */
+#define TILE_CACHE_MB 256   /* default memory for a tiled field's tiles */
+#define TILE_MIN        4   /* fewest tiles kept, however little memory */
+#define TILE_HOLDS      4   /* tiles each thread holds on to */
+#define MAGNITUDE_MAX 1024  /* largest side of a tiled field's magnitude */
+
+
+/* where the field carries points over a short time, found ahead of time */
+/* for a lattice of starting points; each lattice node keeps a fragment of */
+/* streamline going forward and one going backward, and a fragment from */
+/* anywhere else is blended from those of the nearest four nodes */
+
+class FlowMap
+{
+    VectorField *vf;
+    int steps;              /* integration steps in each fragment */
+    float dt;               /* time of each step */
+    int xnodes, ynodes;     /* size of the lattice */
+    float xspace, yspace;   /* distance between lattice nodes */
+    float *frags;           /* displacement from the node and field length */
+                            /* at each step, forward then backward */
+    unsigned char *rough;   /* cells, forward then backward, whose corners' */
+                            /* fragments are too different to blend */
+public:
+    FlowMap(VectorField *, int, int, float);
+    ~FlowMap();
+
+    int fragment(float, float, int, float *, float *, float *);
+
+    int get_steps()
+    { return (steps); }
+
+    float get_dt()
+    { return (dt); }
+
+    long get_bytes()
+    { return ((long) xnodes * ynodes * 2 * steps * 3 * sizeof(float)); }
+};
+
+
+/* follows a streamline through a field, handing out points spaced evenly */
+/* in time; the adaptive integrator takes steps as long as its error */
+/* allows and finds the points in between by interpolation, and a field */
+/* with a flow map is followed by joining up fragments of the map */
+
+class FieldTracer
+{
+    VectorField *vf;
+    int method;             /* integrator in use when the tracer was made */
+    float dt;               /* time between points handed out */
+    double sign;            /* direction of travel */
+    double h;               /* length of current step, or 0 if none yet */
+    double h_next;          /* suggested length of the next step */
+    double pos;             /* time of the last point, from start of step */
+    double x0, y0;          /* start of current step */
+    double x1, y1;          /* end of current step */
+    double k[7][2];         /* field at each stage of the step */
+    double cont[5][2];      /* interpolant across the step */
+    float len0, len1;       /* field magnitude at start and end of step */
+    FlowMap *flow;          /* flow map to stitch fragments from, or NULL */
+    double fscale;          /* time of each step of the fragment, in steps */
+                            /* of the tracer */
+    float fx[FLOW_MAX_STEPS + 1];   /* current fragment of the flow map */
+    float fy[FLOW_MAX_STEPS + 1];
+    float flen[FLOW_MAX_STEPS];
+
+    void take_step();
+    void take_fragment(float, float);
+
+public:
+    int samples;            /* number of field values looked up */
+
+    FieldTracer(VectorField *, float, float, float);
+
+    float step(float &, float &);
+};
 
 #endif /* _VECTOR_FIELD_CLASS_ */
 